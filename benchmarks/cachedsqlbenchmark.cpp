@@ -0,0 +1,500 @@
+//Benchmarks the select, fetch, edit, sort and submit paths of CachedSqlTableModel against generated SQLite tables
+//and writes the timings as JSON so they can be tracked between upgrades
+#include "cachedrow.h"
+#include "cachedsqltablemodel.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+#include <algorithm>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace {
+
+//Number of extra columns of each type in the wide schema, the narrow schema has one of each
+const int WideColumnsPerType = 10;
+
+//Largest burst of setData() calls per fixture, a fraction of the table beyond that says nothing new
+const int MaxEditRows = 100000;
+
+struct Fixture
+{
+    QString storage;   //"memory" or "file"
+    QString schema;    //"narrow" or "wide"
+    int rows;
+};
+
+//Resident set size of the process, -1 where it cannot be read
+qint64 residentBytes()
+{
+#ifdef Q_OS_LINUX
+    QFile statm(QStringLiteral("/proc/self/statm"));
+
+    if (!statm.open(QIODevice::ReadOnly))
+        return -1;
+
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+
+    if (fields.count() < 2)
+        return -1;
+
+    return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE);
+#else
+    return -1;
+#endif
+}
+
+//Hand freed memory back to the system so that consecutive RSS measurements do not reuse each other's heap
+void releaseFreedMemory()
+{
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
+
+QStringList columnDefinitions(const QString &schema)
+{
+    const int perType = schema == QLatin1String("wide") ? WideColumnsPerType : 1;
+    QStringList columns{QStringLiteral("id INTEGER PRIMARY KEY")};
+
+    for (int i = 0; i < perType; ++i) {
+        columns.append(QStringLiteral("name%1 TEXT").arg(i));
+        columns.append(QStringLiteral("amount%1 REAL").arg(i));
+        columns.append(QStringLiteral("created%1 INTEGER").arg(i));
+    }
+
+    return columns;
+}
+
+bool populate(QSqlDatabase &db, const QString &schema, int rows)
+{
+    QSqlQuery query(db);
+    const QStringList columns = columnDefinitions(schema);
+
+    if (!query.exec(QStringLiteral("CREATE TABLE bench (%1)").arg(columns.join(QLatin1String(", "))))) {
+        qWarning() << "create table failed:" << query.lastError().text();
+        return false;
+    }
+
+    //Bind whole column lists and let the driver run them as one batch, committed once
+    QStringList placeholders;
+    for (int i = 0; i < columns.count(); ++i)
+        placeholders.append(QStringLiteral("?"));
+
+    if (!db.transaction() || !query.prepare(QStringLiteral("INSERT INTO bench VALUES (%1)").arg(placeholders.join(QLatin1String(", "))))) {
+        qWarning() << "prepare insert failed:" << query.lastError().text();
+        return false;
+    }
+
+    const int chunk = 10000;
+
+    for (int first = 0; first < rows; first += chunk) {
+        const int count = qMin(chunk, rows - first);
+        QVector<QVariantList> values(columns.count());
+
+        for (QVariantList &column : values)
+            column.reserve(count);
+
+        for (int row = first; row < first + count; ++row) {
+            values[0].append(row + 1);
+
+            for (int c = 1; c < columns.count(); c += 3) {
+                //Scatter the values so that sorting does real work
+                const quint32 scrambled = quint32(row) * 2654435761u + quint32(c);
+                values[c].append(QStringLiteral("name %1").arg(scrambled % 1000003));
+                values[c + 1].append(double(scrambled % 100000) / 100.0);
+                values[c + 2].append(qint64(scrambled));
+            }
+        }
+
+        for (int c = 0; c < columns.count(); ++c)
+            query.addBindValue(values.at(c));
+
+        if (!query.execBatch()) {
+            qWarning() << "insert failed:" << query.lastError().text();
+            db.rollback();
+            return false;
+        }
+    }
+
+    return db.commit();
+}
+
+QJsonObject result(const QString &name, qint64 nsecs, qint64 operations)
+{
+    return QJsonObject{
+        {QStringLiteral("name"), name},
+        {QStringLiteral("nsecs"), nsecs},
+        {QStringLiteral("operations"), operations},
+        {QStringLiteral("nsecsPerOperation"), operations > 0 ? double(nsecs) / operations : 0.0}
+    };
+}
+
+//Compares the memory held by one QSqlRecord per row, as the cache stored rows originally, against CachedRow
+QJsonObject memoryComparison(const QSqlRecord &schema, const QVector<CachedRowValues> &sample, int rows)
+{
+    QJsonObject memory;
+
+    releaseFreedMemory();
+    qint64 before = residentBytes();
+
+    {
+        QVector<CachedRow> cache;
+        cache.reserve(rows);
+
+        for (int row = 0; row < rows; ++row) {
+            //Copy element-wise, copying the vector itself would only share the sample's storage
+            const CachedRowValues &values = sample.at(row % sample.count());
+            cache.append(CachedRow(CachedRow::None, CachedRowValues(values.cbegin(), values.cend())));
+        }
+
+        memory.insert(QStringLiteral("cachedRowBytes"), residentBytes() - before);
+    }
+
+    releaseFreedMemory();
+    before = residentBytes();
+
+    {
+        QVector<QSqlRecord> records;
+        records.reserve(rows);
+
+        for (int row = 0; row < rows; ++row) {
+            QSqlRecord rec(schema);
+            const CachedRowValues &values = sample.at(row % sample.count());
+
+            for (int c = 0; c < values.count(); ++c)
+                rec.setValue(c, values.at(c));
+
+            records.append(rec);
+        }
+
+        memory.insert(QStringLiteral("sqlRecordBytes"), residentBytes() - before);
+    }
+
+    releaseFreedMemory();
+    memory.insert(QStringLiteral("rows"), rows);
+
+    return memory;
+}
+
+QJsonObject runFixture(const Fixture &fixture, const QString &directory, int batchSize)
+{
+    const QString connectionName = QStringLiteral("bench_%1_%2_%3").arg(fixture.storage, fixture.schema).arg(fixture.rows);
+    QJsonObject report{
+        {QStringLiteral("storage"), fixture.storage},
+        {QStringLiteral("schema"), fixture.schema},
+        {QStringLiteral("rows"), fixture.rows}
+    };
+
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), connectionName);
+        db.setDatabaseName(fixture.storage == QLatin1String("file") ? directory + QLatin1Char('/') + connectionName + QLatin1String(".db")
+                                                                    : QStringLiteral(":memory:"));
+
+        if (!db.open() || !populate(db, fixture.schema, fixture.rows)) {
+            report.insert(QStringLiteral("error"), db.lastError().text());
+            db.close();
+            db = QSqlDatabase();
+            QSqlDatabase::removeDatabase(connectionName);
+            return report;
+        }
+
+        QJsonArray results;
+        QElapsedTimer timer;
+        const qint64 rssBefore = residentBytes();
+
+        {
+            CachedSqlTableModel model(nullptr, db);
+            model.setFetchBatchSize(batchSize);
+            model.setTableName(QStringLiteral("bench"));
+
+            timer.start();
+            model.select();
+            results.append(result(QStringLiteral("select"), timer.nsecsElapsed(), 1));
+
+            timer.start();
+            while (model.canFetchMore())
+                model.fetchMore();
+            results.append(result(QStringLiteral("fetchMoreDrain"), timer.nsecsElapsed(), model.rowCount()));
+
+            report.insert(QStringLiteral("cacheBytes"), residentBytes() - rssBefore);
+
+            const int rows = model.rowCount();
+            const int columns = model.columnCount();
+            qint64 nonNull = 0;
+
+            timer.start();
+            for (int row = 0; row < rows; ++row) {
+                for (int column = 0; column < columns; ++column)
+                    nonNull += model.data(model.index(row, column)).isNull() ? 0 : 1;
+            }
+            results.append(result(QStringLiteral("dataScan"), timer.nsecsElapsed(), qint64(rows) * columns));
+
+            //Sort the cache itself, the result is fully fetched
+            model.setSortMode(CachedSqlTableModel::ClientSort);
+
+            timer.start();
+            model.sort(1, Qt::DescendingOrder);
+            results.append(result(QStringLiteral("sortText"), timer.nsecsElapsed(), rows));
+
+            timer.start();
+            model.sort(3, Qt::AscendingOrder);
+            results.append(result(QStringLiteral("sortInteger"), timer.nsecsElapsed(), rows));
+
+            //Edit every tenth row, spread across the table
+            const int step = qMax(10, rows / MaxEditRows);
+            QVector<int> editRows;
+
+            for (int row = 0; row < rows; row += step)
+                editRows.append(row);
+
+            auto editBurst = [&](const QString &value) {
+                for (int row : std::as_const(editRows))
+                    model.setData(model.index(row, 1), value);
+            };
+
+            timer.start();
+            editBurst(QStringLiteral("edited"));
+            results.append(result(QStringLiteral("setDataBurst"), timer.nsecsElapsed(), editRows.count()));
+
+            const int dirtyChecks = 1000000;
+            bool dirty = false;
+
+            timer.start();
+            for (int i = 0; i < dirtyChecks; ++i)
+                dirty = model.isDirty() || dirty;
+            results.append(result(QStringLiteral("isDirty"), timer.nsecsElapsed(), dirtyChecks));
+
+            timer.start();
+            for (int row : std::as_const(editRows))
+                dirty = model.isDirty(model.index(row, 1)) || dirty;
+            results.append(result(QStringLiteral("isDirtyIndex"), timer.nsecsElapsed(), editRows.count()));
+
+            timer.start();
+            if (!model.submitAll())
+                report.insert(QStringLiteral("error"), model.lastError().text());
+            results.append(result(QStringLiteral("submitAll"), timer.nsecsElapsed(), editRows.count()));
+
+            editBurst(QStringLiteral("reverted"));
+
+            timer.start();
+            model.revertAll();
+            results.append(result(QStringLiteral("revertAll"), timer.nsecsElapsed(), editRows.count()));
+
+            //Find in grid over the text column, first by scanning data() and then through the search index
+            const QString needle = QStringLiteral("4242");
+
+            timer.start();
+            const int scanned = model.findRows(1, needle).count();
+            results.append(result(QStringLiteral("findRowsScan"), timer.nsecsElapsed(), rows));
+
+            timer.start();
+            model.setSearchIndexed(1, true);
+            results.append(result(QStringLiteral("searchIndexBuild"), timer.nsecsElapsed(), rows));
+
+            const int searches = 100;
+            int indexed = 0;
+
+            timer.start();
+            for (int i = 0; i < searches; ++i)
+                indexed = model.findRows(1, needle).count();
+            results.append(result(QStringLiteral("findRowsIndexed"), timer.nsecsElapsed(), searches));
+
+            if (indexed != scanned)
+                report.insert(QStringLiteral("error"), QStringLiteral("Indexed search found %1 rows, scan found %2").arg(indexed).arg(scanned));
+
+            //Stage a paste worth of new rows in bulk and through insertRows() in the middle of the table, dropping them again after each
+            const int pasteRows = qMin(rows, MaxEditRows);
+            QList<QSqlRecord> paste;
+
+            for (int i = 0; i < pasteRows; ++i) {
+                QSqlRecord record = model.record();
+                record.setValue(1, QStringLiteral("pasted %1").arg(i));
+                paste.append(record);
+            }
+
+            timer.start();
+            model.appendRecords(paste);
+            results.append(result(QStringLiteral("appendRecords"), timer.nsecsElapsed(), pasteRows));
+
+            model.revertAll();
+
+            timer.start();
+            model.insertRows(rows / 2, pasteRows);
+            results.append(result(QStringLiteral("insertRowsMiddle"), timer.nsecsElapsed(), pasteRows));
+
+            model.revertAll();
+
+            //Stream the cache to disk in both formats, the export runs on its own thread until exportFinished()
+            auto exportTo = [&](const QString &name, CachedSqlTableModel::ExportFormat format) {
+                QEventLoop loop;
+                QObject::connect(&model, &CachedSqlTableModel::exportFinished, &loop, &QEventLoop::quit);
+                QObject::connect(&model, &CachedSqlTableModel::errorOccurred, &loop, &QEventLoop::quit);
+
+                timer.start();
+
+                if (model.exportRows(directory + QLatin1Char('/') + connectionName + name, format))
+                    loop.exec();
+
+                results.append(result(format == CachedSqlTableModel::CsvExport ? QStringLiteral("exportCsv") : QStringLiteral("exportColumnar"), timer.nsecsElapsed(), rows));
+            };
+
+            exportTo(QStringLiteral(".csv"), CachedSqlTableModel::CsvExport);
+            exportTo(QStringLiteral(".csqc"), CachedSqlTableModel::ColumnarExport);
+
+            report.insert(QStringLiteral("nonNullValues"), nonNull);
+            report.insert(QStringLiteral("dirtyAfterChecks"), dirty);
+
+            //Reuse the fetched rows as the sample for the per-row layout comparison
+            const int sampleRows = qMin(rows, 1000);
+            QVector<CachedRowValues> sample;
+
+            for (int row = 0; row < sampleRows; ++row) {
+                CachedRowValues values(columns);
+
+                for (int column = 0; column < columns; ++column)
+                    values[column] = model.data(model.index(row, column));
+
+                sample.append(values);
+            }
+
+            if (!sample.isEmpty())
+                report.insert(QStringLiteral("memory"), memoryComparison(model.record(), sample, rows));
+        }
+
+        report.insert(QStringLiteral("results"), results);
+        db.close();
+    }
+
+    QSqlDatabase::removeDatabase(connectionName);
+
+    return report;
+}
+
+QList<int> parseRowCounts(const QString &value)
+{
+    QList<int> rows;
+
+    for (const QString &part : value.split(QLatin1Char(','), Qt::SkipEmptyParts)) {
+        bool ok = false;
+        const int count = part.trimmed().toInt(&ok);
+
+        if (ok && count > 0)
+            rows.append(count);
+    }
+
+    return rows;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("cachedsqlbenchmark"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("CachedSqlTableModel benchmarks over generated SQLite tables"));
+    parser.addHelpOption();
+
+    const QCommandLineOption rowsOption(QStringLiteral("rows"), QStringLiteral("Comma separated table sizes."), QStringLiteral("counts"),
+                                        QStringLiteral("10000,100000,1000000"));
+    const QCommandLineOption schemaOption(QStringLiteral("schema"), QStringLiteral("narrow, wide or both."), QStringLiteral("schema"),
+                                          QStringLiteral("both"));
+    const QCommandLineOption storageOption(QStringLiteral("storage"), QStringLiteral("memory, file or both."), QStringLiteral("storage"),
+                                           QStringLiteral("both"));
+    const QCommandLineOption batchOption(QStringLiteral("batch"), QStringLiteral("Fetch batch size."), QStringLiteral("rows"),
+                                         QStringLiteral("1000"));
+    const QCommandLineOption outputOption(QStringLiteral("output"), QStringLiteral("Write the JSON report to a file instead of stdout."),
+                                          QStringLiteral("file"));
+
+    parser.addOptions({rowsOption, schemaOption, storageOption, batchOption, outputOption});
+    parser.process(app);
+
+    if (!QSqlDatabase::isDriverAvailable(QStringLiteral("QSQLITE"))) {
+        qCritical() << "The QSQLITE driver is not available";
+        return 1;
+    }
+
+    const QList<int> rowCounts = parseRowCounts(parser.value(rowsOption));
+    const QString schema = parser.value(schemaOption);
+    const QString storage = parser.value(storageOption);
+    const int batchSize = qMax(1, parser.value(batchOption).toInt());
+
+    QStringList schemas;
+    for (const QString &name : {QStringLiteral("narrow"), QStringLiteral("wide")}) {
+        if (schema == QLatin1String("both") || schema == name)
+            schemas.append(name);
+    }
+
+    QStringList storages;
+    for (const QString &name : {QStringLiteral("memory"), QStringLiteral("file")}) {
+        if (storage == QLatin1String("both") || storage == name)
+            storages.append(name);
+    }
+
+    QTemporaryDir directory;
+
+    if (!directory.isValid()) {
+        qCritical() << "Cannot create a temporary directory for file backed tables";
+        return 1;
+    }
+
+    QJsonArray fixtures;
+
+    for (const QString &storageName : std::as_const(storages)) {
+        for (const QString &schemaName : std::as_const(schemas)) {
+            for (int rows : rowCounts) {
+                QTextStream(stderr) << "benchmarking " << storageName << ' ' << schemaName << ' ' << rows << " rows\n";
+                fixtures.append(runFixture(Fixture{storageName, schemaName, rows}, directory.path(), batchSize));
+            }
+        }
+    }
+
+    const QJsonObject report{
+        {QStringLiteral("timestamp"), QDateTime::currentDateTimeUtc().toString(Qt::ISODate)},
+        {QStringLiteral("qtVersion"), QString::fromLatin1(qVersion())},
+        {QStringLiteral("cpu"), QSysInfo::currentCpuArchitecture()},
+        {QStringLiteral("os"), QSysInfo::prettyProductName()},
+        {QStringLiteral("batchSize"), batchSize},
+        {QStringLiteral("fixtures"), fixtures}
+    };
+
+    const QByteArray json = QJsonDocument(report).toJson();
+
+    if (!parser.isSet(outputOption)) {
+        QTextStream(stdout) << json;
+        return 0;
+    }
+
+    QFile file(parser.value(outputOption));
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+        qCritical() << "Cannot write" << file.fileName();
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,10 +1,75 @@
 #include "cachedrow.h"
 
+#include <QHashFunctions>
 #include <QSqlField>
 
-CachedRow::CachedRow(Op o, const QSqlRecord &r)
+CachedRowKey::CachedRowKey(const CachedRowValues &values)
+    : m_values(values)
+{
+}
+
+bool CachedRowKey::isNull() const
+{
+    return m_values.isEmpty();
+}
+
+const CachedRowValues &CachedRowKey::values() const
+{
+    return m_values;
+}
+
+bool CachedRowKey::operator==(const CachedRowKey &other) const
+{
+    return m_values == other.m_values;
+}
+
+bool CachedRowKey::operator!=(const CachedRowKey &other) const
+{
+    return !(*this == other);
+}
+
+size_t qHash(const CachedRowKey &key, size_t seed)
+{
+    //Hash numbers by value to stay consistent with QVariant's numeric equality
+    for (const QVariant &v : key.values()) {
+        switch (v.typeId()) {
+            case QMetaType::Bool:
+            case QMetaType::Char:
+            case QMetaType::SChar:
+            case QMetaType::UChar:
+            case QMetaType::Short:
+            case QMetaType::UShort:
+            case QMetaType::Int:
+            case QMetaType::UInt:
+            case QMetaType::Long:
+            case QMetaType::ULong:
+            case QMetaType::LongLong:
+            case QMetaType::ULongLong:
+                seed = qHashMulti(seed, v.toLongLong());
+                break;
+            case QMetaType::Float:
+            case QMetaType::Double: {
+                const double d = v.toDouble();
+                const qint64 i = qint64(d);
+                seed = (double(i) == d) ? qHashMulti(seed, i) : qHashMulti(seed, d);
+                break;
+            }
+            case QMetaType::QByteArray:
+                seed = qHashMulti(seed, v.toByteArray());
+                break;
+            default:
+                seed = qHashMulti(seed, v.toString());
+                break;
+        }
+    }
+
+    return seed;
+}
+
+CachedRow::CachedRow(Op o, const CachedRowValues &values)
     : m_op(None)
-    , m_db_values(r)
+    , m_values(values)
+    , m_evicted(false)
 {
     setOp(o);
 }
@@ -15,45 +80,84 @@ void CachedRow::setOp(Op o)
     if (o == None) {
         m_submitted = true;
         m_op = None;
-        m_rec = m_db_values;   //Ensure that rec is populated from db_values to present in cached model
-        setGenerated(m_rec, false);
+        m_delta.reset();   //Clean rows only hold their baseline values
         return;
     }
 
     if (o == m_op)
         return;
 
-    //Handle other operations
+    //Evicted rows have to be restored before they can be staged, their key alone cannot be submitted
+    if (m_evicted)
+        return;
+
+    //Handle other operations, any pending edits are discarded
     m_submitted = (o != Insert && o != Delete);
     m_op = o;
-    m_rec = m_db_values;
-    setGenerated(m_rec, m_op == Delete);
+    m_delta.reset();
 }
 
-const QSqlRecord &CachedRow::rec() const
+QSqlRecord CachedRow::rec(const QSqlRecord &schema) const
 {
-    return m_rec;
+    //Build a full record from the shared schema, auto value fields are never flagged as generated
+    QSqlRecord r(schema);
+
+    for (int i = r.count() - 1; i >= 0; --i) {
+        r.setValue(i, value(i));
+        r.setGenerated(i, isGenerated(i) && !r.field(i).isAutoValue());
+    }
+
+    return r;
 }
 
-QSqlRecord &CachedRow::recRef() {
-    return m_rec;
+int CachedRow::count() const
+{
+    //An evicted row only holds its key values
+    if (m_evicted)
+        return 0;
+
+    return m_values.count();
 }
 
 QVariant CachedRow::value(int column) const
 {
-    return m_rec.value(column);
+    //Pending edits take precedence over the baseline
+    if (isDirty(column))
+        return m_delta->values.value(column);
+
+    if (m_evicted)
+        return QVariant();
+
+    return m_values.value(column);
+}
+
+QVariant CachedRow::committedValue(int column) const
+{
+    //The baseline as last read from the database, ignoring pending edits
+    if (m_evicted)
+        return QVariant();
+
+    return m_values.value(column);
 }
 
 void CachedRow::setValue(int c, const QVariant &v)
 {
-    //Flag row as having changes and assign the new value to the record
+    //Range safeguards, evicted rows must be restored before they can be edited
+    if (m_evicted || c < 0 || c >= m_values.count())
+        return;
+
+    //Flag row as having changes and record the new value in the delta, created on first edit
     m_submitted = false;
-    m_rec.setValue(c, v);
 
-    //Check to ensure we're not operating on an auto increment field, setting the generated flag if not
-    if (!m_rec.field(c).isAutoValue()) {
-        m_rec.setGenerated(c, true);
-    }
+    if (!m_delta)
+        m_delta = new CachedRowDelta;
+
+    m_delta->values.insert(c, v);
+
+    if (m_delta->dirty.size() < m_values.count())
+        m_delta->dirty.resize(m_values.count());
+
+    m_delta->dirty.setBit(c);
 
     if (m_op == None) {
         m_op = Update;   //Mark row dirty
@@ -61,24 +165,43 @@ void CachedRow::setValue(int c, const QVariant &v)
     // Insert stays Insert, Update stays Update, Delete ignored
 }
 
+bool CachedRow::isDirty(int c) const
+{
+    return m_delta && c >= 0 && c < m_delta->dirty.size() && m_delta->dirty.testBit(c);
+}
+
+bool CachedRow::isGenerated(int c) const
+{
+    //Deletes flag every column as generated, other operations only flag edited columns
+    if (m_op == Delete)
+        return c >= 0 && c < m_values.count();
+
+    return isDirty(c);
+}
+
 bool CachedRow::submitted() const {
     return m_submitted;
 }
 
 void CachedRow::setSubmitted()
 {
-    //Mark the row as submitted and reset generated flags
+    //Mark the row as submitted
     m_submitted = true;
-    setGenerated(m_rec, false);
 
     //If the record was flagged as a delete, remove all record values
     if (m_op == Delete) {
-        m_rec.clearValues();
+        m_values = CachedRowValues(m_values.count());
     } else {
-        //Otherwise, return state to None and assign the db_values to the submitted rec values
+        //Otherwise, return state to None and fold the pending edits into the baseline values
         m_op = None;
-        m_db_values = m_rec;
+
+        if (const CachedRowDelta *delta = m_delta.constData()) {
+            for (auto it = delta->values.cbegin(); it != delta->values.cend(); ++it)
+                m_values[it.key()] = it.value();
+        }
     }
+
+    m_delta.reset();
 }
 
 void CachedRow::revert()
@@ -89,28 +212,70 @@ void CachedRow::revert()
     if (m_op == Delete)
         m_op = None;
 
-    m_rec = m_db_values;
-    setGenerated(m_rec, false);
+    m_delta.reset();
     m_submitted = true;
 }
 
-QSqlRecord CachedRow::primaryValues(const QSqlRecord &pi) const
+QSqlRecord CachedRow::primaryValues(const QSqlRecord &schema, const QSqlRecord &pi) const
 {
-    if (m_op == Insert)
+    //Evicted rows only hold their key columns, in key order rather than schema order. Refuse rather than bind the wrong values
+    if (m_op == Insert || m_evicted)
         return QSqlRecord();
 
-    return m_db_values.keyValues(pi);
+    //Resolve each key field against the shared schema to find its column in the baseline values
+    QSqlRecord values(pi);
+
+    for (int i = values.count() - 1; i >= 0; --i)
+        values.setValue(i, m_values.value(schema.indexOf(values.fieldName(i))));
+
+    return values;
 }
 
-void CachedRow::setGenerated(QSqlRecord &r, bool g)
+CachedRowKey CachedRow::key(const QVector<int> &columns) const
 {
-    for (int i = r.count() - 1; i >= 0; --i) {
-        if (!r.field(i).isAutoValue()) {
-            r.setGenerated(i, g);
-        } else {
-            r.setGenerated(i, false); // force auto value fields to remain false
-        }
-    }
+    //Rows that do not exist in the database yet have no key
+    if (m_op == Insert || columns.isEmpty())
+        return CachedRowKey();
+
+    //Evicted rows keep exactly the key values they were evicted with
+    if (m_evicted)
+        return CachedRowKey(m_values);
+
+    CachedRowValues values;
+    values.reserve(columns.count());
+
+    for (int c : columns)
+        values.append(m_values.value(c));
+
+    return CachedRowKey(values);
+}
+
+bool CachedRow::isEvicted() const
+{
+    return m_evicted;
+}
+
+void CachedRow::evict(const QVector<int> &keyColumns)
+{
+    //Only clean rows can be dropped, they can be read back from the database by key
+    if (m_evicted || m_op != None || !m_submitted || keyColumns.isEmpty())
+        return;
+
+    CachedRowValues values;
+    values.reserve(keyColumns.count());
+
+    for (int c : keyColumns)
+        values.append(m_values.value(c));
+
+    m_values = values;
+    m_delta.reset();
+    m_evicted = true;
+}
+
+void CachedRow::restore(const CachedRowValues &values)
+{
+    m_values = values;
+    m_evicted = false;
 }
 
 CachedRow::Op CachedRow::op() const {
@@ -1,9 +1,43 @@
 #ifndef CACHEDROW_H
 #define CACHEDROW_H
 
+#include <QBitArray>
 #include <QDebug>
+#include <QHash>
+#include <QSharedData>
 #include <QSqlRecord>
 #include <QVariant>
+#include <QVector>
+
+//Plain per-row value storage, field metadata lives once in the model's schema record
+typedef QVector<QVariant> CachedRowValues;
+
+//Primary key values of a row, hashed by value so that keys read back with different integer widths still match
+class CachedRowKey
+{
+public:
+    CachedRowKey() = default;
+    explicit CachedRowKey(const CachedRowValues &values);
+
+    bool isNull() const;
+    const CachedRowValues &values() const;
+
+    bool operator==(const CachedRowKey &other) const;
+    bool operator!=(const CachedRowKey &other) const;
+
+private:
+    CachedRowValues m_values;
+};
+
+size_t qHash(const CachedRowKey &key, size_t seed = 0);
+
+//Pending edits of a single row, only allocated once a value has been set
+class CachedRowDelta : public QSharedData
+{
+public:
+    QHash<int, QVariant> values;
+    QBitArray dirty;
+};
 
 class CachedRow
 {
@@ -16,30 +50,37 @@ public:
         Delete
     };
 
-    CachedRow(Op o = None, const QSqlRecord &r = QSqlRecord());
+    CachedRow(Op o = None, const CachedRowValues &values = CachedRowValues());
 
     Op op() const;
     void setOp(Op o);
 
-    const QSqlRecord &rec() const;
-    QSqlRecord& recRef();
+    QSqlRecord rec(const QSqlRecord &schema) const;
 
+    int count() const;
     QVariant value(int column) const;
+    QVariant committedValue(int column) const;
     void setValue(int c, const QVariant &v);
+    bool isDirty(int c) const;
+    bool isGenerated(int c) const;
 
     bool submitted() const;
     void setSubmitted();
 
     void revert();
-    QSqlRecord primaryValues(const QSqlRecord& pi) const;
+    QSqlRecord primaryValues(const QSqlRecord &schema, const QSqlRecord& pi) const;
+    CachedRowKey key(const QVector<int> &columns) const;
 
-private:
-    static void setGenerated(QSqlRecord& r, bool g);
+    bool isEvicted() const;
+    void evict(const QVector<int> &keyColumns);
+    void restore(const CachedRowValues &values);
 
+private:
     Op m_op;
-    QSqlRecord m_rec;
-    QSqlRecord m_db_values;
+    CachedRowValues m_values;   //Baseline database values
+    QSharedDataPointer<CachedRowDelta> m_delta;
     bool m_submitted;
+    bool m_evicted;     //Only the key values are held until the row is restored
 };
 
 #endif // CACHEDROW_H
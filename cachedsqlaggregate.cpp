@@ -0,0 +1,425 @@
+#include "cachedsqlaggregate.h"
+
+#include <QtNumeric>
+
+#include <algorithm>
+
+//Decimal places kept exactly, values with more are summed as doubles
+static const int MaxScale = 9;
+
+static const qint64 PowersOfTen[MaxScale + 1] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+//Integers, and text such as a NUMERIC column reads as, become a value scaled by 10^scale. Anything else is not exact
+static bool exactValue(const QVariant &value, qint64 &exact, int &scale)
+{
+    switch (value.typeId()) {
+        case QMetaType::Bool:
+        case QMetaType::Char:
+        case QMetaType::SChar:
+        case QMetaType::UChar:
+        case QMetaType::Short:
+        case QMetaType::UShort:
+        case QMetaType::Int:
+        case QMetaType::UInt:
+        case QMetaType::Long:
+        case QMetaType::LongLong:
+            exact = value.toLongLong();
+            scale = 0;
+            return true;
+        case QMetaType::ULong:
+        case QMetaType::ULongLong:
+            exact = qint64(value.toULongLong());
+            scale = 0;
+            return exact >= 0;
+        case QMetaType::QString:
+        case QMetaType::QByteArray:
+            break;
+        default:
+            return false;
+    }
+
+    const QByteArray text = value.toByteArray().trimmed();
+    const bool negative = text.startsWith('-');
+    qsizetype i = negative || text.startsWith('+') ? 1 : 0;
+
+    exact = 0;
+    scale = -1;
+    int digits = 0;
+
+    for (; i < text.size(); ++i) {
+        const char c = text.at(i);
+
+        if (c == '.' && scale == -1) {
+            scale = 0;
+            continue;
+        }
+
+        //18 digits always fit
+        if (c < '0' || c > '9' || ++digits > 18)
+            return false;
+
+        exact = exact * 10 + (c - '0');
+
+        if (scale != -1)
+            ++scale;
+    }
+
+    if (digits == 0)
+        return false;
+
+    scale = qMax(0, scale);
+
+    //Trailing zeros add nothing but scale
+    while (scale > 0 && exact % 10 == 0) {
+        exact /= 10;
+        --scale;
+    }
+
+    if (negative)
+        exact = -exact;
+
+    return scale <= MaxScale;
+}
+
+CachedSqlAggregate::CachedSqlAggregate(int column, Function function, int groupColumn)
+    : m_column(column)
+    , m_function(function)
+    , m_groupColumn(groupColumn)
+{
+}
+
+int CachedSqlAggregate::column() const
+{
+    return m_column;
+}
+
+CachedSqlAggregate::Function CachedSqlAggregate::function() const
+{
+    return m_function;
+}
+
+int CachedSqlAggregate::groupColumn() const
+{
+    return m_groupColumn;
+}
+
+int CachedSqlAggregate::count() const
+{
+    return int(m_values.size());
+}
+
+void CachedSqlAggregate::clear()
+{
+    m_values.clear();
+    m_present.clear();
+    m_exact.clear();
+    m_scales.clear();
+    m_groups.clear();
+    m_scale = 0;
+    m_inexact = false;
+    m_total = Bucket();
+    m_buckets.clear();
+}
+
+bool CachedSqlAggregate::append(const QVariant &value, const QVariant &group, bool included)
+{
+    m_values.push_back(0);
+    m_present.push_back(Absent);
+    m_exact.push_back(0);
+    m_scales.push_back(0);
+
+    if (m_groupColumn != -1)
+        m_groups.append(CachedRowKey(CachedRowValues{group}));
+
+    return set(count() - 1, value, group, included);
+}
+
+bool CachedSqlAggregate::set(int row, const QVariant &value, const QVariant &group, bool included)
+{
+    if (row < 0 || row >= count())
+        return false;
+
+    //NULLs are left out as in SQL, so is anything that is not a number except for a plain count
+    bool ok = included && !value.isNull();
+    double number = 0;
+    qint64 exact = 0;
+    int scale = 0;
+
+    if (ok && m_function != Count)
+        number = value.toDouble(&ok);
+
+    //Sums drift when doubles are added and taken out again, integers and decimals are kept exactly
+    const Kind kind = !ok ? Absent : (m_function == Sum || m_function == Average) && exactValue(value, exact, scale) ? Exact : Real;
+
+    const CachedRowKey key = m_groupColumn != -1 ? CachedRowKey(CachedRowValues{group}) : CachedRowKey();
+
+    if (m_present[row] == kind && (kind == Absent || (m_values[row] == number && m_exact[row] == exact && m_scales[row] == scale))
+        && (m_groupColumn == -1 || m_groups.at(row) == key))
+        return false;
+
+    //Widen the sums first, the old contribution is then taken out at the new scale
+    if (kind == Exact && scale > m_scale && !m_inexact)
+        rescale(scale);
+
+    take(row);
+
+    m_values[row] = number;
+    m_present[row] = kind;
+    m_exact[row] = exact;
+    m_scales[row] = qint8(scale);
+
+    if (m_groupColumn != -1)
+        m_groups[row] = key;
+
+    add(row);
+    return true;
+}
+
+void CachedSqlAggregate::insert(int row, int count)
+{
+    if (row < 0 || row > this->count() || count <= 0)
+        return;
+
+    //New rows contribute nothing until they are set
+    m_values.insert(m_values.begin() + row, count, 0);
+    m_present.insert(m_present.begin() + row, count, Absent);
+    m_exact.insert(m_exact.begin() + row, count, 0);
+    m_scales.insert(m_scales.begin() + row, count, 0);
+
+    if (m_groupColumn != -1)
+        m_groups.insert(row, count, CachedRowKey());
+}
+
+bool CachedSqlAggregate::remove(int row, int count)
+{
+    row = qMax(0, row);
+    count = qMin(count, this->count() - row);
+
+    if (count <= 0)
+        return false;
+
+    bool changed = false;
+
+    for (int i = row; i < row + count; ++i) {
+        changed = changed || m_present[i] != Absent;
+        take(i);
+    }
+
+    m_values.erase(m_values.begin() + row, m_values.begin() + row + count);
+    m_present.erase(m_present.begin() + row, m_present.begin() + row + count);
+    m_exact.erase(m_exact.begin() + row, m_exact.begin() + row + count);
+    m_scales.erase(m_scales.begin() + row, m_scales.begin() + row + count);
+
+    if (m_groupColumn != -1)
+        m_groups.remove(row, count);
+
+    return changed;
+}
+
+void CachedSqlAggregate::permute(const QVector<int> &newRows)
+{
+    if (newRows.count() != count())
+        return;
+
+    //The totals do not depend on the order, only the contributions move
+    std::vector<double> values(m_values.size());
+    std::vector<char> present(m_present.size());
+    std::vector<qint64> exact(m_exact.size());
+    std::vector<qint8> scales(m_scales.size());
+    QVector<CachedRowKey> groups(m_groups.count());
+
+    for (int row = 0; row < newRows.count(); ++row) {
+        const int to = newRows.at(row);
+        values[to] = m_values[row];
+        present[to] = m_present[row];
+        exact[to] = m_exact[row];
+        scales[to] = m_scales[row];
+
+        if (m_groupColumn != -1)
+            groups[to] = m_groups.at(row);
+    }
+
+    m_values.swap(values);
+    m_present.swap(present);
+    m_exact.swap(exact);
+    m_scales.swap(scales);
+    m_groups.swap(groups);
+}
+
+QVariant CachedSqlAggregate::result() const
+{
+    return result(m_total);
+}
+
+QVariant CachedSqlAggregate::result(const QVariant &group) const
+{
+    const auto it = m_buckets.constFind(CachedRowKey(CachedRowValues{group}));
+    return it == m_buckets.cend() ? result(Bucket()) : result(it.value());
+}
+
+QVariantList CachedSqlAggregate::groups() const
+{
+    QVariantList groups;
+    groups.reserve(m_buckets.count());
+
+    for (auto it = m_buckets.cbegin(); it != m_buckets.cend(); ++it)
+        groups.append(it.key().values().value(0));
+
+    return groups;
+}
+
+bool CachedSqlAggregate::tracksValues() const
+{
+    return m_function == Minimum || m_function == Maximum;
+}
+
+bool CachedSqlAggregate::sumsExactly(int row) const
+{
+    return m_present[row] == Exact && !m_inexact;
+}
+
+bool CachedSqlAggregate::scaled(int row, qint64 &value) const
+{
+    return !qMulOverflow(m_exact[row], PowersOfTen[m_scale - m_scales[row]], &value);
+}
+
+void CachedSqlAggregate::rescale(int scale)
+{
+    //Bring the sums to the new number of decimal places, once they no longer fit fall back to doubles for good
+    const qint64 factor = PowersOfTen[scale - m_scale];
+    bool overflow = qMulOverflow(m_total.exactSum, factor, &m_total.exactSum);
+
+    for (auto it = m_buckets.begin(); !overflow && it != m_buckets.end(); ++it)
+        overflow = qMulOverflow(it->exactSum, factor, &it->exactSum);
+
+    m_scale = scale;
+
+    if (overflow) {
+        m_inexact = true;
+        rebuild();
+    }
+}
+
+void CachedSqlAggregate::rebuild()
+{
+    m_total = Bucket();
+    m_buckets.clear();
+
+    for (int row = 0; row < count(); ++row)
+        add(row);
+}
+
+void CachedSqlAggregate::add(int row)
+{
+    if (m_present[row] == Absent)
+        return;
+
+    const double value = m_values[row];
+    const bool exact = sumsExactly(row);
+    qint64 contribution = 0;
+
+    if (exact && !scaled(row, contribution)) {
+        m_inexact = true;
+        rebuild();
+        return;
+    }
+
+    bool overflow = false;
+
+    auto addTo = [this, value, exact, contribution, &overflow](Bucket &bucket) {
+        ++bucket.count;
+
+        if (exact) {
+            overflow = qAddOverflow(bucket.exactSum, contribution, &bucket.exactSum) || overflow;
+        } else {
+            ++bucket.reals;
+            bucket.realSum += value;
+        }
+
+        if (tracksValues())
+            ++bucket.values[value];
+    };
+
+    addTo(m_total);
+
+    if (m_groupColumn != -1)
+        addTo(m_buckets[m_groups.at(row)]);
+
+    if (overflow) {
+        m_inexact = true;
+        rebuild();
+    }
+}
+
+void CachedSqlAggregate::take(int row)
+{
+    if (m_present[row] == Absent)
+        return;
+
+    const double value = m_values[row];
+    const bool exact = sumsExactly(row);
+    qint64 contribution = 0;
+
+    //Whatever was added fitted, taking it out again cannot overflow
+    if (exact)
+        scaled(row, contribution);
+
+    auto takeFrom = [this, value, exact, contribution](Bucket &bucket) {
+        --bucket.count;
+
+        if (exact) {
+            bucket.exactSum -= contribution;
+        } else {
+            --bucket.reals;
+            bucket.realSum -= value;
+        }
+
+        if (tracksValues()) {
+            const auto it = bucket.values.find(value);
+
+            if (it != bucket.values.end() && --it->second == 0)
+                bucket.values.erase(it);
+        }
+
+        //Once no double is left, start from an exact zero again rather than carry rounding errors forward
+        if (bucket.reals == 0)
+            bucket.realSum = 0;
+    };
+
+    takeFrom(m_total);
+
+    if (m_groupColumn != -1) {
+        const auto it = m_buckets.find(m_groups.at(row));
+
+        if (it != m_buckets.end()) {
+            takeFrom(it.value());
+
+            if (it->count == 0)
+                m_buckets.erase(it);
+        }
+    }
+}
+
+QVariant CachedSqlAggregate::result(const Bucket &bucket) const
+{
+    //Rounded once here rather than on every change
+    const double sum = double(bucket.exactSum) / double(PowersOfTen[m_scale]) + bucket.realSum;
+
+    switch (m_function) {
+        case Count:
+            return bucket.count;
+        case Sum:
+            if (bucket.count == 0)
+                return QVariant();
+
+            return bucket.reals == 0 && m_scale == 0 ? QVariant(bucket.exactSum) : QVariant(sum);
+        case Average:
+            return bucket.count > 0 ? QVariant(sum / bucket.count) : QVariant();
+        case Minimum:
+            return bucket.values.empty() ? QVariant() : QVariant(bucket.values.begin()->first);
+        case Maximum:
+            return bucket.values.empty() ? QVariant() : QVariant(bucket.values.rbegin()->first);
+    }
+
+    return QVariant();
+}
@@ -0,0 +1,88 @@
+#ifndef CACHEDSQLAGGREGATE_H
+#define CACHEDSQLAGGREGATE_H
+
+#include "cachedrow.h"
+
+#include <QHash>
+#include <QVariant>
+#include <QVector>
+
+#include <map>
+#include <vector>
+
+//Running aggregate over one column of the cache, optionally bucketed by the value of a second column.
+//Each row's contribution is kept so that a change only has to take out the old one and add the new one
+class CachedSqlAggregate
+{
+public:
+    enum Function {
+        Count,     //Non-NULL values
+        Sum,       //Exact for integers and decimal text, NULL over no values as in SQL
+        Average,
+        Minimum,
+        Maximum
+    };
+
+    CachedSqlAggregate(int column = -1, Function function = Count, int groupColumn = -1);
+
+    int column() const;
+    Function function() const;
+    int groupColumn() const;
+
+    int count() const;
+    void clear();
+
+    //Row positions follow the cache, the owner reports every change. Each returns whether the result may have changed
+    bool append(const QVariant &value, const QVariant &group, bool included);
+    bool set(int row, const QVariant &value, const QVariant &group, bool included);
+    void insert(int row, int count);
+    bool remove(int row, int count);
+    void permute(const QVector<int> &newRows);   //old row -> new row
+
+    QVariant result() const;
+    QVariant result(const QVariant &group) const;
+    QVariantList groups() const;
+
+private:
+    //How a row takes part, exact values are summed as integers scaled by 10^m_scale
+    enum Kind : char {
+        Absent,
+        Real,
+        Exact
+    };
+
+    struct Bucket
+    {
+        qint64 count = 0;
+        qint64 reals = 0;               //Values only known as doubles
+        qint64 exactSum = 0;
+        double realSum = 0;
+        std::map<double, int> values;   //Multiset of the values, only kept for Minimum and Maximum
+    };
+
+    bool tracksValues() const;
+    bool sumsExactly(int row) const;
+    bool scaled(int row, qint64 &value) const;
+    void rescale(int scale);
+    void rebuild();
+    void add(int row);
+    void take(int row);
+    QVariant result(const Bucket &bucket) const;
+
+    int m_column;
+    Function m_function;
+    int m_groupColumn;
+
+    std::vector<double> m_values;
+    std::vector<char> m_present;    //Kind per row, Absent unless the row is included and its value is a number
+    std::vector<qint64> m_exact;    //Unscaled exact value per row
+    std::vector<qint8> m_scales;    //Decimal places of the exact value
+    QVector<CachedRowKey> m_groups;
+    int m_scale = 0;                //Decimal places of the exact sums, the most any row has
+    bool m_inexact = false;         //The exact sums overflowed, every value is summed as a double from then on
+
+    Bucket m_total;
+    QHash<CachedRowKey, Bucket> m_buckets;
+};
+
+#endif // CACHEDSQLAGGREGATE_H
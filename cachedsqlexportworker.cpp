@@ -0,0 +1,376 @@
+#include "cachedsqlexportworker.h"
+
+#include <QLocale>
+#include <QSaveFile>
+#include <QSqlDatabase>
+#include <QSqlField>
+#include <QSqlQuery>
+#include <QtEndian>
+
+#include <numeric>
+
+static const char ColumnarMagic[4] = {'C', 'S', 'Q', 'C'};
+
+//Rows drained from the worker's own cursor per encoded chunk, the same size as the chunks the model hands over
+static const int DrainChunkRows = 4096;
+
+static bool isIntegerType(int id)
+{
+    switch (id) {
+        case QMetaType::Bool:
+        case QMetaType::Char:
+        case QMetaType::SChar:
+        case QMetaType::UChar:
+        case QMetaType::Short:
+        case QMetaType::UShort:
+        case QMetaType::Int:
+        case QMetaType::UInt:
+        case QMetaType::Long:
+        case QMetaType::ULong:
+        case QMetaType::LongLong:
+        case QMetaType::ULongLong:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isRealType(int id)
+{
+    return id == QMetaType::Double || id == QMetaType::Float;
+}
+
+static void appendVarint(QByteArray &out, quint64 value)
+{
+    while (value >= 0x80) {
+        out += char(value | 0x80);
+        value >>= 7;
+    }
+
+    out += char(value);
+}
+
+template <typename T>
+static void appendLittleEndian(QByteArray &out, T value)
+{
+    char bytes[sizeof(T)];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, sizeof(T));
+}
+
+static QByteArray utf8(const QVariant &value)
+{
+    return value.typeId() == QMetaType::QByteArray ? value.toByteArray() : value.toString().toUtf8();
+}
+
+CachedSqlExportWorker::CachedSqlExportWorker(const QString &fileName, Format format, const QSqlRecord &record, QObject *parent)
+    : QObject(parent)
+    , m_fileName(fileName)
+    , m_format(format)
+    , m_record(record)
+    , m_rows(0)
+    , m_canceled(0)
+{
+    for (int i = 0; i < m_record.count(); ++i) {
+        const int id = m_record.field(i).metaType().id();
+        m_kinds.append(isIntegerType(id) ? Integer : isRealType(id) ? Real : id == QMetaType::QByteArray ? Blob : Text);
+    }
+}
+
+CachedSqlExportWorker::~CachedSqlExportWorker() = default;
+
+void CachedSqlExportWorker::cancel()
+{
+    m_canceled.storeRelaxed(1);
+}
+
+void CachedSqlExportWorker::open()
+{
+    m_file.reset(new QSaveFile(m_fileName));
+
+    if (!m_file->open(QIODevice::WriteOnly)) {
+        fail(m_file->errorString());
+        return;
+    }
+
+    QByteArray header;
+
+    if (m_format == Csv) {
+        for (int i = 0; i < m_record.count(); ++i) {
+            if (i > 0)
+                header += ',';
+
+            header += '"' + m_record.fieldName(i).toUtf8().replace('"', "\"\"") + '"';
+        }
+
+        header += "\r\n";
+    } else {
+        header.append(ColumnarMagic, sizeof(ColumnarMagic));
+        appendLittleEndian<quint16>(header, FormatVersion);
+        appendLittleEndian<quint16>(header, quint16(m_record.count()));
+
+        for (int i = 0; i < m_record.count(); ++i) {
+            const QByteArray name = m_record.fieldName(i).toUtf8();
+            appendVarint(header, quint64(name.size()));
+            header += name;
+            appendLittleEndian<quint32>(header, quint32(m_record.field(i).metaType().id()));
+        }
+    }
+
+    flush(header);
+}
+
+void CachedSqlExportWorker::write(const QVector<CachedRowValues> &rows)
+{
+    //After a failure the remaining chunks are only acknowledged so the model stops waiting on them
+    if (m_file)
+        writeRows(rows);
+
+    emit written(rows.count());
+}
+
+void CachedSqlExportWorker::drain(const CachedSqlExportSource &source)
+{
+    if (!m_file)
+        return;
+
+    const QString connectionName = QStringLiteral("CachedSqlExportWorker_%1").arg(quintptr(this));
+    QString error;
+
+    {
+        //Connections are bound to the thread that created them, clone the model's connection on this thread
+        QSqlDatabase db = QSqlDatabase::cloneDatabase(source.connectionName, connectionName);
+
+        if (db.open()) {
+            QSqlQuery query(db);
+            query.setForwardOnly(true);
+
+            bool ok = query.prepare(source.statement);
+
+            for (int i = 0; ok && i < source.binds.count(); ++i)
+                query.bindValue(i, source.binds.at(i));
+
+            ok = ok && query.exec();
+
+            if (!ok)
+                error = query.lastError().text();
+
+            const int columns = m_record.count();
+            QVector<CachedRow> chunk;
+            chunk.reserve(DrainChunkRows);
+
+            //Only one chunk is held at a time, however long the result is
+            while (ok && m_file && !m_canceled.loadRelaxed() && query.next()) {
+                CachedRowValues values(columns);
+
+                for (int c = 0; c < columns; ++c)
+                    values[c] = query.value(c);
+
+                CachedRow cr(CachedRow::None, values);
+
+                //Rows already exported from the cache went out from there
+                if (source.skipKeys.contains(cr.key(source.keyColumns)))
+                    continue;
+
+                chunk.append(cr);
+
+                if (chunk.count() == DrainChunkRows) {
+                    writeDrained(chunk, source.filter);
+                    chunk.clear();
+                }
+            }
+
+            if (ok && m_file && !m_canceled.loadRelaxed() && !chunk.isEmpty())
+                writeDrained(chunk, source.filter);
+
+            //A cursor that failed part way through just stops returning rows
+            if (ok && query.lastError().isValid())
+                error = query.lastError().text();
+        } else {
+            error = db.lastError().text();
+        }
+    }
+
+    QSqlDatabase::removeDatabase(connectionName);
+
+    if (!error.isEmpty())
+        fail(error);
+}
+
+void CachedSqlExportWorker::writeDrained(const QVector<CachedRow> &chunk, const CachedSqlFilter &filter)
+{
+    //Apply the client side row filter the view shows the cache through
+    QVector<int> candidates(chunk.count());
+    std::iota(candidates.begin(), candidates.end(), 0);
+    const std::vector<char> keep = filter.isEmpty() ? std::vector<char>(chunk.count(), 1) : filter.evaluate(chunk, candidates, m_record);
+
+    QVector<CachedRowValues> rows;
+    rows.reserve(chunk.count());
+
+    for (int i = 0; i < chunk.count(); ++i) {
+        if (!keep[i])
+            continue;
+
+        CachedRowValues values(m_record.count());
+
+        for (int c = 0; c < values.count(); ++c)
+            values[c] = chunk.at(i).value(c);
+
+        rows.append(values);
+    }
+
+    if (!rows.isEmpty() && writeRows(rows))
+        emit drained(rows.count());
+}
+
+void CachedSqlExportWorker::finish()
+{
+    if (!m_file)
+        return;
+
+    if (m_format == Columnar) {
+        QByteArray end;
+        appendVarint(end, 0);
+        appendLittleEndian<quint64>(end, quint64(m_rows));
+
+        if (!flush(end))
+            return;
+    }
+
+    if (!m_file->commit()) {
+        fail(m_file->errorString());
+        return;
+    }
+
+    m_file.reset();
+    emit finished(m_rows);
+}
+
+void CachedSqlExportWorker::encodeCsv(const QVector<CachedRowValues> &rows, QByteArray &out) const
+{
+    for (const CachedRowValues &values : rows) {
+        for (int c = 0; c < values.count(); ++c) {
+            if (c > 0)
+                out += ',';
+
+            const QVariant &value = values.at(c);
+
+            //NULL is an empty field, the same as the import reads it
+            if (value.isNull())
+                continue;
+
+            //Numbers go straight to bytes without a QString in between
+            if (isIntegerType(value.typeId()) && value.typeId() != QMetaType::ULongLong) {
+                out += QByteArray::number(value.toLongLong());
+                continue;
+            }
+
+            if (isRealType(value.typeId())) {
+                out += QByteArray::number(value.toDouble(), 'g', QLocale::FloatingPointShortest);
+                continue;
+            }
+
+            //Quote anything that would not read back as the same single field, an empty string is quoted to tell it from NULL
+            const QByteArray text = utf8(value);
+
+            if (text.isEmpty() || text.contains(',') || text.contains('"') || text.contains('\n') || text.contains('\r'))
+                out += '"' + QByteArray(text).replace('"', "\"\"") + '"';
+            else
+                out += text;
+        }
+
+        out += "\r\n";
+    }
+}
+
+void CachedSqlExportWorker::encodeColumnar(const QVector<CachedRowValues> &rows, QByteArray &out) const
+{
+    const int count = rows.count();
+    const int bitmapSize = (count + 7) / 8;
+
+    appendVarint(out, quint64(count));
+
+    for (int c = 0; c < m_record.count(); ++c) {
+        //Keep the declared kind unless a value in this group does not fit it
+        Kind kind = m_kinds.at(c);
+        QByteArray nulls(bitmapSize, 0);
+
+        for (int row = 0; row < count; ++row) {
+            const QVariant &value = rows.at(row).value(c);
+
+            if (value.isNull()) {
+                nulls[row / 8] = char(nulls.at(row / 8) | (1 << (row % 8)));
+                continue;
+            }
+
+            const int id = value.typeId();
+
+            if ((kind == Integer && (!isIntegerType(id) || id == QMetaType::ULongLong)) || (kind == Real && !isRealType(id) && !isIntegerType(id))
+                || (kind == Blob && id != QMetaType::QByteArray))
+                kind = Text;
+        }
+
+        out += char(kind);
+        out += nulls;
+
+        for (int row = 0; row < count; ++row) {
+            const QVariant &value = rows.at(row).value(c);
+
+            if (value.isNull())
+                continue;
+
+            switch (kind) {
+                case Integer: {
+                    const qint64 v = value.toLongLong();
+                    appendVarint(out, (quint64(v) << 1) ^ quint64(v >> 63));
+                    break;
+                }
+                case Real:
+                    appendLittleEndian<double>(out, value.toDouble());
+                    break;
+                case Text:
+                case Blob: {
+                    const QByteArray bytes = utf8(value);
+                    appendVarint(out, quint64(bytes.size()));
+                    out += bytes;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+bool CachedSqlExportWorker::writeRows(const QVector<CachedRowValues> &rows)
+{
+    QByteArray data;
+
+    if (m_format == Csv)
+        encodeCsv(rows, data);
+    else
+        encodeColumnar(rows, data);
+
+    if (!flush(data))
+        return false;
+
+    m_rows += rows.count();
+    return true;
+}
+
+bool CachedSqlExportWorker::flush(const QByteArray &data)
+{
+    if (m_file->write(data) == data.size())
+        return true;
+
+    fail(m_file->errorString());
+    return false;
+}
+
+void CachedSqlExportWorker::fail(const QString &text)
+{
+    //Dropping the save file discards what was written so far
+    if (m_file)
+        m_file->cancelWriting();
+
+    m_file.reset();
+    emit errorOccurred(QSqlError(text, QString(), QSqlError::UnknownError));
+}
@@ -0,0 +1,92 @@
+#ifndef CACHEDSQLEXPORTWORKER_H
+#define CACHEDSQLEXPORTWORKER_H
+
+#include "cachedrow.h"
+#include "cachedsqlfilter.h"
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QSet>
+#include <QSqlError>
+#include <QSqlRecord>
+#include <QVector>
+
+#include <memory>
+
+class QSaveFile;
+
+//Rest of a result that the export reads on its own connection instead of fetching it into the cache
+struct CachedSqlExportSource
+{
+    QString connectionName;
+    QString statement;
+    QVariantList binds;
+    QSet<CachedRowKey> skipKeys;   //Rows exported from the cache, stepped over when the cursor reaches them
+    QVector<int> keyColumns;
+    CachedSqlFilter filter;        //Client side row filter, empty when the filter is part of the statement
+};
+
+//Encodes exported rows chunk by chunk and writes them to a file as CSV or as a compact columnar layout. Lives on a worker thread
+//
+//The columnar layout is little endian throughout:
+//  header     "CSQC", quint16 version, quint16 column count, then per column its name (varint length + UTF-8) and quint32 meta type id
+//  row group  varint row count, then per column a quint8 kind, a null bitmap of (rows + 7) / 8 bytes and the non-NULL values
+//  end        a row group of 0 rows followed by the total row count as quint64
+//Integer values are zigzag varints, Real values 8 byte IEEE doubles, Text and Blob values a varint length and the bytes
+class CachedSqlExportWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Format {
+        Csv,
+        Columnar
+    };
+
+    //Stored per column and row group, a column whose values do not fit its declared type falls back to Text for that group
+    enum Kind : quint8 {
+        Integer,
+        Real,
+        Text,
+        Blob
+    };
+
+    //Bumped whenever the columnar layout changes
+    static const quint16 FormatVersion = 1;
+
+    CachedSqlExportWorker(const QString &fileName, Format format, const QSqlRecord &record, QObject *parent = nullptr);
+    ~CachedSqlExportWorker() override;
+
+    //Thread-safe, stops draining at the next row
+    void cancel();
+
+public slots:
+    void open();
+    void write(const QVector<CachedRowValues> &rows);
+    void drain(const CachedSqlExportSource &source);
+    void finish();
+
+signals:
+    void written(int rows);
+    void drained(int rows);
+    void finished(qint64 rows);
+    void errorOccurred(const QSqlError &error);
+
+private:
+    void encodeCsv(const QVector<CachedRowValues> &rows, QByteArray &out) const;
+    void encodeColumnar(const QVector<CachedRowValues> &rows, QByteArray &out) const;
+    void writeDrained(const QVector<CachedRow> &chunk, const CachedSqlFilter &filter);
+    bool writeRows(const QVector<CachedRowValues> &rows);
+    bool flush(const QByteArray &data);
+    void fail(const QString &text);
+
+    QString m_fileName;
+    Format m_format;
+    QSqlRecord m_record;
+    QVector<Kind> m_kinds;   //Declared kind per column
+    std::unique_ptr<QSaveFile> m_file;   //Discarded unless the export finishes, a failed export leaves no partial file behind
+    qint64 m_rows;
+    QAtomicInt m_canceled;
+};
+
+#endif // CACHEDSQLEXPORTWORKER_H
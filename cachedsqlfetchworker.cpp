@@ -0,0 +1,100 @@
+#include "cachedsqlfetchworker.h"
+
+#include <QSqlDatabase>
+
+CachedSqlFetchWorker::CachedSqlFetchWorker(const QString &connectionName, QObject *parent)
+    : QObject(parent)
+    , m_connectionName(connectionName)
+    , m_workerConnectionName(QStringLiteral("CachedSqlFetchWorker_%1").arg(quintptr(this)))
+    , m_columns(0)
+    , m_canceled(0)
+{
+}
+
+CachedSqlFetchWorker::~CachedSqlFetchWorker()
+{
+    close();
+}
+
+void CachedSqlFetchWorker::cancel()
+{
+    m_canceled.storeRelaxed(1);
+}
+
+void CachedSqlFetchWorker::open(const QString &stmt)
+{
+    close();
+
+    //Connections are bound to the thread that created them, clone the model's connection on this thread
+    QSqlDatabase db = QSqlDatabase::cloneDatabase(m_connectionName, m_workerConnectionName);
+
+    if (!db.open()) {
+        emit errorOccurred(db.lastError());
+        return;
+    }
+
+    m_query.reset(new QSqlQuery(db));
+    m_query->setForwardOnly(true);
+
+    if (!m_query->exec(stmt)) {
+        emit errorOccurred(m_query->lastError());
+        m_query.reset();
+        return;
+    }
+
+    const QSqlRecord record = m_query->record();
+    m_columns = record.count();
+
+    emit opened(record);
+}
+
+void CachedSqlFetchWorker::fetch(int count)
+{
+    //Range safeguards
+    if (!m_query || count <= 0)
+        return;
+
+    QVector<CachedRowValues> rows;
+    rows.reserve(count);
+    bool exhausted = false;
+
+    //Decode up to count rows, checking for cancellation between rows
+    while (rows.count() < count) {
+        if (m_canceled.loadRelaxed())
+            return;
+
+        if (!m_query->next()) {
+            exhausted = true;
+            break;
+        }
+
+        CachedRowValues values(m_columns);
+
+        for (int i = 0; i < m_columns; ++i)
+            values[i] = m_query->value(i);
+
+        rows.push_back(values);
+    }
+
+    emit fetched(rows, exhausted);
+
+    //Release the server cursor as soon as the result set is drained
+    if (exhausted)
+        close();
+}
+
+void CachedSqlFetchWorker::close()
+{
+    if (!QSqlDatabase::contains(m_workerConnectionName))
+        return;
+
+    //The query must be released before the connection can be removed
+    m_query.reset();
+
+    {
+        QSqlDatabase db = QSqlDatabase::database(m_workerConnectionName, false);
+        db.close();
+    }
+
+    QSqlDatabase::removeDatabase(m_workerConnectionName);
+}
@@ -0,0 +1,44 @@
+#ifndef CACHEDSQLFETCHWORKER_H
+#define CACHEDSQLFETCHWORKER_H
+
+#include "cachedrow.h"
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QSqlRecord>
+
+#include <memory>
+
+//Runs a select statement on its own database connection and streams decoded rows back in batches. Lives on a worker thread
+class CachedSqlFetchWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CachedSqlFetchWorker(const QString &connectionName, QObject *parent = nullptr);
+    ~CachedSqlFetchWorker() override;
+
+    //Thread-safe, stops the current batch at the next row boundary
+    void cancel();
+
+public slots:
+    void open(const QString &stmt);
+    void fetch(int count);
+    void close();
+
+signals:
+    void opened(const QSqlRecord &record);
+    void fetched(const QVector<CachedRowValues> &rows, bool exhausted);
+    void errorOccurred(const QSqlError &error);
+
+private:
+    QString m_connectionName;
+    QString m_workerConnectionName;
+    std::unique_ptr<QSqlQuery> m_query;
+    int m_columns;
+    QAtomicInt m_canceled;
+};
+
+#endif // CACHEDSQLFETCHWORKER_H
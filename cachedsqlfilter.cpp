@@ -0,0 +1,369 @@
+#include "cachedsqlfilter.h"
+#include "cachedsqltablemodel.h"
+
+#include <QSqlDriver>
+#include <QSqlField>
+
+using CachedSql = CachedSqlTableModelSql;
+
+namespace {
+
+enum ScanKind {
+    IntScan,
+    DoubleScan,
+    StringScan,
+    VariantScan
+};
+
+ScanKind kindOf(int typeId)
+{
+    switch (typeId) {
+        case QMetaType::Bool:
+        case QMetaType::Char:
+        case QMetaType::SChar:
+        case QMetaType::UChar:
+        case QMetaType::Short:
+        case QMetaType::UShort:
+        case QMetaType::Int:
+        case QMetaType::UInt:
+        case QMetaType::Long:
+        case QMetaType::LongLong:
+            return IntScan;
+        case QMetaType::Float:
+        case QMetaType::Double:
+            return DoubleScan;
+        case QMetaType::QString:
+            return StringScan;
+        default:
+            return VariantScan;
+    }
+}
+
+bool matches(CachedSqlFilter::Op op, int cmp)
+{
+    switch (op) {
+        case CachedSqlFilter::Equal: return cmp == 0;
+        case CachedSqlFilter::NotEqual: return cmp != 0;
+        case CachedSqlFilter::Less: return cmp < 0;
+        case CachedSqlFilter::LessEqual: return cmp <= 0;
+        case CachedSqlFilter::Greater: return cmp > 0;
+        case CachedSqlFilter::GreaterEqual: return cmp >= 0;
+        default: return false;
+    }
+}
+
+bool matches(CachedSqlFilter::Op op, QPartialOrdering cmp)
+{
+    if (cmp == QPartialOrdering::Unordered)
+        return false;
+
+    return matches(op, cmp == QPartialOrdering::Less ? -1 : (cmp == QPartialOrdering::Greater ? 1 : 0));
+}
+
+template <typename T>
+bool matches(CachedSqlFilter::Op op, T a, T b)
+{
+    switch (op) {
+        case CachedSqlFilter::Equal: return a == b;
+        case CachedSqlFilter::NotEqual: return a != b;
+        case CachedSqlFilter::Less: return a < b;
+        case CachedSqlFilter::LessEqual: return a <= b;
+        case CachedSqlFilter::Greater: return a > b;
+        case CachedSqlFilter::GreaterEqual: return a >= b;
+        default: return false;
+    }
+}
+
+//Converts and compares each value in one pass, a value that does not convert is compared as a variant instead
+template <typename T, typename Convert>
+void compareColumn(const QVector<CachedRow> &rows, const QVector<int> &candidates, int column, CachedSqlFilter::Op op, const QVariant &value, T c, char *mask, Convert convert)
+{
+    for (int i = 0; i < candidates.count(); ++i) {
+        const QVariant v = rows.at(candidates.at(i)).value(column);
+
+        if (v.isNull())
+            continue;
+
+        bool ok = false;
+        const T t = convert(v, &ok);
+        mask[i] = char(ok ? matches(op, t, c) : matches(op, QVariant::compare(v, value)));
+    }
+}
+
+//Whether LOWER() folds the text the way QString does, SQLite's built in LOWER() only folds ASCII
+bool foldsCase(const QSqlDriver *driver, const QString &text)
+{
+    if (driver->dbmsType() != QSqlDriver::SQLite)
+        return true;
+
+    for (QChar ch : text) {
+        if (ch.unicode() > 0x7f)
+            return false;
+    }
+
+    return true;
+}
+
+} // namespace
+
+CachedSqlFilter::CachedSqlFilter()
+    : m_kind(Empty)
+    , m_column(-1)
+    , m_op(Equal)
+    , m_cs(Qt::CaseInsensitive)
+{
+}
+
+CachedSqlFilter::CachedSqlFilter(int column, Op op, const QVariant &value, Qt::CaseSensitivity cs)
+    : m_kind(Term)
+    , m_column(column)
+    , m_op(op)
+    , m_value(value)
+    , m_cs(cs)
+{
+}
+
+CachedSqlFilter CachedSqlFilter::all(const QList<CachedSqlFilter> &terms)
+{
+    if (terms.count() == 1)
+        return terms.front();
+
+    CachedSqlFilter filter;
+
+    if (!terms.isEmpty()) {
+        filter.m_kind = And;
+        filter.m_terms = terms;
+    }
+
+    return filter;
+}
+
+CachedSqlFilter CachedSqlFilter::any(const QList<CachedSqlFilter> &terms)
+{
+    if (terms.count() == 1)
+        return terms.front();
+
+    CachedSqlFilter filter;
+
+    if (!terms.isEmpty()) {
+        filter.m_kind = Or;
+        filter.m_terms = terms;
+    }
+
+    return filter;
+}
+
+bool CachedSqlFilter::isEmpty() const
+{
+    return m_kind == Empty;
+}
+
+bool CachedSqlFilter::isValid(int columnCount) const
+{
+    if (m_kind == Term)
+        return m_column >= 0 && m_column < columnCount;
+
+    for (const CachedSqlFilter &term : m_terms) {
+        if (!term.isValid(columnCount))
+            return false;
+    }
+
+    return true;
+}
+
+std::vector<char> CachedSqlFilter::evaluate(const QVector<CachedRow> &rows, const QVector<int> &candidates, const QSqlRecord &schema) const
+{
+    const size_t n = candidates.size();
+
+    switch (m_kind) {
+        case Empty:
+            return std::vector<char>(n, 1);
+        case Term:
+            return evaluateTerm(rows, candidates, schema);
+        case And:
+        case Or:
+            break;
+    }
+
+    std::vector<char> mask(n, m_kind == And ? 1 : 0);
+
+    for (const CachedSqlFilter &term : m_terms) {
+        const std::vector<char> sub = term.evaluate(rows, candidates, schema);
+
+        if (m_kind == And) {
+            for (size_t i = 0; i < n; ++i)
+                mask[i] &= sub[i];
+        } else {
+            for (size_t i = 0; i < n; ++i)
+                mask[i] |= sub[i];
+        }
+    }
+
+    return mask;
+}
+
+std::vector<char> CachedSqlFilter::evaluateTerm(const QVector<CachedRow> &rows, const QVector<int> &candidates, const QSqlRecord &schema) const
+{
+    const size_t n = candidates.size();
+    std::vector<char> mask(n, 0);
+
+    if (m_op == IsNull || m_op == IsNotNull) {
+        const bool wantNull = m_op == IsNull;
+
+        for (size_t i = 0; i < n; ++i)
+            mask[i] = char(rows.at(candidates.at(int(i))).value(m_column).isNull() == wantNull);
+
+        return mask;
+    }
+
+    //Comparing with NULL never matches, as in SQL
+    if (m_value.isNull())
+        return mask;
+
+    if (m_op == Contains || m_op == StartsWith) {
+        const QString needle = m_value.toString();
+
+        for (size_t i = 0; i < n; ++i) {
+            const QVariant v = rows.at(candidates.at(int(i))).value(m_column);
+
+            if (v.isNull())
+                continue;
+
+            const QString text = v.toString();
+            mask[i] = char(m_op == Contains ? text.contains(needle, m_cs) : text.startsWith(needle, m_cs));
+        }
+
+        return mask;
+    }
+
+    ScanKind kind = kindOf(schema.field(m_column).metaType().id());
+
+    //A fractional constant on an integer column compares as double
+    if (kind == IntScan && (m_value.typeId() == QMetaType::Double || m_value.typeId() == QMetaType::Float))
+        kind = DoubleScan;
+
+    bool ok = false;
+
+    if (kind == IntScan) {
+        const qint64 c = m_value.toLongLong(&ok);
+
+        if (ok) {
+            compareColumn<qint64>(rows, candidates, m_column, m_op, m_value, c, mask.data(), [](const QVariant &v, bool *rowOk) { return v.toLongLong(rowOk); });
+            return mask;
+        }
+    } else if (kind == DoubleScan) {
+        const double c = m_value.toDouble(&ok);
+
+        if (ok) {
+            compareColumn<double>(rows, candidates, m_column, m_op, m_value, c, mask.data(), [](const QVariant &v, bool *rowOk) { return v.toDouble(rowOk); });
+            return mask;
+        }
+    } else if (kind == StringScan) {
+        const QString c = m_value.toString();
+
+        for (size_t i = 0; i < n; ++i) {
+            const QVariant v = rows.at(candidates.at(int(i))).value(m_column);
+
+            if (!v.isNull())
+                mask[i] = char(matches(m_op, QString::compare(v.toString(), c)));
+        }
+
+        return mask;
+    }
+
+    //Other column types, or a constant that does not convert, compare the variants themselves
+    for (size_t i = 0; i < n; ++i) {
+        const QVariant v = rows.at(candidates.at(int(i))).value(m_column);
+        mask[i] = char(!v.isNull() && matches(m_op, QVariant::compare(v, m_value)));
+    }
+
+    return mask;
+}
+
+bool CachedSqlFilter::hasSql(const QSqlDriver *driver) const
+{
+    if (m_kind == And || m_kind == Or) {
+        for (const CachedSqlFilter &term : m_terms) {
+            if (!term.hasSql(driver))
+                return false;
+        }
+
+        return true;
+    }
+
+    if (m_kind == Empty || (m_op != Contains && m_op != StartsWith))
+        return true;
+
+    //LIKE folds case on SQLite and MySQL, only SQLite's instr() and PostgreSQL's LIKE match case-sensitively
+    if (m_cs == Qt::CaseSensitive)
+        return driver->dbmsType() == QSqlDriver::SQLite || driver->dbmsType() == QSqlDriver::PostgreSQL;
+
+    return foldsCase(driver, m_value.toString());
+}
+
+QString CachedSqlFilter::toSql(const QSqlRecord &schema, const QSqlDriver *driver) const
+{
+    if (m_kind == Empty)
+        return QString();
+
+    if (m_kind == And || m_kind == Or) {
+        QString sql;
+
+        for (const CachedSqlFilter &term : m_terms) {
+            const QString part = CachedSql::paren(term.toSql(schema, driver));
+            sql = m_kind == And ? CachedSql::et(sql, part) : CachedSql::vel(sql, part);
+        }
+
+        return sql;
+    }
+
+    const QString field = driver->escapeIdentifier(schema.fieldName(m_column), QSqlDriver::FieldName);
+
+    auto literal = [driver](const QVariant &value) {
+        QSqlField f(QString(), value.metaType());
+        f.setValue(value);
+        return driver->formatValue(f);
+    };
+
+    switch (m_op) {
+        case IsNull:
+            return CachedSql::concat(field, QStringLiteral("IS NULL"));
+        case IsNotNull:
+            return CachedSql::concat(field, QStringLiteral("IS NOT NULL"));
+        case Contains:
+        case StartsWith: {
+            //SQLite's LIKE ignores case, instr() compares the text exactly
+            if (m_cs == Qt::CaseSensitive && driver->dbmsType() == QSqlDriver::SQLite) {
+                const QString position = QStringLiteral("instr(%1, %2)").arg(field, literal(m_value.toString()));
+                return CachedSql::concat(position, m_op == Contains ? QStringLiteral("> 0") : QStringLiteral("= 1"));
+            }
+
+            //'!' rather than a backslash as the escape character, MySQL treats backslashes in literals specially
+            QString pattern = m_value.toString();
+            pattern.replace(QLatin1Char('!'), QStringLiteral("!!")).replace(QLatin1Char('%'), QStringLiteral("!%")).replace(QLatin1Char('_'), QStringLiteral("!_"));
+            pattern = (m_op == Contains ? QStringLiteral("%") : QString()) + pattern + QStringLiteral("%");
+
+            const QString value = literal(pattern);
+            const bool folded = m_cs == Qt::CaseInsensitive;
+
+            return CachedSql::concat(CachedSql::concat(folded ? QStringLiteral("LOWER(%1)").arg(field) : field, QStringLiteral("LIKE")),
+                                     CachedSql::concat(folded ? QStringLiteral("LOWER(%1)").arg(value) : value, QStringLiteral("ESCAPE '!'")));
+        }
+        default:
+            break;
+    }
+
+    QString op;
+
+    switch (m_op) {
+        case Equal: op = QStringLiteral("="); break;
+        case NotEqual: op = QStringLiteral("<>"); break;
+        case Less: op = QStringLiteral("<"); break;
+        case LessEqual: op = QStringLiteral("<="); break;
+        case Greater: op = QStringLiteral(">"); break;
+        case GreaterEqual: op = QStringLiteral(">="); break;
+        default: break;
+    }
+
+    return CachedSql::concat(CachedSql::concat(field, op), literal(m_value));
+}
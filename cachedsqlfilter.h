@@ -0,0 +1,70 @@
+#ifndef CACHEDSQLFILTER_H
+#define CACHEDSQLFILTER_H
+
+#include "cachedrow.h"
+
+#include <QList>
+#include <QSqlRecord>
+#include <QVariant>
+#include <QVector>
+
+#include <vector>
+
+class QSqlDriver;
+
+//Typed row predicate, a column comparison or an AND/OR tree of them, evaluated over the cache or turned into a WHERE clause
+class CachedSqlFilter
+{
+public:
+    enum Op {
+        Equal,
+        NotEqual,
+        Less,
+        LessEqual,
+        Greater,
+        GreaterEqual,
+        Contains,     //Substring match on the value's text, honours the case sensitivity
+        StartsWith,   //Prefix match on the value's text, honours the case sensitivity
+        IsNull,
+        IsNotNull
+    };
+
+    //An empty filter matches every row
+    CachedSqlFilter();
+    CachedSqlFilter(int column, Op op, const QVariant &value = QVariant(), Qt::CaseSensitivity cs = Qt::CaseInsensitive);
+
+    static CachedSqlFilter all(const QList<CachedSqlFilter> &terms);
+    static CachedSqlFilter any(const QList<CachedSqlFilter> &terms);
+
+    bool isEmpty() const;
+    bool isValid(int columnCount) const;
+
+    //One flag per candidate row, non-zero where the row matches. Numeric columns are compared as numbers, other values as variants
+    std::vector<char> evaluate(const QVector<CachedRow> &rows, const QVector<int> &candidates, const QSqlRecord &schema) const;
+
+    //Whether toSql() matches exactly the rows evaluate() does on this driver. Case-sensitive text matches need SQLite or PostgreSQL, and
+    //case-insensitive ones on SQLite an ASCII needle
+    bool hasSql(const QSqlDriver *driver) const;
+
+    //WHERE clause with the values inlined by the driver, empty for an empty filter
+    QString toSql(const QSqlRecord &schema, const QSqlDriver *driver) const;
+
+private:
+    enum Kind {
+        Empty,
+        Term,
+        And,
+        Or
+    };
+
+    std::vector<char> evaluateTerm(const QVector<CachedRow> &rows, const QVector<int> &candidates, const QSqlRecord &schema) const;
+
+    Kind m_kind;
+    int m_column;
+    Op m_op;
+    QVariant m_value;
+    Qt::CaseSensitivity m_cs;
+    QList<CachedSqlFilter> m_terms;
+};
+
+#endif // CACHEDSQLFILTER_H
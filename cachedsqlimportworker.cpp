@@ -0,0 +1,335 @@
+#include "cachedsqlimportworker.h"
+
+#include <QFile>
+#include <QSqlField>
+#include <QThread>
+
+#include <cstring>
+
+//Bytes handed out per round of parsing, split across the threads and sent back as one batch
+static constexpr qint64 BlockSize = 4 * 1024 * 1024;
+
+CachedSqlImportWorker::CachedSqlImportWorker(const QSqlRecord &record, char separator, bool hasHeader, QObject *parent)
+    : QObject(parent)
+    , m_record(record)
+    , m_separator(separator)
+    , m_hasHeader(hasHeader)
+    , m_canceled(0)
+    , m_begun(false)
+    , m_failed(false)
+    , m_total(0)
+{
+    //The pool's threads are kept across blocks, this thread parses a slice of its own
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+
+    //Without a header the fields map to the model's columns by position
+    for (int i = 0; i < m_record.count(); ++i) {
+        m_types.append(m_record.field(i).metaType());
+        m_columns.append(i);
+    }
+}
+
+void CachedSqlImportWorker::cancel()
+{
+    m_canceled.storeRelaxed(1);
+}
+
+void CachedSqlImportWorker::importFile(const QString &fileName)
+{
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        emit errorOccurred(QSqlError(file.errorString(), QString(), QSqlError::UnknownError));
+        return;
+    }
+
+    const qint64 size = file.size();
+
+    //Parse straight from the page cache where possible
+    if (size > 0) {
+        if (uchar *map = file.map(0, size)) {
+            const char *data = reinterpret_cast<const char *>(map);
+
+            if (parse(data, begin(data, size), size))
+                emit finished(m_total);
+
+            file.unmap(map);
+            return;
+        }
+    }
+
+    //Not every file can be mapped, read it instead
+    const QByteArray data = file.readAll();
+
+    if (parse(data.constData(), begin(data.constData(), data.size()), data.size()))
+        emit finished(m_total);
+}
+
+void CachedSqlImportWorker::append(const QByteArray &data)
+{
+    if (m_failed)
+        return;
+
+    m_buffer += data;
+
+    //Only whole records are parsed, the cut one waits for the next chunk
+    const char *buffer = m_buffer.constData();
+    const qint64 end = recordsEnd(buffer, 0, m_buffer.size());
+
+    if (end > 0) {
+        qint64 pos = 0;
+
+        if (!m_begun) {
+            pos = begin(buffer, end);
+            m_begun = true;
+        }
+
+        if (!parse(buffer, pos, end))
+            return;
+
+        m_buffer.remove(0, end);
+    }
+
+    emit consumed();
+}
+
+void CachedSqlImportWorker::finish()
+{
+    if (m_failed)
+        return;
+
+    const char *buffer = m_buffer.constData();
+    qint64 pos = 0;
+
+    if (!m_begun) {
+        pos = begin(buffer, m_buffer.size());
+        m_begun = true;
+    }
+
+    if (!parse(buffer, pos, m_buffer.size()))
+        return;
+
+    m_buffer.clear();
+    emit finished(m_total);
+}
+
+qint64 CachedSqlImportWorker::begin(const char *data, qint64 size)
+{
+    qint64 pos = 0;
+
+    //Skip a UTF-8 byte order mark
+    if (size >= 3 && std::memcmp(data, "\xEF\xBB\xBF", 3) == 0)
+        pos = 3;
+
+    if (m_hasHeader)
+        pos = readHeader(data, pos, size);
+
+    return pos;
+}
+
+bool CachedSqlImportWorker::parse(const char *data, qint64 pos, qint64 size)
+{
+    QVector<Slice> slices;
+
+    while (pos < size) {
+        if (m_canceled.loadRelaxed())
+            return false;
+
+        const qint64 next = splitBlock(data, pos, size, slices);
+
+        //Every slice but the first is parsed on the pool, the first one on this thread
+        for (int i = 1; i < slices.count(); ++i) {
+            Slice *slice = &slices[i];
+            m_pool.start([this, data, slice]() { parseSlice(data, *slice); });
+        }
+
+        parseSlice(data, slices[0]);
+        m_pool.waitForDone();
+
+        //Stitch the slices back together in file order
+        QVector<CachedRowValues> rows;
+
+        for (const Slice &slice : std::as_const(slices)) {
+            if (slice.failedRecord != -1) {
+                const QString text = QStringLiteral("Cannot convert \"%1\" to the type of column %2 in record %3")
+                                         .arg(slice.failedText, m_record.fieldName(slice.failedColumn))
+                                         .arg(m_total + rows.count() + slice.failedRecord + 1);
+                m_failed = true;
+                emit errorOccurred(QSqlError(text, QString(), QSqlError::StatementError));
+                return false;
+            }
+
+            rows += slice.rows;
+        }
+
+        m_total += rows.count();
+        pos = next;
+
+        if (!rows.isEmpty())
+            emit imported(rows);
+    }
+
+    return true;
+}
+
+qint64 CachedSqlImportWorker::recordsEnd(const char *data, qint64 pos, qint64 size)
+{
+    //Just past the last newline outside quotes, pos itself when no record is complete yet
+    qint64 end = pos;
+    bool inQuotes = false;
+
+    for (qint64 i = pos; i < size; ++i) {
+        if (data[i] == '"')
+            inQuotes = !inQuotes;
+        else if (data[i] == '\n' && !inQuotes)
+            end = i + 1;
+    }
+
+    return end;
+}
+
+qint64 CachedSqlImportWorker::splitBlock(const char *data, qint64 begin, qint64 size, QVector<Slice> &slices) const
+{
+    const qint64 sliceSize = qMax<qint64>(1, BlockSize / qMax(1, QThread::idealThreadCount()));
+
+    slices.clear();
+    Slice slice;
+    slice.begin = begin;
+
+    //Cut at record boundaries only, a newline inside quotes belongs to the field. An escaped quote toggles twice
+    bool inQuotes = false;
+
+    for (qint64 pos = begin; pos < size; ++pos) {
+        const char c = data[pos];
+
+        if (c == '"') {
+            inQuotes = !inQuotes;
+        } else if (c == '\n' && !inQuotes && pos + 1 - slice.begin >= sliceSize) {
+            slice.end = pos + 1;
+            slices.append(slice);
+
+            if (slice.end - begin >= BlockSize)
+                return slice.end;
+
+            slice = Slice();
+            slice.begin = pos + 1;
+        }
+    }
+
+    if (slice.begin < size) {
+        slice.end = size;
+        slices.append(slice);
+    }
+
+    return size;
+}
+
+qint64 CachedSqlImportWorker::readHeader(const char *data, qint64 pos, qint64 size)
+{
+    QVector<QByteArray> fields;
+    QVector<bool> quoted;
+    pos = readFields(data, pos, size, fields, quoted);
+
+    //Fields are matched to the model's columns by name, columns the model does not have are skipped
+    m_columns.clear();
+
+    for (const QByteArray &name : std::as_const(fields))
+        m_columns.append(m_record.indexOf(QString::fromUtf8(name).trimmed()));
+
+    return pos;
+}
+
+qint64 CachedSqlImportWorker::readFields(const char *data, qint64 pos, qint64 end, QVector<QByteArray> &fields, QVector<bool> &quoted) const
+{
+    fields.clear();
+    quoted.clear();
+
+    while (true) {
+        QByteArray field;
+        bool isQuoted = false;
+
+        if (pos < end && data[pos] == '"') {
+            isQuoted = true;
+            ++pos;
+
+            while (pos < end) {
+                const char c = data[pos++];
+
+                if (c == '"') {
+                    if (pos < end && data[pos] == '"') {
+                        field += '"';
+                        ++pos;
+                        continue;
+                    }
+
+                    break;
+                }
+
+                field += c;
+            }
+        }
+
+        //Unquoted text, or whatever follows a closing quote, runs to the separator or the end of the record
+        const qint64 start = pos;
+
+        while (pos < end && data[pos] != m_separator && data[pos] != '\n')
+            ++pos;
+
+        qint64 stop = pos;
+
+        if (stop > start && data[stop - 1] == '\r')
+            --stop;
+
+        field.append(data + start, stop - start);
+        fields.append(field);
+        quoted.append(isQuoted);
+
+        if (pos < end && data[pos] == m_separator) {
+            ++pos;
+            continue;
+        }
+
+        //Step over the newline
+        return pos < end ? pos + 1 : pos;
+    }
+}
+
+void CachedSqlImportWorker::parseSlice(const char *data, Slice &slice) const
+{
+    QVector<QByteArray> fields;
+    QVector<bool> quoted;
+    qint64 pos = slice.begin;
+
+    while (pos < slice.end) {
+        pos = readFields(data, pos, slice.end, fields, quoted);
+
+        //Blank lines are not records
+        if (fields.count() == 1 && fields.front().isEmpty() && !quoted.front())
+            continue;
+
+        CachedRowValues values(m_record.count());
+
+        for (int i = 0; i < fields.count() && i < m_columns.count(); ++i) {
+            const int c = m_columns.at(i);
+
+            //Empty unquoted fields are NULL, the insert leaves those columns to the database
+            if (c == -1 || (fields.at(i).isEmpty() && !quoted.at(i)))
+                continue;
+
+            const QString text = QString::fromUtf8(fields.at(i));
+            const QMetaType type = m_types.at(c);
+            QVariant value(text);
+
+            if (type.isValid() && type.id() != QMetaType::QString && !value.convert(type)) {
+                slice.failedRecord = slice.rows.count();
+                slice.failedColumn = c;
+                slice.failedText = text;
+                return;
+            }
+
+            values[c] = value;
+        }
+
+        slice.rows.append(values);
+    }
+}
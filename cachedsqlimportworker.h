@@ -0,0 +1,68 @@
+#ifndef CACHEDSQLIMPORTWORKER_H
+#define CACHEDSQLIMPORTWORKER_H
+
+#include "cachedrow.h"
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QSqlError>
+#include <QSqlRecord>
+#include <QThreadPool>
+#include <QVector>
+
+//Parses CSV text into rows laid out like the model's record and streams them back in batches. Lives on a worker thread
+class CachedSqlImportWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    CachedSqlImportWorker(const QSqlRecord &record, char separator, bool hasHeader, QObject *parent = nullptr);
+
+    //Thread-safe, stops at the next block boundary
+    void cancel();
+
+public slots:
+    void importFile(const QString &fileName);
+    void append(const QByteArray &data);   //Next bytes of a stream, a record may be cut anywhere
+    void finish();                         //End of the stream, parses the last record
+
+signals:
+    void imported(const QVector<CachedRowValues> &rows);
+    void consumed();   //Bytes handed to append() have been parsed, the next chunk may be sent
+    void finished(int rows);
+    void errorOccurred(const QSqlError &error);
+
+private:
+    //A run of whole records, parsed independently of the others
+    struct Slice
+    {
+        qint64 begin = 0;
+        qint64 end = 0;
+        QVector<CachedRowValues> rows;
+        int failedRecord = -1;   //Record within the slice whose value could not be converted
+        int failedColumn = -1;
+        QString failedText;
+    };
+
+    qint64 begin(const char *data, qint64 size);
+    bool parse(const char *data, qint64 pos, qint64 size);
+    static qint64 recordsEnd(const char *data, qint64 pos, qint64 size);
+    qint64 splitBlock(const char *data, qint64 begin, qint64 size, QVector<Slice> &slices) const;
+    qint64 readHeader(const char *data, qint64 pos, qint64 size);
+    qint64 readFields(const char *data, qint64 pos, qint64 end, QVector<QByteArray> &fields, QVector<bool> &quoted) const;
+    void parseSlice(const char *data, Slice &slice) const;
+
+    QSqlRecord m_record;
+    QVector<QMetaType> m_types;   //Target type per model column
+    QVector<int> m_columns;       //CSV field -> model column, -1 for fields the model does not have
+    char m_separator;
+    bool m_hasHeader;
+    QAtomicInt m_canceled;
+    QThreadPool m_pool;
+    QByteArray m_buffer;   //Stream bytes after the last whole record
+    bool m_begun;          //Byte order mark and header have been read
+    bool m_failed;
+    int m_total;
+};
+
+#endif // CACHEDSQLIMPORTWORKER_H
@@ -0,0 +1,131 @@
+#include "cachedsqlrefreshworker.h"
+#include "cachedsqltablemodel.h"
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+
+using CachedSql = CachedSqlTableModelSql;
+
+CachedSqlRefreshWorker::CachedSqlRefreshWorker(QObject *parent)
+    : QObject(parent)
+    , m_workerConnectionName(QStringLiteral("CachedSqlRefreshWorker_%1").arg(quintptr(this)))
+    , m_canceled(0)
+{
+}
+
+void CachedSqlRefreshWorker::cancel()
+{
+    m_canceled.storeRelaxed(1);
+}
+
+void CachedSqlRefreshWorker::refresh(const CachedSqlRefreshSource &source)
+{
+    QSet<CachedRowKey> keys;
+    QVector<CachedRowValues> rows;
+    QSqlError error;
+    bool success = false;
+
+    {
+        //Connections are bound to the thread that created them, clone the model's connection on this thread
+        QSqlDatabase db = QSqlDatabase::cloneDatabase(source.connectionName, m_workerConnectionName);
+
+        if (!db.open())
+            error = db.lastError();
+        else
+            success = read(db, source, keys, rows, error);
+
+        db.close();
+    }
+
+    QSqlDatabase::removeDatabase(m_workerConnectionName);
+
+    //A canceled refresh reports nothing, the model has moved on
+    if (m_canceled.loadRelaxed())
+        return;
+
+    if (success)
+        emit refreshed(keys, rows);
+    else
+        emit errorOccurred(error);
+}
+
+bool CachedSqlRefreshWorker::read(QSqlDatabase &db, const CachedSqlRefreshSource &source, QSet<CachedRowKey> &keys, QVector<CachedRowValues> &rows, QSqlError &error)
+{
+    //Every key still in the result, cached rows missing from it have been deleted by someone else
+    QVector<CachedRowValues> keyRows;
+
+    if (!readRows(db, source.keysStatement, QVariantList(), source.keyFields.count(), keyRows, error))
+        return false;
+
+    keys.reserve(keyRows.count());
+
+    for (const CachedRowValues &values : std::as_const(keyRows))
+        keys.insert(CachedRowKey(values));
+
+    keyRows.clear();
+
+    //Only newer versions when a version column is set
+    if (!source.versionStatement.isEmpty())
+        return readRows(db, source.versionStatement, {source.lastVersion}, source.columns, rows, error);
+
+    //Otherwise the resident rows by key, and once the result is drained the keys nobody has fetched yet
+    QVector<CachedRowKey> readKeys = source.readKeys;
+
+    if (source.readNewRows) {
+        for (const CachedRowKey &key : std::as_const(keys)) {
+            if (!source.cachedKeys.contains(key))
+                readKeys.append(key);
+        }
+    }
+
+    for (int start = 0; start < readKeys.count(); start += source.chunkSize) {
+        const int end = qMin(int(readKeys.count()), start + source.chunkSize);
+        QVariantList binds;
+
+        for (int k = start; k < end; ++k)
+            binds += readKeys.at(k).values();
+
+        const QString stmt = CachedSql::concat(source.rowsStatement, CachedSql::where(CachedSqlTableModel::keyPredicate(source.keyFields, end - start)));
+
+        if (!readRows(db, stmt, binds, source.columns, rows, error))
+            return false;
+    }
+
+    return true;
+}
+
+bool CachedSqlRefreshWorker::readRows(QSqlDatabase &db, const QString &stmt, const QVariantList &binds, int columns, QVector<CachedRowValues> &rows, QSqlError &error)
+{
+    if (m_canceled.loadRelaxed())
+        return false;
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+
+    if (!query.prepare(stmt)) {
+        error = query.lastError();
+        return false;
+    }
+
+    for (int i = 0; i < binds.count(); ++i)
+        query.bindValue(i, binds.at(i));
+
+    if (!query.exec()) {
+        error = query.lastError();
+        return false;
+    }
+
+    while (query.next()) {
+        if (m_canceled.loadRelaxed())
+            return false;
+
+        CachedRowValues values(columns);
+
+        for (int i = 0; i < columns; ++i)
+            values[i] = query.value(i);
+
+        rows.push_back(values);
+    }
+
+    return true;
+}
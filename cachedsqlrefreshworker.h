@@ -0,0 +1,58 @@
+#ifndef CACHEDSQLREFRESHWORKER_H
+#define CACHEDSQLREFRESHWORKER_H
+
+#include "cachedrow.h"
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QSet>
+#include <QSqlError>
+#include <QStringList>
+#include <QVector>
+
+class QSqlDatabase;
+
+//What a background refresh reads, put together by the model on its own thread
+struct CachedSqlRefreshSource
+{
+    QString connectionName;
+    QString keysStatement;              //Key columns of the whole filtered result
+    QString versionStatement;           //Rows with a version newer than lastVersion, empty when rows are read by key instead
+    QVariant lastVersion;
+    QString rowsStatement;              //The filtered result, narrowed down by a key predicate per chunk
+    QStringList keyFields;              //Escaped key column names for the predicate
+    int chunkSize = 1;                  //Keys per statement, below the bind value limit
+    int columns = 0;
+    QVector<CachedRowKey> readKeys;     //Rows read back by key when there is no version column
+    QSet<CachedRowKey> cachedKeys;      //Keys in the cache, keys of the result not among them are new rows
+    bool readNewRows = false;           //Whether new rows are read too, only once nothing is left to fetch
+};
+
+//Reads what refresh() needs to merge on its own database connection, so validating a cache costs the model's thread nothing but the
+//merge. Lives on a worker thread
+class CachedSqlRefreshWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CachedSqlRefreshWorker(QObject *parent = nullptr);
+
+    //Thread-safe, stops at the next statement
+    void cancel();
+
+public slots:
+    void refresh(const CachedSqlRefreshSource &source);
+
+signals:
+    void refreshed(const QSet<CachedRowKey> &keys, const QVector<CachedRowValues> &rows);
+    void errorOccurred(const QSqlError &error);
+
+private:
+    bool read(QSqlDatabase &db, const CachedSqlRefreshSource &source, QSet<CachedRowKey> &keys, QVector<CachedRowValues> &rows, QSqlError &error);
+    bool readRows(QSqlDatabase &db, const QString &stmt, const QVariantList &binds, int columns, QVector<CachedRowValues> &rows, QSqlError &error);
+
+    QString m_workerConnectionName;
+    QAtomicInt m_canceled;
+};
+
+#endif // CACHEDSQLREFRESHWORKER_H
@@ -0,0 +1,207 @@
+#include "cachedsqlsearchindex.h"
+
+#include <algorithm>
+#include <iterator>
+
+int CachedSqlSearchIndex::count() const
+{
+    return m_texts.count();
+}
+
+void CachedSqlSearchIndex::clear()
+{
+    m_texts.clear();
+    m_originals.clear();
+    m_postings.clear();
+    m_postingsValid = true;
+}
+
+void CachedSqlSearchIndex::append(const QString &text)
+{
+    m_texts.append(text.toCaseFolded());
+    m_originals.append(text);
+
+    //Rows are appended in order, the posting lists stay sorted
+    if (m_postingsValid)
+        addPostings(m_texts.count() - 1);
+}
+
+void CachedSqlSearchIndex::set(int row, const QString &text)
+{
+    if (row < 0 || row >= m_texts.count())
+        return;
+
+    if (text == m_originals.at(row))
+        return;
+
+    if (m_postingsValid)
+        removePostings(row);
+
+    m_texts[row] = text.toCaseFolded();
+    m_originals[row] = text;
+
+    if (m_postingsValid)
+        addPostings(row);
+}
+
+void CachedSqlSearchIndex::insert(int row, int count)
+{
+    if (row < 0 || row > m_texts.count() || count <= 0)
+        return;
+
+    m_texts.insert(row, count, QString());
+    m_originals.insert(row, count, QString());
+
+    if (row < m_texts.count() - count)
+        m_postingsValid = false;
+}
+
+void CachedSqlSearchIndex::remove(int row, int count)
+{
+    row = qMax(0, row);
+    count = qMin(count, int(m_texts.count()) - row);
+
+    if (count <= 0)
+        return;
+
+    m_texts.remove(row, count);
+    m_originals.remove(row, count);
+    m_postingsValid = false;
+}
+
+void CachedSqlSearchIndex::permute(const QVector<int> &newRows)
+{
+    if (newRows.count() != m_texts.count())
+        return;
+
+    QVector<QString> texts(m_texts.count());
+    QVector<QString> originals(m_originals.count());
+
+    for (int row = 0; row < newRows.count(); ++row) {
+        texts[newRows.at(row)] = std::move(m_texts[row]);
+        originals[newRows.at(row)] = std::move(m_originals[row]);
+    }
+
+    m_texts.swap(texts);
+    m_originals.swap(originals);
+    m_postingsValid = false;
+}
+
+QVector<int> CachedSqlSearchIndex::find(const QString &text, MatchType type, Qt::CaseSensitivity cs) const
+{
+    const QString needle = text.toCaseFolded();
+    QVector<int> rows;
+
+    //Too short to have a trigram, scan the folded texts, still far cheaper than going through data()
+    if (needle.size() < 3) {
+        for (int row = 0; row < m_texts.count(); ++row) {
+            if (matches(m_texts.at(row), needle, type) && (cs == Qt::CaseInsensitive || matches(m_originals.at(row), text, type)))
+                rows.append(row);
+        }
+
+        return rows;
+    }
+
+    if (!m_postingsValid)
+        rebuild();
+
+    //Intersect the posting lists of every trigram of the needle, shortest first
+    QVector<const QVector<int> *> lists;
+
+    for (quint64 trigram : trigrams(needle)) {
+        const auto it = m_postings.constFind(trigram);
+
+        if (it == m_postings.cend())
+            return rows;
+
+        lists.append(&it.value());
+    }
+
+    std::sort(lists.begin(), lists.end(), [](const QVector<int> *a, const QVector<int> *b) { return a->count() < b->count(); });
+
+    QVector<int> candidates = *lists.front();
+
+    for (int i = 1; i < lists.count() && !candidates.isEmpty(); ++i) {
+        QVector<int> narrowed;
+        std::set_intersection(candidates.cbegin(), candidates.cend(), lists.at(i)->cbegin(), lists.at(i)->cend(), std::back_inserter(narrowed));
+        candidates.swap(narrowed);
+    }
+
+    //Sharing every trigram does not make a match, check the text itself. A case sensitive search checks it as given as well
+    for (int row : std::as_const(candidates)) {
+        if (matches(m_texts.at(row), needle, type) && (cs == Qt::CaseInsensitive || matches(m_originals.at(row), text, type)))
+            rows.append(row);
+    }
+
+    return rows;
+}
+
+QVector<quint64> CachedSqlSearchIndex::trigrams(const QString &folded)
+{
+    QVector<quint64> keys;
+
+    if (folded.size() < 3)
+        return keys;
+
+    keys.reserve(folded.size() - 2);
+    const QChar *c = folded.constData();
+
+    for (qsizetype i = 0; i + 2 < folded.size(); ++i)
+        keys.append(quint64(c[i].unicode()) << 32 | quint64(c[i + 1].unicode()) << 16 | quint64(c[i + 2].unicode()));
+
+    //Each row appears once per posting list
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+bool CachedSqlSearchIndex::matches(const QString &folded, const QString &needle, MatchType type)
+{
+    switch (type) {
+        case StartsWith: return folded.startsWith(needle);
+        case Exactly: return folded == needle;
+        case Contains: break;
+    }
+
+    return folded.contains(needle);
+}
+
+void CachedSqlSearchIndex::addPostings(int row)
+{
+    for (quint64 trigram : trigrams(m_texts.at(row))) {
+        QVector<int> &list = m_postings[trigram];
+        list.insert(std::lower_bound(list.begin(), list.end(), row), row);
+    }
+}
+
+void CachedSqlSearchIndex::removePostings(int row)
+{
+    for (quint64 trigram : trigrams(m_texts.at(row))) {
+        const auto it = m_postings.find(trigram);
+
+        if (it == m_postings.end())
+            continue;
+
+        QVector<int> &list = it.value();
+        const auto pos = std::lower_bound(list.begin(), list.end(), row);
+
+        if (pos != list.end() && *pos == row)
+            list.erase(pos);
+
+        if (list.isEmpty())
+            m_postings.erase(it);
+    }
+}
+
+void CachedSqlSearchIndex::rebuild() const
+{
+    m_postings.clear();
+
+    //Rows in ascending order keep every posting list sorted without a sort
+    for (int row = 0; row < m_texts.count(); ++row) {
+        for (quint64 trigram : trigrams(m_texts.at(row)))
+            m_postings[trigram].append(row);
+    }
+
+    m_postingsValid = true;
+}
@@ -0,0 +1,45 @@
+#ifndef CACHEDSQLSEARCHINDEX_H
+#define CACHEDSQLSEARCHINDEX_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+//Substring index over the text of one column, one posting list of rows per trigram. Postings are case insensitive
+class CachedSqlSearchIndex
+{
+public:
+    enum MatchType {
+        Contains,
+        StartsWith,
+        Exactly
+    };
+
+    int count() const;
+    void clear();
+
+    //Row positions follow the cache, the owner reports every change
+    void append(const QString &text);
+    void set(int row, const QString &text);
+    void insert(int row, int count);
+    void remove(int row, int count);
+    void permute(const QVector<int> &newRows);   //old row -> new row
+
+    //Rows whose text matches, in ascending order. Evicted rows are matched too, the index holds the text as given
+    QVector<int> find(const QString &text, MatchType type = Contains, Qt::CaseSensitivity cs = Qt::CaseInsensitive) const;
+
+private:
+    static QVector<quint64> trigrams(const QString &folded);
+    static bool matches(const QString &folded, const QString &needle, MatchType type);
+
+    void addPostings(int row);
+    void removePostings(int row);
+    void rebuild() const;
+
+    QVector<QString> m_texts;       //Case folded text per row
+    QVector<QString> m_originals;   //Text per row as given, shares its data with the folded text where folding changed nothing
+    mutable QHash<quint64, QVector<int>> m_postings;
+    mutable bool m_postingsValid = true;   //Structural changes only move the texts, the postings are rebuilt on the next search
+};
+
+#endif // CACHEDSQLSEARCHINDEX_H
@@ -0,0 +1,203 @@
+#include "cachedsqlsnapshot.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+#include <QSqlField>
+#include <QStringList>
+
+//Header: magic, format version, payload size and a SHA-1 of the payload, followed by the payload itself
+static const quint32 SnapshotMagic = 0x43535153;   //"CSQS"
+static const int ChecksumSize = 20;
+static const int HeaderSize = 4 + 2 + 8 + ChecksumSize;
+static const QDataStream::Version StreamVersion = QDataStream::Qt_6_4;
+
+bool CachedSqlSnapshot::write(const QString &path, QString &error) const
+{
+    QByteArray payload;
+
+    {
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out.setVersion(StreamVersion);
+
+        out << tableName << selectStatement << filter;
+
+        out << qint32(record.count());
+
+        for (int i = 0; i < record.count(); ++i) {
+            const QSqlField field = record.field(i);
+            out << field.name() << field.tableName() << qint32(field.metaType().id())
+                << field.isAutoValue() << field.isReadOnly() << qint32(field.requiredStatus());
+        }
+
+        QStringList keyFields;
+
+        for (int i = 0; i < primaryIndex.count(); ++i)
+            keyFields.append(primaryIndex.fieldName(i));
+
+        out << primaryIndex.cursorName() << primaryIndex.name() << keyFields;
+        out << versionColumn << lastVersion;
+
+        out << qint32(rows.count());
+
+        for (const CachedRowValues &values : rows) {
+            for (const QVariant &value : values)
+                out << value;
+        }
+
+        if (out.status() != QDataStream::Ok) {
+            error = QStringLiteral("Could not encode the snapshot");
+            return false;
+        }
+    }
+
+    QSaveFile file(path);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(StreamVersion);
+
+    out << SnapshotMagic << FormatVersion << quint64(payload.size());
+    out.writeRawData(QCryptographicHash::hash(payload, QCryptographicHash::Sha1).constData(), ChecksumSize);
+    out.writeRawData(payload.constData(), int(payload.size()));
+
+    if (out.status() != QDataStream::Ok || !file.commit()) {
+        error = file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+bool CachedSqlSnapshot::read(const QString &path, QString &error)
+{
+    QFile file(path);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    const qint64 size = file.size();
+
+    if (size < HeaderSize) {
+        error = QStringLiteral("Snapshot is truncated");
+        return false;
+    }
+
+    //The mapping stays valid until the file is closed, decoding copies everything it keeps
+    QByteArray data;
+
+    if (uchar *mapped = file.map(0, size))
+        data = QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), size);
+    else
+        data = file.readAll();
+
+    QDataStream header(data);
+    header.setVersion(StreamVersion);
+
+    quint32 magic = 0;
+    quint16 version = 0;
+    quint64 payloadSize = 0;
+
+    header >> magic >> version >> payloadSize;
+
+    if (magic != SnapshotMagic) {
+        error = QStringLiteral("Not a snapshot file");
+        return false;
+    }
+
+    if (version != FormatVersion) {
+        error = QStringLiteral("Unsupported snapshot version %1").arg(version);
+        return false;
+    }
+
+    if (payloadSize != quint64(size - HeaderSize)) {
+        error = QStringLiteral("Snapshot is truncated");
+        return false;
+    }
+
+    const QByteArray checksum = QByteArray::fromRawData(data.constData() + HeaderSize - ChecksumSize, ChecksumSize);
+    const QByteArray payload = QByteArray::fromRawData(data.constData() + HeaderSize, qsizetype(payloadSize));
+
+    if (QCryptographicHash::hash(payload, QCryptographicHash::Sha1) != checksum) {
+        error = QStringLiteral("Snapshot checksum mismatch");
+        return false;
+    }
+
+    QDataStream in(payload);
+    in.setVersion(StreamVersion);
+
+    in >> tableName >> selectStatement >> filter;
+
+    qint32 fieldCount = 0;
+    in >> fieldCount;
+
+    record.clear();
+
+    for (int i = 0; i < fieldCount && in.status() == QDataStream::Ok; ++i) {
+        QString name;
+        QString table;
+        qint32 typeId = 0;
+        bool autoValue = false;
+        bool readOnly = false;
+        qint32 required = 0;
+
+        in >> name >> table >> typeId >> autoValue >> readOnly >> required;
+
+        QSqlField field(name, QMetaType(typeId), table);
+        field.setAutoValue(autoValue);
+        field.setReadOnly(readOnly);
+        field.setRequiredStatus(QSqlField::RequiredStatus(required));
+        record.append(field);
+    }
+
+    QString cursorName;
+    QString indexName;
+    QStringList keyFields;
+
+    in >> cursorName >> indexName >> keyFields;
+
+    primaryIndex = QSqlIndex(cursorName, indexName);
+
+    for (const QString &name : std::as_const(keyFields))
+        primaryIndex.append(record.field(name));
+
+    in >> versionColumn >> lastVersion;
+
+    qint32 rowCount = 0;
+    in >> rowCount;
+
+    rows.clear();
+
+    if (in.status() == QDataStream::Ok && rowCount > 0) {
+        rows.reserve(rowCount);
+
+        for (int r = 0; r < rowCount && in.status() == QDataStream::Ok; ++r) {
+            CachedRowValues values(fieldCount);
+
+            for (int c = 0; c < fieldCount; ++c)
+                in >> values[c];
+
+            rows.append(values);
+        }
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        error = QStringLiteral("Snapshot is corrupt");
+        rows.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool CachedSqlSnapshot::matches(const QString &table, const QString &select, const QString &where) const
+{
+    return tableName == table && selectStatement == select && filter == where;
+}
@@ -0,0 +1,40 @@
+#ifndef CACHEDSQLSNAPSHOT_H
+#define CACHEDSQLSNAPSHOT_H
+
+#include "cachedrow.h"
+
+#include <QSqlIndex>
+#include <QSqlRecord>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+//Clean rows and schema of a model, stored in a versioned and checksummed file for a fast cold start
+struct CachedSqlSnapshot
+{
+    //Bumped whenever the layout changes, older files are rejected rather than misread
+    static const quint16 FormatVersion = 1;
+
+    //Identify the result the rows came from, a snapshot only loads into a model with the same ones
+    QString tableName;
+    QString selectStatement;
+    QString filter;
+
+    QSqlRecord record;
+    QSqlIndex primaryIndex;
+
+    QString versionColumn;
+    QVariant lastVersion;
+
+    QVector<CachedRowValues> rows;
+
+    //Writes through a temporary file, an interrupted save leaves the previous snapshot intact
+    bool write(const QString &path, QString &error) const;
+
+    //Maps the file instead of reading it where the platform allows, then verifies the checksum before decoding
+    bool read(const QString &path, QString &error);
+
+    bool matches(const QString &table, const QString &select, const QString &where) const;
+};
+
+#endif // CACHEDSQLSNAPSHOT_H
@@ -0,0 +1,224 @@
+#include "cachedsqlsorter.h"
+
+#include <QAtomicInt>
+#include <QCollator>
+#include <QCollatorSortKey>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <optional>
+#include <vector>
+
+namespace {
+
+//Below this many rows per task the threading overhead outweighs the gain
+const int ParallelThreshold = 16384;
+
+enum KeyKind {
+    IntKey,
+    DoubleKey,
+    StringKey,
+    VariantKey
+};
+
+//One pre-extracted sort key column, only the vector matching the kind is populated
+struct KeyColumn
+{
+    KeyKind kind;
+    bool descending;
+    std::vector<char> nulls;
+    std::vector<qint64> ints;
+    std::vector<double> doubles;
+    std::vector<std::optional<QCollatorSortKey>> strings;
+    std::vector<QVariant> variants;
+
+    int compare(int a, int b) const
+    {
+        //NULL sorts before any value, matching the previous comparator
+        if (nulls[a] || nulls[b])
+            return int(nulls[b]) - int(nulls[a]);
+
+        switch (kind) {
+            case IntKey:
+                return ints[a] < ints[b] ? -1 : (ints[b] < ints[a] ? 1 : 0);
+            case DoubleKey:
+                return doubles[a] < doubles[b] ? -1 : (doubles[b] < doubles[a] ? 1 : 0);
+            case StringKey:
+                return strings[a]->compare(*strings[b]);
+            case VariantKey: {
+                const QPartialOrdering cmp = QVariant::compare(variants[a], variants[b]);
+                return cmp == QPartialOrdering::Less ? -1 : (cmp == QPartialOrdering::Greater ? 1 : 0);
+            }
+        }
+
+        return 0;
+    }
+};
+
+KeyKind kindOf(int typeId)
+{
+    switch (typeId) {
+        case QMetaType::Bool:
+        case QMetaType::Char:
+        case QMetaType::SChar:
+        case QMetaType::UChar:
+        case QMetaType::Short:
+        case QMetaType::UShort:
+        case QMetaType::Int:
+        case QMetaType::UInt:
+        case QMetaType::Long:
+        case QMetaType::LongLong:
+            return IntKey;
+        case QMetaType::Float:
+        case QMetaType::Double:
+            return DoubleKey;
+        case QMetaType::QString:
+            return StringKey;
+        default:
+            return VariantKey;
+    }
+}
+
+//Runs task(0) .. task(count - 1), all but the first on the global thread pool
+void parallelFor(int count, const std::function<void(int)> &task)
+{
+    if (count <= 0)
+        return;
+
+    QSemaphore done;
+
+    for (int i = 1; i < count; ++i) {
+        QThreadPool::globalInstance()->start([&task, &done, i]() {
+            task(i);
+            done.release();
+        });
+    }
+
+    task(0);
+    done.acquire(count - 1);
+}
+
+KeyColumn extract(const QVector<CachedRow> &rows, const QSqlRecord &schema, const CachedSqlSortColumn &column, const QVector<int> &bounds)
+{
+    const int n = rows.count();
+    const int chunks = bounds.count() - 1;
+
+    KeyColumn key;
+    key.kind = kindOf(schema.field(column.column).metaType().id());
+    key.descending = column.order == Qt::DescendingOrder;
+    key.nulls.assign(n, 0);
+
+    switch (key.kind) {
+        case IntKey: key.ints.resize(n); break;
+        case DoubleKey: key.doubles.resize(n); break;
+        case StringKey: key.strings.resize(n); break;
+        case VariantKey: key.variants.resize(n); break;
+    }
+
+    //Edited values may not match the column type, fall back to variant comparison if any fails to convert
+    QAtomicInt mismatch(0);
+
+    parallelFor(chunks, [&](int chunk) {
+        QCollator collator;
+
+        for (int i = bounds[chunk]; i < bounds[chunk + 1]; ++i) {
+            const QVariant v = rows.at(i).value(column.column);
+
+            if (v.isNull()) {
+                key.nulls[i] = 1;
+                continue;
+            }
+
+            bool ok = true;
+
+            switch (key.kind) {
+                case IntKey: key.ints[i] = v.toLongLong(&ok); break;
+                case DoubleKey: key.doubles[i] = v.toDouble(&ok); break;
+                case StringKey: key.strings[i] = collator.sortKey(v.toString()); break;
+                case VariantKey: key.variants[i] = v; break;
+            }
+
+            if (!ok)
+                mismatch.storeRelaxed(1);
+        }
+    });
+
+    if (mismatch.loadRelaxed()) {
+        key.kind = VariantKey;
+        key.ints.clear();
+        key.doubles.clear();
+        key.strings.clear();
+        key.variants.resize(n);
+
+        parallelFor(chunks, [&](int chunk) {
+            for (int i = bounds[chunk]; i < bounds[chunk + 1]; ++i)
+                key.variants[i] = rows.at(i).value(column.column);
+        });
+    }
+
+    return key;
+}
+
+} // namespace
+
+QVector<int> CachedSqlSorter::sort(const QVector<CachedRow> &rows, const QSqlRecord &schema, const QList<CachedSqlSortColumn> &columns)
+{
+    const int n = rows.count();
+
+    QVector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+
+    if (n < 2 || columns.isEmpty())
+        return order;
+
+    //Split the rows into one contiguous range per task
+    const int chunks = qBound(1, n / ParallelThreshold, qMax(1, QThread::idealThreadCount()));
+    QVector<int> bounds(chunks + 1);
+
+    for (int i = 0; i <= chunks; ++i)
+        bounds[i] = int(qint64(n) * i / chunks);
+
+    //Pre-extract every key column once so comparisons never dispatch on QVariant types unless they have to
+    std::vector<KeyColumn> keys;
+    keys.reserve(columns.count());
+
+    for (const CachedSqlSortColumn &column : columns)
+        keys.push_back(extract(rows, schema, column, bounds));
+
+    const auto lessThan = [&keys](int a, int b) {
+        for (const KeyColumn &key : keys) {
+            const int cmp = key.compare(a, b);
+
+            if (cmp != 0)
+                return key.descending ? cmp > 0 : cmp < 0;
+        }
+
+        return false;
+    };
+
+    //Stable sort each range, then merge neighbouring runs pairwise until one run is left
+    int *data = order.data();
+
+    parallelFor(chunks, [&](int chunk) {
+        std::stable_sort(data + bounds[chunk], data + bounds[chunk + 1], lessThan);
+    });
+
+    for (int width = 1; width < chunks; width *= 2) {
+        const int pairs = (chunks + 2 * width - 1) / (2 * width);
+
+        parallelFor(pairs, [&](int pair) {
+            const int lo = pair * 2 * width;
+            const int mid = lo + width;
+            const int hi = qMin(lo + 2 * width, chunks);
+
+            if (mid < hi)
+                std::inplace_merge(data + bounds[lo], data + bounds[mid], data + bounds[hi], lessThan);
+        });
+    }
+
+    return order;
+}
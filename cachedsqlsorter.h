@@ -0,0 +1,24 @@
+#ifndef CACHEDSQLSORTER_H
+#define CACHEDSQLSORTER_H
+
+#include "cachedrow.h"
+
+#include <QList>
+#include <QSqlRecord>
+#include <QVector>
+
+struct CachedSqlSortColumn
+{
+    int column;
+    Qt::SortOrder order;
+};
+
+//Computes a stable row order over the cache from type specialized key columns, sorting in parallel for large caches
+class CachedSqlSorter
+{
+public:
+    //Returns the permutation new row -> old row
+    static QVector<int> sort(const QVector<CachedRow> &rows, const QSqlRecord &schema, const QList<CachedSqlSortColumn> &columns);
+};
+
+#endif // CACHEDSQLSORTER_H
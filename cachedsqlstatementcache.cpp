@@ -0,0 +1,78 @@
+#include "cachedsqlstatementcache.h"
+
+CachedSqlStatementCache::CachedSqlStatementCache(int capacity)
+    : m_queries(capacity)
+    , m_hits(0)
+    , m_misses(0)
+{
+}
+
+QSqlQuery *CachedSqlStatementCache::object(const QByteArray &key)
+{
+    //Looking a query up also marks it as most recently used
+    QSqlQuery *query = m_queries.object(key);
+
+    if (query)
+        ++m_hits;
+    else
+        ++m_misses;
+
+    return query;
+}
+
+QSqlQuery *CachedSqlStatementCache::insert(const QByteArray &key, QSqlQuery *query)
+{
+    //The cache takes ownership, the least recently used statement is finalized once capacity is exceeded
+    if (!m_queries.insert(key, query))
+        return nullptr;
+
+    return query;
+}
+
+void CachedSqlStatementCache::clear()
+{
+    m_queries.clear();
+}
+
+void CachedSqlStatementCache::setCapacity(int capacity)
+{
+    if (capacity > 0)
+        m_queries.setMaxCost(capacity);
+}
+
+int CachedSqlStatementCache::capacity() const
+{
+    return int(m_queries.maxCost());
+}
+
+quint64 CachedSqlStatementCache::hits() const
+{
+    return m_hits;
+}
+
+quint64 CachedSqlStatementCache::misses() const
+{
+    return m_misses;
+}
+
+QByteArray CachedSqlStatementCache::key(CachedRow::Op op, const QString &table, const QSqlRecord &rec, const QSqlRecord &whereValues, int rows)
+{
+    //Operation, table and row count, followed by the generated value columns and the where columns with their NULL state.
+    //Columns are named rather than numbered, the same position may hold another column once the record changes
+    QByteArray k = QByteArray::number(int(op)) + ':' + table.toUtf8() + ':' + QByteArray::number(rows) + ':';
+    k.reserve(k.size() + (rec.count() + whereValues.count()) * 16);
+
+    for (int i = 0; i < rec.count(); ++i) {
+        if (rec.isGenerated(i))
+            k.append(',').append(rec.fieldName(i).toUtf8());
+    }
+
+    for (int i = 0; i < whereValues.count(); ++i) {
+        if (!whereValues.isGenerated(i))
+            continue;
+
+        k.append(':').append(whereValues.fieldName(i).toUtf8()).append(whereValues.isNull(i) ? 'n' : 'v');
+    }
+
+    return k;
+}
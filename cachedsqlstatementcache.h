@@ -0,0 +1,35 @@
+#ifndef CACHEDSQLSTATEMENTCACHE_H
+#define CACHEDSQLSTATEMENTCACHE_H
+
+#include "cachedrow.h"
+
+#include <QByteArray>
+#include <QCache>
+#include <QSqlQuery>
+#include <QSqlRecord>
+
+//Least recently used cache of prepared edit statements, keyed by the shape of the statement rather than its SQL text
+class CachedSqlStatementCache
+{
+public:
+    explicit CachedSqlStatementCache(int capacity = 32);
+
+    QSqlQuery *object(const QByteArray &key);
+    QSqlQuery *insert(const QByteArray &key, QSqlQuery *query);
+    void clear();
+
+    void setCapacity(int capacity);
+    int capacity() const;
+
+    quint64 hits() const;
+    quint64 misses() const;
+
+    static QByteArray key(CachedRow::Op op, const QString &table, const QSqlRecord &rec, const QSqlRecord &whereValues, int rows = 1);
+
+private:
+    QCache<QByteArray, QSqlQuery> m_queries;
+    quint64 m_hits;
+    quint64 m_misses;
+};
+
+#endif // CACHEDSQLSTATEMENTCACHE_H
@@ -0,0 +1,110 @@
+#include "cachedsqlstats.h"
+
+#include <QtAlgorithms>
+
+Q_LOGGING_CATEGORY(lcCachedSqlStats, "cachedsql.stats")
+
+void CachedSqlHistogram::add(qint64 nsecs)
+{
+    const quint64 usecs = quint64(qMax<qint64>(0, nsecs) / 1000);
+
+    //Index of the highest set bit, durations below 2us land in bucket 0
+    const int index = qMin(BucketCount - 1, 63 - int(qCountLeadingZeroBits(usecs | 1)));
+
+    ++m_buckets[index];
+    ++m_count;
+    m_totalNsecs += nsecs;
+    m_maxNsecs = qMax(m_maxNsecs, nsecs);
+}
+
+quint64 CachedSqlHistogram::count() const
+{
+    return m_count;
+}
+
+qint64 CachedSqlHistogram::totalNsecs() const
+{
+    return m_totalNsecs;
+}
+
+qint64 CachedSqlHistogram::maxNsecs() const
+{
+    return m_maxNsecs;
+}
+
+double CachedSqlHistogram::meanNsecs() const
+{
+    return m_count > 0 ? double(m_totalNsecs) / m_count : 0.0;
+}
+
+quint64 CachedSqlHistogram::bucket(int i) const
+{
+    return i >= 0 && i < BucketCount ? m_buckets[i] : 0;
+}
+
+qint64 CachedSqlHistogram::percentileNsecs(double percentile) const
+{
+    if (m_count == 0)
+        return 0;
+
+    const quint64 rank = quint64(qBound(0.0, percentile, 1.0) * (m_count - 1)) + 1;
+    quint64 seen = 0;
+
+    for (int i = 0; i < BucketCount - 1; ++i) {
+        seen += m_buckets[i];
+
+        if (seen >= rank)
+            return qMin(m_maxNsecs, (qint64(2) << i) * 1000);
+    }
+
+    return m_maxNsecs;
+}
+
+QDebug operator<<(QDebug debug, const CachedSqlHistogram &histogram)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "count=" << histogram.count()
+                    << " mean=" << qint64(histogram.meanNsecs()) / 1000 << "us"
+                    << " p50=" << histogram.percentileNsecs(0.5) / 1000 << "us"
+                    << " p99=" << histogram.percentileNsecs(0.99) / 1000 << "us"
+                    << " max=" << histogram.maxNsecs() / 1000 << "us";
+    return debug;
+}
+
+QDebug operator<<(QDebug debug, const CachedSqlStats &stats)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "CachedSqlStats("
+                    << "fetch batches=" << stats.fetchBatches << " rows=" << stats.fetchedRows << " bytes=" << stats.fetchedBytes
+                    << "; fetch " << stats.fetchTime
+                    << "; sort " << stats.sortTime
+                    << "; submit " << stats.submitTime
+                    << "; insert " << stats.insertTime
+                    << "; update " << stats.updateTime
+                    << "; delete " << stats.deleteTime
+                    << "; prepare " << stats.prepareTime
+                    << "; exec " << stats.execTime
+                    << "; cache rows=" << stats.cachedRows << " resident=" << stats.residentRows << " bytes=" << stats.cacheBytes
+                    << ')';
+    return debug;
+}
+
+CachedSqlScopedTimer::CachedSqlScopedTimer(CachedSqlHistogram *histogram, const char *operation)
+    : m_histogram(histogram)
+    , m_operation(operation)
+{
+    if (m_histogram)
+        m_timer.start();
+}
+
+CachedSqlScopedTimer::~CachedSqlScopedTimer()
+{
+    if (!m_histogram)
+        return;
+
+    const qint64 nsecs = m_timer.nsecsElapsed();
+    m_histogram->add(nsecs);
+
+    if (m_operation)
+        qCDebug(lcCachedSqlStats, "%s took %lld us", m_operation, static_cast<long long>(nsecs / 1000));
+}
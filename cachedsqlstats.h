@@ -0,0 +1,76 @@
+#ifndef CACHEDSQLSTATS_H
+#define CACHEDSQLSTATS_H
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QLoggingCategory>
+
+#include <array>
+
+Q_DECLARE_LOGGING_CATEGORY(lcCachedSqlStats)
+
+//Duration histogram with power of two microsecond buckets
+class CachedSqlHistogram
+{
+public:
+    //Bucket i counts durations in [2^i, 2^(i+1)) microseconds, bucket 0 everything below 2us and the last bucket everything above
+    static const int BucketCount = 24;
+
+    void add(qint64 nsecs);
+
+    quint64 count() const;
+    qint64 totalNsecs() const;
+    qint64 maxNsecs() const;
+    double meanNsecs() const;
+
+    quint64 bucket(int i) const;
+    qint64 percentileNsecs(double percentile) const;   //Upper bound of the bucket holding the percentile
+
+private:
+    std::array<quint64, BucketCount> m_buckets {};
+    quint64 m_count = 0;
+    qint64 m_totalNsecs = 0;
+    qint64 m_maxNsecs = 0;
+};
+
+//Snapshot of the model's counters, see CachedSqlTableModel::stats()
+struct CachedSqlStats
+{
+    quint64 fetchBatches = 0;
+    quint64 fetchedRows = 0;
+    quint64 fetchedBytes = 0;   //Estimated size of the decoded values
+
+    CachedSqlHistogram fetchTime;    //Per batch, on the model's thread
+    CachedSqlHistogram sortTime;
+    CachedSqlHistogram submitTime;   //Whole submitAll() transactions
+    CachedSqlHistogram insertTime;   //Per submitted batch of each operation
+    CachedSqlHistogram updateTime;
+    CachedSqlHistogram deleteTime;
+    CachedSqlHistogram prepareTime;  //Statement preparation on the edit path
+    CachedSqlHistogram execTime;     //Statement execution on the edit path
+
+    int cachedRows = 0;
+    int residentRows = 0;
+    qint64 cacheBytes = 0;   //Estimated memory held by the cache when the snapshot was taken
+};
+
+QDebug operator<<(QDebug debug, const CachedSqlHistogram &histogram);
+QDebug operator<<(QDebug debug, const CachedSqlStats &stats);
+
+//Adds the lifetime of a scope to a histogram and logs it to lcCachedSqlStats, does nothing when given no histogram
+class CachedSqlScopedTimer
+{
+public:
+    explicit CachedSqlScopedTimer(CachedSqlHistogram *histogram, const char *operation = nullptr);
+    ~CachedSqlScopedTimer();
+
+    CachedSqlScopedTimer(const CachedSqlScopedTimer &) = delete;
+    CachedSqlScopedTimer &operator=(const CachedSqlScopedTimer &) = delete;
+
+private:
+    CachedSqlHistogram *m_histogram;
+    const char *m_operation;
+    QElapsedTimer m_timer;
+};
+
+#endif // CACHEDSQLSTATS_H
@@ -0,0 +1,228 @@
+#include "cachedsqlsubmitter.h"
+#include "cachedsqlstatementcache.h"
+#include "cachedsqlstats.h"
+#include "cachedsqltablemodel.h"
+
+#include <QSqlDriver>
+#include <QSqlQuery>
+
+CachedSqlSubmitter::CachedSqlSubmitter(const QSqlDatabase &db, const QString &tableName, const QString &autoColumn, CachedSqlStatementCache &statements)
+    : m_db(db)
+    , m_tableName(tableName)
+    , m_autoColumn(autoColumn)
+    , m_statements(statements)
+    , m_canceled(nullptr)
+    , m_prepareTime(nullptr)
+    , m_execTime(nullptr)
+{
+}
+
+void CachedSqlSubmitter::setCancelFlag(const QAtomicInt *canceled)
+{
+    m_canceled = canceled;
+}
+
+void CachedSqlSubmitter::setHistograms(CachedSqlHistogram *prepareTime, CachedSqlHistogram *execTime)
+{
+    m_prepareTime = prepareTime;
+    m_execTime = execTime;
+}
+
+void CachedSqlSubmitter::setProgressHandler(const std::function<void(int)> &handler)
+{
+    m_progress = handler;
+}
+
+bool CachedSqlSubmitter::submit(const CachedSqlSubmitBatch &batch, QVariantList &insertIds)
+{
+    QSqlDriver *driver = m_db.driver();
+    const QSqlRecord &rec = batch.records.constFirst();
+    const QSqlRecord &whereValues = batch.whereValues.constFirst();
+    const int count = batch.rows.count();
+
+    m_error = QSqlError();
+
+    //Without prepared statements every row is sent as its own statement with inlined values
+    if (!driver->hasFeature(QSqlDriver::PreparedQueries)) {
+        QSqlQuery query(m_db);
+
+        for (int i = 0; i < count; ++i) {
+            if (canceled())
+                return false;
+
+            const QString stmt = CachedSqlTableModel::editStatement(driver, m_tableName, batch.op, batch.records.at(i), batch.whereValues.at(i), false);
+
+            if (stmt.isEmpty()) {
+                m_error = QSqlError(batch.op == CachedRow::Delete ? "Unable to delete row" : "No Fields to update", QString(), QSqlError::StatementError);
+                return false;
+            }
+
+            CachedSqlScopedTimer statsTimer(m_execTime);
+
+            if (!query.exec(stmt)) {
+                m_error = query.lastError();
+                return false;
+            }
+
+            insertIds.append(batch.op == CachedRow::Insert ? query.lastInsertId() : QVariant());
+            reportProgress(1);
+        }
+
+        return true;
+    }
+
+    //Inserts into tables with an auto increment column need each generated id, execute row by row on the same prepared statement
+    if (batch.op == CachedRow::Insert && !m_autoColumn.isEmpty()) {
+        QSqlQuery *query = statement(batch.op, rec, QSqlRecord());
+
+        if (!query)
+            return false;
+
+        for (int i = 0; i < count; ++i) {
+            if (canceled() || !execPrepared(*query, CachedSqlTableModel::bindValues(batch.records.at(i), QSqlRecord())))
+                return false;
+
+            insertIds.append(query->lastInsertId());
+            reportProgress(1);
+        }
+
+        return true;
+    }
+
+    //Single column keys are deleted with IN lists, drivers without native array binds get multi-row inserts
+    const bool deleteIn = batch.op == CachedRow::Delete && count > 1 && whereValues.count() == 1 && whereValues.isGenerated(0) && !whereValues.isNull(0);
+    const bool multiRowInsert = batch.op == CachedRow::Insert && count > 1 && !driver->hasFeature(QSqlDriver::BatchOperations);
+
+    if (deleteIn || multiRowInsert) {
+        //Chunk to stay below driver bind limits, full chunks share one cached statement and only the last one is shorter
+        const int perRow = qMax(1, int(CachedSqlTableModel::bindValues(rec, whereValues).count()));
+        const int rowsPerChunk = qMax(1, CachedSqlTableModel::MaxBatchBindValues / perRow);
+
+        for (int start = 0; start < count; start += rowsPerChunk) {
+            if (canceled())
+                return false;
+
+            const int chunk = qMin(rowsPerChunk, count - start);
+            QSqlQuery *query = statement(batch.op, rec, whereValues, chunk);
+
+            if (!query)
+                return false;
+
+            QVariantList values;
+            values.reserve(chunk * perRow);
+
+            for (int i = start; i < start + chunk; ++i)
+                values += CachedSqlTableModel::bindValues(batch.records.at(i), batch.whereValues.at(i));
+
+            if (!execPrepared(*query, values))
+                return false;
+
+            reportProgress(chunk);
+        }
+    }
+    //Everything else goes through execBatch, natively with array binds or emulated by Qt on the single prepared statement
+    else {
+        if (canceled())
+            return false;
+
+        QSqlQuery *query = statement(batch.op, rec, whereValues);
+
+        if (!query)
+            return false;
+
+        QVector<QVariantList> columns;
+
+        for (int i = 0; i < count; ++i) {
+            const QVariantList values = CachedSqlTableModel::bindValues(batch.records.at(i), batch.whereValues.at(i));
+
+            if (columns.isEmpty())
+                columns.resize(values.count());
+
+            for (int j = 0; j < values.count(); ++j)
+                columns[j].append(values.at(j));
+        }
+
+        for (int j = 0; j < columns.count(); ++j)
+            query->bindValue(j, columns.at(j));
+
+        CachedSqlScopedTimer statsTimer(m_execTime);
+
+        if (!query->execBatch()) {
+            m_error = query->lastError();
+            return false;
+        }
+
+        reportProgress(count);
+    }
+
+    //Batched statements report no generated ids, callers still get one entry per row
+    for (int i = 0; i < count; ++i)
+        insertIds.append(QVariant());
+
+    return true;
+}
+
+QSqlError CachedSqlSubmitter::lastError() const
+{
+    return m_error;
+}
+
+QSqlQuery *CachedSqlSubmitter::statement(CachedRow::Op op, const QSqlRecord &rec, const QSqlRecord &whereValues, int rows)
+{
+    const QByteArray key = CachedSqlStatementCache::key(op, m_tableName, rec, whereValues, rows);
+
+    if (QSqlQuery *query = m_statements.object(key))
+        return query;
+
+    //Only build and prepare the SQL on a cache miss
+    QSqlDriver *driver = m_db.driver();
+    const QString stmt = rows > 1 ? CachedSqlTableModel::batchStatement(driver, m_tableName, op, rec, whereValues, rows)
+                                  : CachedSqlTableModel::editStatement(driver, m_tableName, op, rec, whereValues, true);
+
+    if (stmt.isEmpty()) {
+        m_error = QSqlError(op == CachedRow::Delete ? "Unable to delete row" : "No Fields to update", QString(), QSqlError::StatementError);
+        return nullptr;
+    }
+
+    QSqlQuery *query = new QSqlQuery(m_db);
+    bool prepared;
+    {
+        CachedSqlScopedTimer statsTimer(m_prepareTime);
+        prepared = query->prepare(stmt);
+    }
+
+    if (!prepared) {
+        m_error = query->lastError();
+        delete query;
+        return nullptr;
+    }
+
+    return m_statements.insert(key, query);
+}
+
+bool CachedSqlSubmitter::execPrepared(QSqlQuery &query, const QVariantList &values)
+{
+    //Bind by position so values left over from the previous execution are overwritten
+    for (int i = 0; i < values.count(); ++i)
+        query.bindValue(i, values.at(i));
+
+    CachedSqlScopedTimer statsTimer(m_execTime);
+
+    if (!query.exec()) {
+        m_error = query.lastError();
+        return false;
+    }
+
+    return true;
+}
+
+bool CachedSqlSubmitter::canceled() const
+{
+    return m_canceled && m_canceled->loadRelaxed();
+}
+
+void CachedSqlSubmitter::reportProgress(int rows)
+{
+    if (m_progress)
+        m_progress(rows);
+}
@@ -0,0 +1,61 @@
+#ifndef CACHEDSQLSUBMITTER_H
+#define CACHEDSQLSUBMITTER_H
+
+#include "cachedrow.h"
+
+#include <QAtomicInt>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlRecord>
+#include <QVector>
+
+#include <functional>
+
+class CachedSqlHistogram;
+class CachedSqlStatementCache;
+class QSqlQuery;
+
+//Rows of one operation that produce the same statement, submitted together
+struct CachedSqlSubmitBatch
+{
+    CachedRow::Op op;
+    QVector<int> rows;
+    QVector<QSqlRecord> records;
+    QVector<QSqlRecord> whereValues;
+};
+
+//Sends submit batches over one connection in as few statements as the driver allows. submitAll() runs it on the model's connection and
+//statement cache, the submit worker on its own clone of the connection. Transactions are left to the caller
+class CachedSqlSubmitter
+{
+public:
+    CachedSqlSubmitter(const QSqlDatabase &db, const QString &tableName, const QString &autoColumn, CachedSqlStatementCache &statements);
+
+    //A set flag stops at the next statement, submit() then returns false without an error
+    void setCancelFlag(const QAtomicInt *canceled);
+    void setHistograms(CachedSqlHistogram *prepareTime, CachedSqlHistogram *execTime);
+    void setProgressHandler(const std::function<void(int rows)> &handler);   //Called with the rows each statement has sent
+
+    //Appends one entry per row to insertIds, the generated id of inserts sent row by row and an invalid QVariant otherwise
+    bool submit(const CachedSqlSubmitBatch &batch, QVariantList &insertIds);
+
+    QSqlError lastError() const;
+
+private:
+    QSqlQuery *statement(CachedRow::Op op, const QSqlRecord &rec, const QSqlRecord &whereValues, int rows = 1);
+    bool execPrepared(QSqlQuery &query, const QVariantList &values);
+    bool canceled() const;
+    void reportProgress(int rows);
+
+    QSqlDatabase m_db;
+    QString m_tableName;
+    QString m_autoColumn;   //Inserts into tables with an auto increment column are sent row by row to read back each generated id
+    CachedSqlStatementCache &m_statements;
+    const QAtomicInt *m_canceled;
+    CachedSqlHistogram *m_prepareTime;
+    CachedSqlHistogram *m_execTime;
+    std::function<void(int)> m_progress;
+    QSqlError m_error;
+};
+
+#endif // CACHEDSQLSUBMITTER_H
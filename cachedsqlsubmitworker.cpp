@@ -0,0 +1,96 @@
+#include "cachedsqlsubmitworker.h"
+#include "cachedsqlstatementcache.h"
+
+//Rows between two progress reports
+static const int ProgressInterval = 64;
+
+CachedSqlSubmitWorker::CachedSqlSubmitWorker(const QString &connectionName, const QString &tableName, const QString &autoColumn, QObject *parent)
+    : QObject(parent)
+    , m_connectionName(connectionName)
+    , m_workerConnectionName(QStringLiteral("CachedSqlSubmitWorker_%1").arg(quintptr(this)))
+    , m_tableName(tableName)
+    , m_autoColumn(autoColumn)
+    , m_canceled(0)
+    , m_done(0)
+    , m_total(0)
+{
+}
+
+void CachedSqlSubmitWorker::cancel()
+{
+    m_canceled.storeRelaxed(1);
+}
+
+void CachedSqlSubmitWorker::submit(const QVector<CachedSqlSubmitBatch> &batches)
+{
+    QVariantList insertIds;
+    QSqlError error;
+    bool committed = false;
+
+    {
+        //Connections are bound to the thread that created them, clone the model's connection on this thread
+        QSqlDatabase db = QSqlDatabase::cloneDatabase(m_connectionName, m_workerConnectionName);
+
+        //Begin a transaction - the upload either fully succeeds or fails
+        if (!db.open() || !db.transaction()) {
+            error = db.lastError();
+        } else if (!submitBatches(db, batches, insertIds, error)) {
+            db.rollback();
+        } else if (m_canceled.loadRelaxed()) {
+            //A cancel that arrives after the last statement still wins as long as nothing has been committed
+            db.rollback();
+        } else if (!db.commit()) {
+            error = db.lastError();
+            db.rollback();
+        } else {
+            committed = true;
+        }
+
+        db.close();
+    }
+
+    QSqlDatabase::removeDatabase(m_workerConnectionName);
+
+    //A rollback without an error means the submit was canceled
+    if (committed)
+        emit finished(insertIds);
+    else if (error.isValid())
+        emit errorOccurred(error);
+    else
+        emit canceled();
+}
+
+bool CachedSqlSubmitWorker::submitBatches(QSqlDatabase &db, const QVector<CachedSqlSubmitBatch> &batches, QVariantList &insertIds, QSqlError &error)
+{
+    int total = 0;
+    for (const CachedSqlSubmitBatch &batch : batches)
+        total += batch.rows.count();
+
+    m_done = 0;
+    m_total = total;
+
+    //Statements are prepared on this connection, they are finalized with the cache before the connection closes
+    CachedSqlStatementCache statements;
+    CachedSqlSubmitter submitter(db, m_tableName, m_autoColumn, statements);
+    submitter.setCancelFlag(&m_canceled);
+    submitter.setProgressHandler([this](int rows) { reportProgress(rows); });
+
+    for (const CachedSqlSubmitBatch &batch : batches) {
+        if (!submitter.submit(batch, insertIds)) {
+            error = submitter.lastError();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void CachedSqlSubmitWorker::reportProgress(int rows)
+{
+    //Report every ProgressInterval rows, batched statements can cross several intervals at once
+    const int before = m_done / ProgressInterval;
+    m_done += rows;
+
+    if (m_done / ProgressInterval != before || m_done == m_total)
+        emit progress(m_done, m_total);
+}
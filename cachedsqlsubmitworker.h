@@ -0,0 +1,45 @@
+#ifndef CACHEDSQLSUBMITWORKER_H
+#define CACHEDSQLSUBMITWORKER_H
+
+#include "cachedsqlsubmitter.h"
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QVector>
+
+//Runs a whole submit transaction on its own database connection. Lives on a worker thread
+class CachedSqlSubmitWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    CachedSqlSubmitWorker(const QString &connectionName, const QString &tableName, const QString &autoColumn, QObject *parent = nullptr);
+
+    //Thread-safe, rolls the transaction back at the next statement or before the commit
+    void cancel();
+
+public slots:
+    void submit(const QVector<CachedSqlSubmitBatch> &batches);
+
+signals:
+    void progress(int done, int total);
+    void finished(const QVariantList &insertIds);   //One entry per submitted row, in batch order
+    void canceled();
+    void errorOccurred(const QSqlError &error);
+
+private:
+    bool submitBatches(QSqlDatabase &db, const QVector<CachedSqlSubmitBatch> &batches, QVariantList &insertIds, QSqlError &error);
+    void reportProgress(int rows);
+
+    QString m_connectionName;
+    QString m_workerConnectionName;
+    QString m_tableName;
+    QString m_autoColumn;
+    QAtomicInt m_canceled;
+    int m_done;
+    int m_total;
+};
+
+#endif // CACHEDSQLSUBMITWORKER_H
@@ -1,19 +1,116 @@
 #include "cachedsqltablemodel.h"
+#include "cachedsqlaggregate.h"
+#include "cachedsqlexportworker.h"
+#include "cachedsqlfetchworker.h"
+#include "cachedsqlfilter.h"
+#include "cachedsqlimportworker.h"
+#include "cachedsqlrefreshworker.h"
+#include "cachedsqlsearchindex.h"
+#include "cachedsqlsnapshot.h"
+#include "cachedsqlsorter.h"
+#include "cachedsqlstatementcache.h"
+#include "cachedsqlstats.h"
+#include "cachedsqlsubmitworker.h"
 
 #include <algorithm>
-
+#include <limits>
+#include <numeric>
+#include <utility>
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QIODevice>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QSqlDriver>
 #include <QSqlError>
 #include <QSqlField>
 #include <QSqlQuery>
 #include <QSqlRecord>
+#include <QStringList>
+#include <QThread>
 
 using CachedSql = CachedSqlTableModelSql;
 
+//Bytes read from an import device at a time, and chunks handed to the import worker but not parsed yet
+static const qint64 ImportChunkSize = 1024 * 1024;
+static const int MaxImportChunks = 2;
+
+//Cache rows copied into one export chunk, and chunks handed to the export worker but not written yet
+static const int ExportChunkRows = 4096;
+static const int MaxExportChunks = 4;
+
+//Longest a fetch queued by data() drains the result before the event loop gets a turn, and the batches one worker request may cover
+static const qint64 MaxDrainNsecs = 16 * 1000 * 1000;
+static const int MaxDrainBatches = 8;
+
+//Cached rows live updates probe by key on every commit, larger caches are probed once per probe interval
+static const int LiveProbeRows = 10000;
+
+//Rough memory held by a resident row, variant storage plus the payload of string and byte array values
+static qint64 estimatedRowBytes(const CachedRowValues &values)
+{
+    qint64 bytes = qint64(sizeof(CachedRow)) + values.count() * qint64(sizeof(QVariant));
+
+    for (const QVariant &v : values) {
+        switch (v.typeId()) {
+            case QMetaType::QString:
+                bytes += v.toString().size() * qint64(sizeof(QChar));
+                break;
+            case QMetaType::QByteArray:
+                bytes += v.toByteArray().size();
+                break;
+            default:
+                break;
+        }
+    }
+
+    return bytes;
+}
+
+//Count the rows of a select statement, -1 if the count failed
+static qint64 countRows(const QSqlDatabase &db, const QString &select, const QString &count, bool estimate)
+{
+    qint64 rows = -1;
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+
+    //PostgreSQL reports the planner's estimate without scanning the table
+    if (estimate && db.driverName() == QLatin1String("QPSQL")
+        && query.exec(QStringLiteral("EXPLAIN (FORMAT JSON) ") + select) && query.next()) {
+        const QJsonArray plans = QJsonDocument::fromJson(query.value(0).toByteArray()).array();
+        rows = plans.at(0).toObject().value(QLatin1String("Plan")).toObject().value(QLatin1String("Plan Rows")).toInteger(-1);
+    }
+
+    if (rows < 0 && query.exec(count) && query.next())
+        rows = query.value(0).toLongLong();
+
+    return rows;
+}
+
+//Count the rows of a select statement on a connection cloned for the calling thread, -1 if the count failed
+static qint64 countRows(const QString &connectionName, const QString &select, const QString &count, bool estimate)
+{
+    const QString name = QStringLiteral("CachedSqlRowCount_%1").arg(quintptr(QThread::currentThreadId()));
+    qint64 rows = -1;
+
+    {
+        QSqlDatabase db = QSqlDatabase::cloneDatabase(connectionName, name);
+
+        if (db.open()) {
+            rows = countRows(db, select, count, estimate);
+            db.close();
+        }
+    }
+
+    QSqlDatabase::removeDatabase(name);
+    return rows;
+}
+
 CachedSqlTableModel::CachedSqlTableModel(QObject *parent, const QSqlDatabase &db)
     : QAbstractTableModel(parent)
     , m_db(db.isValid() ? db : QSqlDatabase::database())
-    , m_editQuery(m_db)
     , m_filter()
     , m_autoColumn()
     , m_select()
@@ -22,12 +119,126 @@ CachedSqlTableModel::CachedSqlTableModel(QObject *parent, const QSqlDatabase &db
     , m_fetchBatchSize(100)
     , m_selectQuery(m_db)
     , m_queryExhausted(false)
+    , m_adaptiveFetch(false)
+    , m_minFetchBatchSize(25)
+    , m_maxFetchBatchSize(10000)
+    , m_fetchTargetDuration(8)
+    , m_fetchMode(FetchOnDemand)
+    , m_fetchThread(nullptr)
+    , m_fetchWorker(nullptr)
+    , m_fetchGeneration(0)
+    , m_fetchPending(false)
+    , m_statements()
+    , m_keyIndexValid(false)
+    , m_duplicateKeys(false)
+    , m_sortMode(AutoSort)
+    , m_sortFields()
+    , m_floatingRows(0)
+    , m_filterMode(AutoFilter)
+    , m_clientFilter(false)
+    , m_nextAggregateId(0)
+    , m_cacheBudget(0)
+    , m_cacheBudgetUnit(RowBudget)
+    , m_evictedCount(0)
+    , m_rowBytes(0)
+    , m_lastAccessedRow(0)
+    , m_budgetQueued(false)
+    , m_rowCountMode(FetchedRowCount)
+    , m_totalRowCount(-1)
+    , m_unfetchedRows(0)
+    , m_countGeneration(0)
+    , m_fetchUntilRow(-1)
+    , m_liveUpdates(false)
+    , m_liveSubscribed(false)
+    , m_dataVersion(-1)
+    , m_liveRowid(-1)
+    , m_liveRefreshAll(false)
+    , m_liveDelta(false)
+    , m_liveProbeInterval(30000)
+    , m_statsEnabled(false)
+    , m_refreshThread(nullptr)
+    , m_refreshWorker(nullptr)
+    , m_refreshGeneration(0)
+    , m_submitThread(nullptr)
+    , m_submitWorker(nullptr)
+    , m_submitGeneration(0)
+    , m_importThread(nullptr)
+    , m_importWorker(nullptr)
+    , m_importGeneration(0)
+    , m_importedCount(0)
+    , m_importDevice(nullptr)
+    , m_importPending(0)
+    , m_importInputDone(false)
+    , m_importFinishing(false)
+    , m_exportThread(nullptr)
+    , m_exportWorker(nullptr)
+    , m_exportGeneration(0)
+    , m_exportValues(StagedValues)
+    , m_exportDrain(false)
+    , m_exportRow(0)
+    , m_exportEnd(0)
+    , m_exportPending(0)
+    , m_exportedCount(0)
+    , m_exportFinishing(false)
 {
     //Ensure we have a valid database to operate on, notify if not
     if (!m_db.isOpen()) {
         m_error = QSqlError("Database not open", QString(), QSqlError::ConnectionError);
         emit errorOccurred(m_error);
     }
+
+    m_livePollTimer.setInterval(1000);
+    m_liveDelayTimer.setInterval(100);
+    m_liveDelayTimer.setSingleShot(true);
+
+    connect(&m_livePollTimer, &QTimer::timeout, this, &CachedSqlTableModel::pollLiveUpdates);
+    connect(&m_liveDelayTimer, &QTimer::timeout, this, &CachedSqlTableModel::applyLiveUpdates);
+
+    //A deferred probe of the cached keys runs like another commit would
+    m_liveProbeTimer.setSingleShot(true);
+    connect(&m_liveProbeTimer, &QTimer::timeout, this, [this]() {
+        m_liveDelta = true;
+        applyLiveUpdates();
+    });
+}
+
+CachedSqlTableModel::~CachedSqlTableModel()
+{
+    stopLiveUpdates();
+
+    //Wait for a running fetch worker so its connection is released before the model goes away
+    if (QThread *thread = m_fetchThread) {
+        stopFetchWorker();
+        thread->wait();
+    }
+
+    //A background refresh only reads, but holds a connection of its own
+    if (QThread *thread = m_refreshThread) {
+        stopRefreshWorker();
+        thread->wait();
+    }
+
+        //An unfinished submit is rolled back
+    if (QThread *thread = m_submitThread) {
+        stopSubmitWorker();
+        thread->wait();
+    }
+
+    //An import reads from the model's record, let it finish its block
+    if (QThread *thread = m_importThread) {
+        stopImportWorker();
+        thread->wait();
+    }
+
+    //An unfinished export is discarded
+    if (QThread *thread = m_exportThread) {
+        stopExportWorker();
+        thread->wait();
+    }
+
+    //Count threads post their result back to the model, they must not outlive it
+    for (QThread *thread : std::as_const(m_countThreads))
+        thread->wait();
 }
 
 int CachedSqlTableModel::rowCount(const QModelIndex &parent) const
@@ -36,7 +247,11 @@ int CachedSqlTableModel::rowCount(const QModelIndex &parent) const
     if (parent.isValid())
         return 0;
 
-    return m_cache.count();
+    //A filtered cache shows only its matching rows, the counted tail is hidden
+    if (m_clientFilter)
+        return m_visibleRows.count();
+
+    return m_cache.count() + m_unfetchedRows;
 }
 
 int CachedSqlTableModel::columnCount(const QModelIndex &parent) const
@@ -64,7 +279,7 @@ QVariant CachedSqlTableModel::headerData(int section, Qt::Orientation orientatio
     if (orientation == Qt::Vertical && role == Qt::DisplayRole) {
 
         //Range safeguards
-        if (section < 0 || section >= m_cache.count())
+        if (section < 0 || section >= rowCount())
             return QVariant();
 
         return section + 1;
@@ -79,11 +294,25 @@ QVariant CachedSqlTableModel::data(const QModelIndex &index, int role) const
     if (!index.isValid())
         return QVariant();
 
-    if(index.row() < 0 || index.row() >= m_cache.count() || index.column() < 0 || index.column() >= m_record.count())
+    if(index.row() < 0 || index.row() >= rowCount() || index.column() < 0 || index.column() >= m_record.count())
         return QVariant();
 
-    if(role == Qt::DisplayRole || role == Qt::EditRole)
-        return m_cache[index.row()].value(index.column());
+    if(role == Qt::DisplayRole || role == Qt::EditRole) {
+        const int row = sourceRow(index.row());
+        m_lastAccessedRow = row;
+
+        //Counted rows that have not been fetched yet are materialized once control returns to the event loop
+        if (row >= m_cache.count()) {
+            fetchUntil(row);
+            return QVariant();
+        }
+
+        //Evicted rows are read back from the database together with their neighbours, nothing visible changes
+        if (m_evictedCount > 0 && m_cache.at(row).isEvicted())
+            readBackRows(row);
+
+        return m_cache[row].value(index.column());
+    }
 
     return QVariant();
 }
@@ -94,7 +323,17 @@ bool CachedSqlTableModel::setData(const QModelIndex &index, const QVariant &valu
     if(!index.isValid())
         return false;
 
-    if(index.row() < 0 || index.row() >= m_cache.count() || index.column() < 0 || index.column() >= m_record.count())
+    if(index.row() < 0 || index.row() >= rowCount() || index.column() < 0 || index.column() >= m_record.count())
+        return false;
+
+    //The cache is read only while an asynchronous submit is running
+    if (isSubmitting())
+        return false;
+
+    //Counted rows that have not been fetched yet are fetched before they are edited
+    const int row = sourceRow(index.row());
+
+    if (!fetchThrough(row))
         return false;
 
     if(role == Qt::EditRole){
@@ -106,7 +345,9 @@ bool CachedSqlTableModel::setData(const QModelIndex &index, const QVariant &valu
             return false;
 
         //Update data structure
-        m_cache[index.row()].setValue(index.column(), value); //setValue() updates CachedRow operator to "Update" automatically
+        m_cache[row].setValue(index.column(), value); //setValue() updates CachedRow operator to "Update" automatically
+        m_dirtyRows.insert(row);
+        updateRowIndexes(row);
         emit dataChanged(index, index, {role});
 
         return true;
@@ -118,13 +359,35 @@ bool CachedSqlTableModel::setData(const QModelIndex &index, const QVariant &valu
 bool CachedSqlTableModel::insertRows(int row, int count, const QModelIndex &parent)
 {
     //Range safeguards
-    if(parent.isValid() || row < 0 || row > m_cache.count() || count <= 0)
+    if(parent.isValid() || row < 0 || row > rowCount() || count <= 0 || isSubmitting())
+        return false;
+
+    //Rows inserted among the counted tail go in after the fetched rows before them
+    if (!m_clientFilter && row > m_cache.count() && !fetchThrough(row - 1))
         return false;
 
+    //Under a client filter the rows go in before the cache row shown at the given position
+    const int first = sourceRow(row);
+
     beginInsertRows(QModelIndex(), row, row + count - 1);
 
-    for(int i = 0; i < count; ++i)
-        m_cache.insert(row, CachedRow(CachedRow::Insert, m_record));
+    //One insert moves the rows after the new ones once, not once per new row
+    m_cache.insert(first, count, CachedRow(CachedRow::Insert, CachedRowValues(m_record.count())));
+
+    //Staged inserts are dirty until submitted
+    shiftRows(first, count);
+    for (int i = first; i < first + count; ++i) {
+        m_dirtyRows.insert(i);
+
+        if (m_cacheBudget > 0)
+            m_residentRows.insert(i);
+    }
+
+    //New rows are always shown, the filter applies once they have been submitted
+    if (m_clientFilter) {
+        for (int i = 0; i < count; ++i)
+            m_visibleRows.insert(row + i, first + i);
+    }
 
     endInsertRows();
 
@@ -134,28 +397,50 @@ bool CachedSqlTableModel::insertRows(int row, int count, const QModelIndex &pare
 bool CachedSqlTableModel::removeRows(int row, int count, const QModelIndex &parent)
 {
     //Range safeguards
-    if (parent.isValid() || row < 0 || row + count > m_cache.count() || count <= 0)
+    if (parent.isValid() || row < 0 || row + count > rowCount() || count <= 0 || isSubmitting())
+        return false;
+
+    //Counted rows that have not been fetched yet are fetched before they are staged for delete
+    if (!fetchThrough(sourceRow(row + count - 1)))
+        return false;
+
+    //Under a client filter the shown rows need not be neighbours in the cache
+    QVector<int> rows;
+    rows.reserve(count);
+
+    for (int i = row; i < row + count; ++i)
+        rows.append(sourceRow(i));
+
+    //Deleted rows need their full values for the submit, read back any that were evicted
+    if (m_evictedCount > 0 && !loadRows(rows.constFirst(), rows.constLast()))
         return false;
 
+    //A row still evicted only holds its key columns, it cannot be matched for the delete
+    for (int i : std::as_const(rows)) {
+        if (m_cache.at(i).isEvicted()) {
+            m_error = QSqlError("Unable to delete row", QString(), QSqlError::StatementError);
+            emit errorOccurred(m_error);
+            return false;
+        }
+    }
+
     // Staged deletion - database removal will not occur until after call to submitAll()
-    bool changed = false;
+    QVector<int> stagedRows;
+    QVector<int> discardedRows;
 
-    for (int i = row + count - 1; i >= row; --i) {
+    for (int i : std::as_const(rows)) {
 
         CachedRow &cr = m_cache[i];
         switch (cr.op()) {
             case CachedRow::None:
-                cr.setOp(CachedRow::Delete);
-                changed = true;
-                break;
             case CachedRow::Update:
                 cr.setOp(CachedRow::Delete);
-                changed = true;
+                m_dirtyRows.insert(i);
+                stagedRows.append(i);
                 break;
             case CachedRow::Insert:
-                // brand-new row - should be discarded immedialty
-                m_cache.removeAt(i);
-                changed = true;
+                // brand-new row - should be discarded immediately
+                discardedRows.append(i);
                 break;
             case CachedRow::Delete:
                 // already staged
@@ -163,9 +448,12 @@ bool CachedSqlTableModel::removeRows(int row, int count, const QModelIndex &pare
         }
     }
 
-    //Notify view of any changes
-    if (changed)
-        emit layoutChanged();
+    //Notify view of any changes, staged rows first while their indices are still valid
+    emitRowsChanged(stagedRows);
+    removeCachedRows(discardedRows);
+
+    //Only now that the rows are staged, and so pinned, may other rows be evicted again
+    enforceCacheBudget();
 
     return true;
 }
@@ -173,7 +461,7 @@ bool CachedSqlTableModel::removeRows(int row, int count, const QModelIndex &pare
 Qt::ItemFlags CachedSqlTableModel::flags(const QModelIndex &index) const
 {
     //Range safeguards
-    if(!index.isValid())
+    if(!index.isValid() || isSubmitting())
         return QAbstractTableModel::flags(index);
 
     return QAbstractTableModel::flags(index) | Qt::ItemFlag::ItemIsEditable;
@@ -185,6 +473,14 @@ bool CachedSqlTableModel::canFetchMore(const QModelIndex &parent) const
     if (parent.isValid())
         return false;
 
+    //In background mode there is more to come for as long as the worker has not drained the result set
+    if (m_fetchMode == FetchInBackground)
+        return m_fetchWorker && !m_queryExhausted;
+
+    //In keyset mode no cursor is held between batches, the next batch is a new query
+    if (m_fetchMode == FetchByKeyset)
+        return !m_record.isEmpty() && !m_queryExhausted;
+
     return m_selectQuery.isActive() && !m_queryExhausted;
 }
 
@@ -194,29 +490,46 @@ void CachedSqlTableModel::fetchMore(const QModelIndex &parent)
     if (parent.isValid())
         return;
 
+    //In background mode request the next batch from the worker, rows are appended once it arrives
+    if (m_fetchMode == FetchInBackground) {
+        requestWorkerBatch(m_fetchBatchSize);
+        return;
+    }
+
+    //Time the whole batch, query round trip and view notification alike, to size the next one
+    CachedSqlScopedTimer statsTimer(statsHistogram(m_stats.fetchTime), "fetchMore");
+    QElapsedTimer timer;
+    timer.start();
+
+    if (m_fetchMode == FetchByKeyset) {
+        const int fetched = m_fetchedCount;
+
+        if (!m_queryExhausted && fetchKeysetBatch())
+            adaptFetchBatchSize(timer.nsecsElapsed(), m_fetchedCount - fetched);
+        return;
+    }
+
     //Stage data structure for new additions
-    int count = 0;
-    QVector<CachedRow> newRows;
+    const int columns = m_record.count();
+    QVector<CachedRowValues> newRows;
     newRows.reserve(m_fetchBatchSize);
 
-    //Iterate through the remaining query to populate additional rows
-    while (count < m_fetchBatchSize && m_selectQuery.next()) {
-        newRows.push_back(CachedRow(CachedRow::None, m_selectQuery.record()));
-        ++count;
+    //Iterate through the remaining query to populate additional rows, reading values directly to avoid building a QSqlRecord per row
+    while (newRows.count() < m_fetchBatchSize && m_selectQuery.next()) {
+        CachedRowValues values(columns);
+
+        for (int i = 0; i < columns; ++i)
+            values[i] = m_selectQuery.value(i);
+
+        newRows.push_back(values);
     }
 
-    //Handle query exhaustian with explicit flag
-    if (count == 0) {
-        // No more rows available
+    //Handle query exhaustian with explicit flag, a short batch means no more rows are available
+    if (newRows.count() < m_fetchBatchSize)
         m_queryExhausted = true;
-        return;
-    }
 
-    //If we do have rows to add, append to the cache and notify view
-    beginInsertRows(QModelIndex(), m_fetchedCount, m_fetchedCount + count - 1);
-    m_cache += newRows;
-    m_fetchedCount += count;
-    endInsertRows();
+    appendFetchedRows(newRows);
+    adaptFetchBatchSize(timer.nsecsElapsed(), newRows.count());
 }
 
 void CachedSqlTableModel::setSelectStatement(const QString &select)
@@ -225,6 +538,43 @@ void CachedSqlTableModel::setSelectStatement(const QString &select)
 }
 
 QString CachedSqlTableModel::selectStatement() const
+{
+    const QString stmt = baseSelectStatement();
+
+    if (stmt.isEmpty())
+        return QString();
+
+    //Server side ordering requested through sort()
+    QString order;
+
+    for (const auto &sortField : m_sortFields) {
+        const QString field = m_db.driver()->escapeIdentifier(sortField.first, QSqlDriver::FieldName);
+        order = CachedSql::comma(order, sortField.second == Qt::AscendingOrder ? CachedSql::asc(field) : CachedSql::desc(field));
+    }
+
+    return composeSelect(stmt, effectiveFilter(), order);
+}
+
+QString CachedSqlTableModel::composeSelect(const QString &stmt, const QString &where, const QString &order) const
+{
+    if (where.isEmpty() && order.isEmpty())
+        return stmt;
+
+    //A custom statement may end in a WHERE, ORDER BY or LIMIT of its own, add the clauses around it instead
+    const QString from = m_select.isEmpty() ? stmt : CachedSql::concat(CachedSql::select(QStringLiteral("*")), CachedSql::from(CachedSql::as(CachedSql::paren(stmt), QStringLiteral("cached_select"))));
+
+    return CachedSql::concat(CachedSql::concat(from, CachedSql::where(where)), CachedSql::orderBy(order));
+}
+
+bool CachedSqlTableModel::isComposable() const
+{
+    //Only a query can become a subquery, a stored procedure call runs as given
+    const QString stmt = m_select.trimmed();
+
+    return stmt.isEmpty() || stmt.startsWith(QLatin1String("SELECT"), Qt::CaseInsensitive) || stmt.startsWith(QLatin1String("WITH"), Qt::CaseInsensitive);
+}
+
+QString CachedSqlTableModel::baseSelectStatement() const
 {
     if (m_tableName.isEmpty()) {
         m_error = QSqlError("No table name given", QString(), QSqlError::StatementError);
@@ -232,18 +582,13 @@ QString CachedSqlTableModel::selectStatement() const
         return QString();
     }
 
-    QString stmt;
-
     //If a custom statement exists, use that - i.e. a stored procedure or a subset selection of the table
     if(!m_select.isEmpty())
-        stmt = m_select;
-    else {
-        //Otherwise, load the full table
-        QSqlRecord rec = m_db.record(m_tableName);
-        stmt = m_db.driver()->sqlStatement(QSqlDriver::SelectStatement, m_tableName, rec, false);
-    }
+        return m_select;
 
-    return CachedSql::concat(stmt, CachedSql::where(m_filter));
+    //Otherwise, load the full table
+    QSqlRecord rec = m_db.record(m_tableName);
+    return m_db.driver()->sqlStatement(QSqlDriver::SelectStatement, m_tableName, rec, false);
 }
 
 void CachedSqlTableModel::setTableName(const QString &name)
@@ -275,12 +620,7 @@ QSqlError CachedSqlTableModel::lastError() const
 
 bool CachedSqlTableModel::isDirty() const
 {
-    for (const auto &row : std::as_const(m_cache)) {
-        if (!row.submitted())
-            return true;
-    }
-
-    return false;
+    return !m_dirtyRows.empty();
 }
 
 bool CachedSqlTableModel::isDirty(const QModelIndex &index) const
@@ -289,385 +629,4087 @@ bool CachedSqlTableModel::isDirty(const QModelIndex &index) const
     if (!index.isValid() )
         return false;
 
-    if(index.row() < 0 || index.row() >= m_cache.count() || index.column() < 0 || index.column() >= m_record.count())
+    if(index.row() < 0 || index.row() >= rowCount() || index.column() < 0 || index.column() >= m_record.count())
+        return false;
+
+    const int r = sourceRow(index.row());
+
+    if (r >= m_cache.count())
         return false;
 
     //Get the specified cached row
-    const CachedRow &row = m_cache.at(index.row());
+    const CachedRow &row = m_cache.at(r);
 
     //If that row has already been submitted, the row is not dirty
     if (row.submitted())
         return false;
 
     //If the op is Insert or Delete, the whole row is dirty. Update is only dirty if the generated flag is set for the specified index
-    return row.op() == CachedRow::Insert || row.op() == CachedRow::Delete || (row.op() == CachedRow::Update && row.rec().isGenerated(index.column()));
+    return row.op() == CachedRow::Insert || row.op() == CachedRow::Delete || (row.op() == CachedRow::Update && row.isGenerated(index.column()) && !m_record.field(index.column()).isAutoValue());
 }
 
 bool CachedSqlTableModel::select()
 {
-    QString stmt = selectStatement();
+    return requery(CacheVec());
+}
 
-    //Ensure we have a valid statement
-    if (stmt.isEmpty())
+bool CachedSqlTableModel::refresh()
+{
+    if (isSubmitting())
         return false;
 
-    //Prepare and execute the query
-    m_selectQuery = QSqlQuery(m_db);
-    m_selectQuery.setForwardOnly(true);
+    //A refresh running in the background is superseded by this one
+    stopRefreshWorker();
 
-    if (!m_selectQuery.exec(stmt)) {
-        m_error = m_selectQuery.lastError();
-        emit errorOccurred(m_error);
+    //Rows can only be matched by primary key, without one there is nothing to do but select again
+    if (m_primaryIndex.isEmpty() || m_keyColumns.isEmpty() || m_record.isEmpty())
+        return select();
+
+    if (!m_keyIndexValid)
+        rebuildKeyIndex();
+
+    //Every key still in the result, cached rows missing from it have been deleted by someone else
+    QSet<CachedRowKey> keys;
+
+    if (!selectKeys(keys))
         return false;
-    }
 
-    beginResetModel();
+    const QVector<int> removedRows = missingRows(keys);
 
-    //Clear data structures and reset flags and variables
-    m_cache.clear();
-    m_record = m_selectQuery.record();
-    m_autoColumn.clear();
-    m_fetchedCount = 0;
-    m_queryExhausted = false;
+    //Read the rows that may have changed: only newer versions when a version column is set, otherwise every resident row by key
+    QVector<CachedRowValues> current;
+    const int versionColumn = m_record.indexOf(m_versionColumn);
 
-    //Force NULL values for base record to allow setData generated flags to accurately track updates. Certain types (i.e. INT, BOOL) default to non-NULL values (i.e. INT, BOOL)
-    for (int i = 0; i < m_record.count(); ++i) {
-        m_record.setValue(i, QVariant());
-    }
+    if (versionColumn != -1 && m_lastVersion.isValid()) {
+        const QString field = m_db.driver()->escapeIdentifier(m_versionColumn, QSqlDriver::FieldName);
+        const QString where = CachedSql::et(CachedSql::paren(effectiveFilter()), CachedSql::gt(field, QStringLiteral("?")));
 
-    //Search for any auto incremented fields and save the result if one exists
-    for (int i = 0; i < m_record.count(); ++i) {
-        if (m_record.field(i).isAutoValue()) {
-            m_autoColumn = m_record.fieldName(i);
-            break;
+        QSqlQuery query(m_db);
+        query.setForwardOnly(true);
+
+        if (!query.prepare(composeSelect(baseSelectStatement(), where))) {
+            m_error = query.lastError();
+            emit errorOccurred(m_error);
+            return false;
+        }
+
+        query.bindValue(0, m_lastVersion);
+
+        if (!query.exec()) {
+            m_error = query.lastError();
+            emit errorOccurred(m_error);
+            return false;
+        }
+
+        const int count = m_record.count();
+
+        while (query.next()) {
+            CachedRowValues values(count);
+
+            for (int i = 0; i < count; ++i)
+                values[i] = query.value(i);
+
+            current.push_back(values);
+        }
+    } else {
+        QVector<CachedRowKey> cachedKeys;
+
+        for (const CachedRow &cr : std::as_const(m_cache)) {
+            if (cr.op() == CachedRow::None && cr.submitted() && !cr.isEvicted())
+                cachedKeys.append(cr.key(m_keyColumns));
+        }
+
+        //Once the result is drained, keys nobody has fetched yet are new rows. Before that they may simply not have been reached
+        if (m_queryExhausted) {
+            for (const CachedRowKey &key : std::as_const(keys)) {
+                if (!m_keyIndex.contains(key))
+                    cachedKeys.append(key);
+            }
         }
+
+        if (!selectByKeys(cachedKeys, current))
+            return false;
     }
 
-    //Fetch the first batch of data
-    fetchMore();
-    endResetModel();
+    mergeRows(current, removedRows);
 
     return true;
 }
 
-bool CachedSqlTableModel::submitAll()
+QVector<int> CachedSqlTableModel::missingRows(const QSet<CachedRowKey> &keys, const QSet<CachedRowKey> *candidates) const
 {
-    //Begin a transaction - the upload either fully succeeds or fails
-    if (!m_db.transaction()) {
-        m_error = m_db.lastError();
-        emit errorOccurred(m_error);
-        return false;
+    QVector<int> rows;
+
+    for (int row = 0; row < m_cache.count(); ++row) {
+        const CachedRow &cr = m_cache.at(row);
+
+        //Rows with pending changes are kept as they are, their submit reports any conflict
+        if (cr.op() != CachedRow::None || !cr.submitted())
+            continue;
+
+        const CachedRowKey key = cr.key(m_keyColumns);
+
+        if (!keys.contains(key) && (!candidates || candidates->contains(key)))
+            rows.append(row);
     }
 
-    bool success = true;
-    QVector<int> rowsToDelete; //Cache indices of rows staged-delete that succeeded in DB
+    return rows;
+}
 
-    for (int row = 0; row < m_cache.count(); ++row) {
+void CachedSqlTableModel::startRefreshWorker()
+{
+    stopRefreshWorker();
 
-        //Iterate through the cache and get a reference to the cached row
-        CachedRow &cr = m_cache[row];
+    if (isSubmitting())
+        return;
 
-        //If there have been no changes or the row is already submitted, there is nothing to be done
-        if (cr.op() == CachedRow::None || cr.submitted())
-            continue;
+    //Rows can only be matched by primary key, without one there is nothing to do but select again
+    if (m_primaryIndex.isEmpty() || m_keyColumns.isEmpty() || m_record.isEmpty()) {
+        select();
+        return;
+    }
 
-        switch (cr.op()) {
-            case CachedRow::Insert:
+    CachedSqlRefreshSource source;
+    source.connectionName = m_db.connectionName();
+    source.keysStatement = keysStatement();
+    source.columns = m_record.count();
 
-                success = insertRowInTable(cr.rec());
+    if (source.keysStatement.isEmpty())
+        return;
 
-                //Check if we have an auto generated row, if so populate the primary key value retrieved from the insertion
-                if (success) {
-                    int c = cr.rec().indexOf(m_autoColumn); //Returns -1 if the autoColumn is not found (does not exist)
+    QSqlDriver *driver = m_db.driver();
 
-                    if(c != -1 && !cr.rec().isGenerated(c)){
-                        cr.setValue(c, m_editQuery.lastInsertId());
-                        emit echoLastInsertId(m_editQuery.lastInsertId());
-                    }
+    for (int c : std::as_const(m_keyColumns))
+        source.keyFields.append(driver->escapeIdentifier(m_record.fieldName(c), QSqlDriver::FieldName));
 
-                    cr.setSubmitted();
-                }
-                break;
+    source.chunkSize = qMax(1, MaxBatchBindValues / int(source.keyFields.count()));
 
-            case CachedRow::Update:
-                success = updateRowInTable(row, cr.rec());
-                if (success)
-                    cr.setSubmitted();
-                break;
+    //Rows of the cache when the read starts, only these can be found missing from the result once it arrives
+    for (const CachedRow &cr : std::as_const(m_cache)) {
+        const CachedRowKey key = cr.key(m_keyColumns);
 
-            case CachedRow::Delete:
-                success = deleteRowFromTable(row);
-                if (success) {
-                    cr.setSubmitted();
-                    rowsToDelete.push_back(row);
-                }
-                break;
+        if (key.isNull())
+            continue;
 
-            default:
-                m_error = QSqlError("Unhandled Operation in CachedSqlTable::submitAll", QString(), QSqlError::UnknownError);
-                emit errorOccurred(m_error);
-                success = false;
-                break;
-        }
+        source.cachedKeys.insert(key);
 
-        //If an operation has failed, rollback the transaction and return
-        if (!success) {
-            m_db.rollback();
-            return false;
-        }
+        if (cr.op() == CachedRow::None && cr.submitted() && !cr.isEvicted())
+            source.readKeys.append(key);
     }
 
-    //If all operations have succeed, try committing to the database, if this fails rollback transactions and return
-    if (!m_db.commit()) {
-        m_db.rollback();
-        return false;
+    //The same reads as refresh(): newer versions when a version column is set, otherwise resident rows and, once nothing is left to
+    //fetch, new rows by key
+    if (m_record.indexOf(m_versionColumn) != -1 && m_lastVersion.isValid()) {
+        const QString field = driver->escapeIdentifier(m_versionColumn, QSqlDriver::FieldName);
+        source.versionStatement = composeSelect(baseSelectStatement(), CachedSql::et(CachedSql::paren(effectiveFilter()), CachedSql::gt(field, QStringLiteral("?"))));
+        source.lastVersion = m_lastVersion;
+        source.readKeys.clear();
+    } else {
+        source.rowsStatement = CachedSql::concat(CachedSql::select(QStringLiteral("*")), CachedSql::from(CachedSql::as(CachedSql::paren(composeSelect(baseSelectStatement(), effectiveFilter())), QStringLiteral("cached_rows"))));
+        source.readNewRows = m_queryExhausted;
     }
 
-    //All database operations have been committed to the database at this point, handle any deleted rows to ensure the local cache is in sync with the database
-    if (!rowsToDelete.isEmpty()) {
-        std::sort(rowsToDelete.begin(), rowsToDelete.end());
-        int start = rowsToDelete.front();
-        int prev = start;
+    //Results of a previous worker that are still queued are discarded by comparing generations
+    const int generation = ++m_refreshGeneration;
+    const QSet<CachedRowKey> cachedKeys = source.cachedKeys;
 
-        auto flushRange = [&](int s, int e) {
-            beginRemoveRows(QModelIndex(), s, e);
-            // remove from end to start within the range
-            for (int i = e; i >= s; --i) {
-                m_cache.removeAt(i);
-            }
-            endRemoveRows();
-        };
+    m_refreshThread = new QThread;
+    m_refreshWorker = new CachedSqlRefreshWorker;
+    m_refreshWorker->moveToThread(m_refreshThread);
 
-        for (int i = 1; i < rowsToDelete.size(); ++i) {
-            int cur = rowsToDelete[i];
-            if (cur == prev + 1) {
-                prev = cur;
-            } else {
-                flushRange(start, prev);
-                start = prev = cur;
-            }
-        }
-        flushRange(start, prev);
-    }
+    //Both objects clean themselves up once the thread's event loop exits
+    connect(m_refreshThread, &QThread::finished, m_refreshWorker, &QObject::deleteLater);
+    connect(m_refreshThread, &QThread::finished, m_refreshThread, &QObject::deleteLater);
 
-    return true;
+    connect(m_refreshWorker, &CachedSqlRefreshWorker::refreshed, this, [this, generation, cachedKeys](const QSet<CachedRowKey> &keys, const QVector<CachedRowValues> &rows) {
+        if (generation != m_refreshGeneration)
+            return;
+
+        //Rows fetched or submitted while the worker was reading were not part of its key read, they are not missing
+        stopRefreshWorker();
+        mergeRows(rows, missingRows(keys, &cachedKeys));
+    });
+    connect(m_refreshWorker, &CachedSqlRefreshWorker::errorOccurred, this, [this, generation](const QSqlError &error) {
+        if (generation != m_refreshGeneration)
+            return;
+
+        m_error = error;
+        stopRefreshWorker();
+        emit errorOccurred(m_error);
+    });
+
+    m_refreshThread->start();
+
+    CachedSqlRefreshWorker *worker = m_refreshWorker;
+    QMetaObject::invokeMethod(worker, [worker, source]() { worker->refresh(source); }, Qt::QueuedConnection);
 }
 
-bool CachedSqlTableModel::revertAll()
+void CachedSqlTableModel::stopRefreshWorker()
 {
-    bool changed = false;
+    if (!m_refreshThread)
+        return;
 
-    //Iterate backwards to safely remove rows
-    for (int row = m_cache.count() - 1; row >= 0; --row) {
-        CachedRow &cr = m_cache[row];
+    //Invalidate anything still queued from this worker, then let the thread wind down on its own
+    ++m_refreshGeneration;
+    m_refreshWorker->cancel();
+    m_refreshThread->quit();
 
-        switch (cr.op()) {
-            case CachedRow::Insert:
-                beginRemoveRows(QModelIndex(), row, row);
-                m_cache.removeAt(row);
-                endRemoveRows();
-                changed = true;
-                break;
-            case CachedRow::Update:
-                cr.revert(); // Reset to None and restore database values
-                dataChanged(index(row, 0), index(row, columnCount() - 1));
-                changed = true;
-                break;
-            case CachedRow::Delete:
-                cr.revert(); // Reset to None and restore database values
-                dataChanged(index(row, 0), index(row, columnCount() - 1));
-                changed = true;
-                break;
-            case CachedRow::None:
-                break;
+    m_refreshThread = nullptr;
+    m_refreshWorker = nullptr;
+}
+
+void CachedSqlTableModel::mergeRows(const QVector<CachedRowValues> &rows, const QVector<int> &removedRows)
+{
+    if (!m_keyIndexValid)
+        rebuildKeyIndex();
+
+    //Merge by key, rows with pending changes keep their local values
+    QVector<int> changedRows;
+    CacheVec addedRows;
+
+    for (const CachedRowValues &values : rows) {
+        trackVersion(values);
+
+        const CachedRowKey key = keyOf(values);
+        const int row = m_keyIndex.value(key, -1);
+
+        if (row == -1) {
+            addedRows.append(CachedRow(CachedRow::None, values));
+            continue;
+        }
+
+        CachedRow &cr = m_cache[row];
+
+        //Evicted rows are read back fresh when they are next looked at
+        if (cr.op() != CachedRow::None || !cr.submitted() || cr.isEvicted())
+            continue;
+
+        bool same = cr.count() == values.count();
+
+        for (int c = 0; same && c < values.count(); ++c)
+            same = cr.value(c) == values.at(c);
+
+        if (!same) {
+            cr = CachedRow(CachedRow::None, values);
+            changedRows.append(row);
         }
     }
 
-    return changed;
+    //Notify views of updated rows while their indices are still valid, then remove deleted rows
+    emitRowsChanged(changedRows);
+    removeCachedRows(removedRows);
+
+    if (!addedRows.isEmpty()) {
+        const int first = m_cache.count();
+        const int last = first + addedRows.count() - 1;
+
+        //The cursor has not reached these rows yet, skip them when it does
+        if (!m_queryExhausted) {
+            for (const CachedRow &cr : std::as_const(addedRows))
+                m_pinnedKeys.insert(cr.key(m_keyColumns));
+        }
+
+        const bool notify = !m_clientFilter;
+
+        if (notify)
+            beginInsertRows(QModelIndex(), first, last);
+
+        m_cache += addedRows;
+        indexRows(first, last);
+
+        if (m_cacheBudget > 0) {
+            for (int row = first; row <= last; ++row)
+                m_residentRows.insert(m_residentRows.end(), row);
+        }
+
+        if (notify)
+            endInsertRows();
+        else
+            showAppendedRows(first, last);
+
+        //The counted tail already held the new rows
+        if (m_unfetchedRows > 0)
+            resizeUnfetchedRows(qMax(0, m_unfetchedRows - addedRows.count()));
+
+        syncRowIndexes();
+        enforceCacheBudget();
+    }
 }
 
-void CachedSqlTableModel::clear()
+QString CachedSqlTableModel::keysStatement() const
 {
-    m_tableName.clear();
-    m_editQuery.clear();
-    m_cache.clear();
-    m_record.clear();
-    m_primaryIndex.clear();
-    m_filter.clear();
-    m_autoColumn.clear();
-    m_fetchedCount = 0;
-    m_queryExhausted = false;
+    const QString stmt = baseSelectStatement();
+
+    if (stmt.isEmpty())
+        return QString();
+
+    QSqlDriver *driver = m_db.driver();
+    QString fields;
+
+    for (int c : std::as_const(m_keyColumns))
+        fields = CachedSql::comma(fields, driver->escapeIdentifier(m_record.fieldName(c), QSqlDriver::FieldName));
+
+    //Only the key columns of the filtered result, far cheaper to transfer than whole rows
+    const QString select = composeSelect(stmt, effectiveFilter());
+    return CachedSql::concat(CachedSql::select(fields), CachedSql::from(CachedSql::as(CachedSql::paren(select), QStringLiteral("cached_keys"))));
 }
 
-bool CachedSqlTableModel::updateRowInTable(int row, const QSqlRecord &values)
+bool CachedSqlTableModel::selectKeys(QSet<CachedRowKey> &keys)
 {
-    QSqlRecord rec(values);
-    emit beforeUpdate(row, rec);
+    const QString keysStmt = keysStatement();
+
+    if (keysStmt.isEmpty())
+        return false;
 
-    const QSqlRecord whereValues = primaryValues(row);
-    const bool prepStatement = m_db.driver()->hasFeature(QSqlDriver::PreparedQueries);
-    const QString stmt = m_db.driver()->sqlStatement(QSqlDriver::UpdateStatement, m_tableName, rec, prepStatement);
-    const QString where = m_db.driver()->sqlStatement(QSqlDriver::WhereStatement, m_tableName, whereValues, prepStatement);
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
 
-    if (stmt.isEmpty() || where.isEmpty() || row < 0 || row >= rowCount()) {
-        m_error = QSqlError("No Fields to update", QString(), QSqlError::StatementError);
+    if (!query.exec(keysStmt)) {
+        m_error = query.lastError();
         emit errorOccurred(m_error);
         return false;
     }
 
-    return exec(CachedSql::concat(stmt, where), prepStatement, rec, whereValues);
+    const int count = m_keyColumns.count();
+
+    while (query.next()) {
+        CachedRowValues values(count);
+
+        for (int i = 0; i < count; ++i)
+            values[i] = query.value(i);
+
+        keys.insert(CachedRowKey(values));
+    }
+
+    return true;
 }
 
-bool CachedSqlTableModel::insertRowInTable(const QSqlRecord &values)
+bool CachedSqlTableModel::submitAll()
 {
-    QSqlRecord rec = values;
-
-    emit beforeInsert(rec);
+    //Rows still arriving from an import are submitted once it has finished
+    if (isSubmitting() || isImporting())
+        return false;
 
-    const bool prepStatement = m_db.driver()->hasFeature(QSqlDriver::PreparedQueries);
-    const QString stmt = m_db.driver()->sqlStatement(QSqlDriver::InsertStatement, m_tableName, rec, prepStatement);
+    CachedSqlScopedTimer statsTimer(statsHistogram(m_stats.submitTime), "submitAll");
 
-    if (stmt.isEmpty()) {
-        m_error = QSqlError("No Fields to update", QString(), QSqlError::StatementError);
+    //Begin a transaction - the upload either fully succeeds or fails
+    if (!m_db.transaction()) {
+        m_error = m_db.lastError();
         emit errorOccurred(m_error);
         return false;
     }
 
-    return exec(stmt, prepStatement, rec, QSqlRecord() /* no where values */);
-}
+    //Group pending rows by operation and statement shape so each group can be sent in as few round trips as possible
+    QVector<SubmitBatch> batches;
 
-bool CachedSqlTableModel::deleteRowFromTable(int row)
-{
-    emit beforeDelete(row);
+    if (!collectSubmitBatches(batches)) {
+        m_db.rollback();
+        return false;
+    }
+
+    //Batches come deletes first, then updates, then inserts. Rows are only marked submitted once the commit has succeeded, a rollback leaves
+    //every pending change in place
+    CachedSqlSubmitter submitter(m_db, m_tableName, m_autoColumn, m_statements);
+    submitter.setHistograms(statsHistogram(m_stats.prepareTime), statsHistogram(m_stats.execTime));
+
+    QVariantList insertIds;
 
-    const QSqlRecord whereValues = primaryValues(row);
-    const bool prepStatement = m_db.driver()->hasFeature(QSqlDriver::PreparedQueries);
-    const QString stmt = m_db.driver()->sqlStatement(QSqlDriver::DeleteStatement, m_tableName, QSqlRecord(), prepStatement);
-    const QString where = m_db.driver()->sqlStatement(QSqlDriver::WhereStatement, m_tableName, whereValues, prepStatement);
+    for (const SubmitBatch &batch : std::as_const(batches)) {
+        //If an operation has failed, rollback the transaction and return
+        CachedSqlHistogram &opTime = batch.op == CachedRow::Delete ? m_stats.deleteTime : batch.op == CachedRow::Update ? m_stats.updateTime : m_stats.insertTime;
+        CachedSqlScopedTimer batchTimer(statsHistogram(opTime));
+
+        if (!submitter.submit(batch, insertIds)) {
+            m_error = submitter.lastError();
+            m_db.rollback();
+            emit errorOccurred(m_error);
+            return false;
+        }
+    }
 
-    if (stmt.isEmpty() || where.isEmpty()) {
-        m_error = QSqlError("Unable to delete row", QString(), QSqlError::StatementError);
+    //If all operations have succeed, try committing to the database, if this fails rollback transactions and return
+    if (!m_db.commit()) {
+        m_error = m_db.lastError();
+        m_db.rollback();
         emit errorOccurred(m_error);
         return false;
     }
 
-    return exec(CachedSql::concat(stmt, where), prepStatement, QSqlRecord() /* no new values */, whereValues);
+    //All database operations have been committed to the database at this point, bring the cache in sync with the database
+    applySubmitted(batches, insertIds);
+
+    return true;
 }
 
-QSqlRecord CachedSqlTableModel::primaryValues(int row) const
+bool CachedSqlTableModel::collectSubmitBatches(QVector<SubmitBatch> &batches)
 {
-    //Use the primary index if available, otherwise fall back to the base record
-    const QSqlRecord &pIndex = m_primaryIndex.isEmpty() ? m_record : m_primaryIndex;
+    QHash<QByteArray, int> batchIndex;
 
-    //Guard against invalid row indices
-    if (row < 0 || row >= m_cache.count())
-        return QSqlRecord();
+    const QVector<int> dirtyRows(m_dirtyRows.cbegin(), m_dirtyRows.cend());
 
-    //Get the cached row at the given index
-    const CachedRow &cr = m_cache.at(row);
+    for (int row : dirtyRows) {
 
-    //For rows marked as Insert, no database values exist yet, return an empty record
-    if (cr.op() == CachedRow::Insert)
-        return QSqlRecord();
+        //Iterate through the dirty rows and get a reference to the cached row
+        const CachedRow &cr = m_cache.at(row);
 
-    //For None, Update, or Delete rows, return the baseline database primary key values
-    return cr.primaryValues(pIndex);
-}
+        //If there have been no changes or the row is already submitted, there is nothing to be done
+        if (cr.op() == CachedRow::None || cr.submitted())
+            continue;
 
-bool CachedSqlTableModel::exec(const QString &stmt, bool prepStatement, const QSqlRecord &rec, const QSqlRecord &whereValues)
-{
-    if (stmt.isEmpty()) {
-        m_error = QSqlError("Empty SQL statement", QString(), QSqlError::StatementError);
-        emit errorOccurred(m_error);
-        return false;
-    }
+        QSqlRecord rec;
+        QSqlRecord whereValues;
+
+        switch (cr.op()) {
+            case CachedRow::Insert:
+                rec = cr.rec(m_record);
+                emit beforeInsert(rec);
+                break;
+
+            case CachedRow::Update:
+                rec = cr.rec(m_record);
+                emit beforeUpdate(row, rec);
+                whereValues = primaryValues(row);
+                break;
 
-    if (prepStatement) {
+            case CachedRow::Delete:
+                emit beforeDelete(row);
+                whereValues = primaryValues(row);
+                break;
 
-        // Always clear before preparing to avoid stale binds
-        m_editQuery.clear();
+            default:
+                m_error = QSqlError("Unhandled Operation in CachedSqlTable::submitAll", QString(), QSqlError::UnknownError);
+                emit errorOccurred(m_error);
+                return false;
+        }
 
-        if (!m_editQuery.prepare(stmt)) {
-            m_error = m_editQuery.lastError();
+        //Without key values the statement would match nothing, or the wrong row
+        if (cr.op() != CachedRow::Insert && whereValues.isEmpty()) {
+            m_error = QSqlError(cr.op() == CachedRow::Delete ? "Unable to delete row" : "No Fields to update", QString(), QSqlError::StatementError);
             emit errorOccurred(m_error);
             return false;
         }
 
-        // Bind generated fields
-        for (int i = 0; i < rec.count(); ++i) {
-            if (rec.isGenerated(i))
-                m_editQuery.addBindValue(rec.value(i));
+        //Rows share a batch when they produce the same statement - same operation, generated columns and NULL key columns
+        const QByteArray key = CachedSqlStatementCache::key(cr.op(), m_tableName, rec, whereValues);
+
+        int index = batchIndex.value(key, -1);
+        if (index == -1) {
+            index = batches.count();
+            batchIndex.insert(key, index);
+            batches.push_back(SubmitBatch{cr.op(), {}, {}, {}});
+        }
+
+        SubmitBatch &batch = batches[index];
+        batch.rows.push_back(row);
+        batch.records.push_back(rec);
+        batch.whereValues.push_back(whereValues);
+    }
+
+    //Send deletes first, then updates, then inserts so that key values freed by a delete can be reused in the same submit
+    auto rank = [](CachedRow::Op op) { return op == CachedRow::Delete ? 0 : op == CachedRow::Update ? 1 : 2; };
+    std::stable_sort(batches.begin(), batches.end(), [rank](const SubmitBatch &a, const SubmitBatch &b) { return rank(a.op) < rank(b.op); });
+
+    return true;
+}
+
+void CachedSqlTableModel::applySubmitted(const QVector<SubmitBatch> &batches, const QVariantList &insertIds)
+{
+    //One insert id per submitted row, in batch order
+    QVector<int> rowsToDelete;
+    int index = 0;
+
+    for (const SubmitBatch &batch : batches) {
+        for (int i = 0; i < batch.rows.count(); ++i)
+            setRowSubmitted(batch.rows.at(i), batch.records.at(i), insertIds.value(index++));
+
+        if (batch.op == CachedRow::Delete)
+            rowsToDelete += batch.rows;
+    }
+
+    removeCachedRows(rowsToDelete);
+}
+
+void CachedSqlTableModel::removeCachedRows(QVector<int> rows)
+{
+    if (rows.isEmpty())
+        return;
+
+    //Remove in contiguous ranges, one signal pair per range. Work bottom up so that removing a range does not shift the ones still to go
+    std::sort(rows.begin(), rows.end());
+    int end = rows.constLast();
+    int prev = end;
+
+    auto flushRange = [&](int s, int e) {
+        //Under a client filter only the shown part of the range is removed from the view, possibly none of it
+        int first = s;
+        int last = e;
+
+        if (m_clientFilter) {
+            first = int(std::lower_bound(m_visibleRows.cbegin(), m_visibleRows.cend(), s) - m_visibleRows.cbegin());
+            last = int(std::upper_bound(m_visibleRows.cbegin(), m_visibleRows.cend(), e) - m_visibleRows.cbegin()) - 1;
         }
-        for (int i = 0; i < whereValues.count(); ++i) {
-            if (whereValues.isGenerated(i) && !whereValues.isNull(i))
-                m_editQuery.addBindValue(whereValues.value(i));
+
+        if (first <= last)
+            beginRemoveRows(QModelIndex(), first, last);
+
+        for (int i = s; i <= e; ++i)
+            m_evictedCount -= m_cache.at(i).isEvicted() ? 1 : 0;
+
+        m_cache.remove(s, e - s + 1);
+        shiftRows(e + 1, s - e - 1);
+
+        if (first <= last)
+            endRemoveRows();
+    };
+
+    for (int i = rows.size() - 2; i >= 0; --i) {
+        const int cur = rows.at(i);
+        if (cur == prev - 1) {
+            prev = cur;
+        } else {
+            flushRange(prev, end);
+            end = prev = cur;
         }
+    }
+    flushRange(prev, end);
+}
 
-        if (!m_editQuery.exec()) {
-            m_error = m_editQuery.lastError();
-            emit errorOccurred(m_error);
-            return false;
+void CachedSqlTableModel::emitRowsChanged(QVector<int> rows)
+{
+    if (rows.isEmpty())
+        return;
+
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+    for (int row : std::as_const(rows))
+        updateRowIndexes(row);
+
+    //Under a client filter only shown rows are notified, in view positions
+    QVector<int> shown;
+
+    if (m_clientFilter) {
+        for (int row : std::as_const(rows)) {
+            const int view = viewRow(row);
+
+            if (view != -1)
+                shown.append(view);
         }
     } else {
-        if (!m_editQuery.exec(stmt)) {
-            m_error = m_editQuery.lastError();
-            emit errorOccurred(m_error);
-            return false;
+        shown = rows;
+    }
+
+    //One dataChanged() per contiguous range of rows
+    if (!shown.isEmpty()) {
+        int start = shown.constFirst();
+        int prev = start;
+        const int lastColumn = columnCount() - 1;
+
+        for (int i = 1; i < shown.size(); ++i) {
+            const int cur = shown.at(i);
+            if (cur == prev + 1) {
+                prev = cur;
+            } else {
+                emit dataChanged(index(start, 0), index(prev, lastColumn));
+                start = prev = cur;
+            }
         }
+        emit dataChanged(index(start, 0), index(prev, lastColumn));
+    }
+
+    //Changed values may move rows in or out of the filter
+    if (m_clientFilter)
+        refilterRows(rows);
+}
+
+bool CachedSqlTableModel::submitAllAsync()
+{
+    if (isSubmitting() || isImporting())
+        return false;
+
+    //The worker cannot open a private database, submit on this connection and report it the same way
+    if (!canCloneConnection()) {
+        emit submitFinished(submitAll());
+        return true;
+    }
+
+    //Snapshot the pending rows on this thread, the before* signals may still adjust the records
+    QVector<SubmitBatch> batches;
+
+    if (!collectSubmitBatches(batches))
+        return false;
+
+    if (batches.isEmpty()) {
+        emit submitFinished(true);
+        return true;
     }
 
+    m_submitBatches = batches;
+
+    //Results of a canceled worker that are still queued are discarded by comparing generations
+    const int generation = ++m_submitGeneration;
+
+    m_submitThread = new QThread;
+    m_submitWorker = new CachedSqlSubmitWorker(m_db.connectionName(), m_tableName, m_autoColumn);
+    m_submitWorker->moveToThread(m_submitThread);
+
+    //Both objects clean themselves up once the thread's event loop exits
+    connect(m_submitThread, &QThread::finished, m_submitWorker, &QObject::deleteLater);
+    connect(m_submitThread, &QThread::finished, m_submitThread, &QObject::deleteLater);
+
+    connect(m_submitWorker, &CachedSqlSubmitWorker::progress, this, [this, generation](int done, int total) {
+        if (generation == m_submitGeneration)
+            emit submitProgress(done, total);
+    });
+    connect(m_submitWorker, &CachedSqlSubmitWorker::finished, this, [this, generation](const QVariantList &insertIds) {
+        if (generation == m_submitGeneration)
+            submitWorkerFinished(insertIds);
+    });
+    connect(m_submitWorker, &CachedSqlSubmitWorker::canceled, this, [this, generation]() {
+        if (generation != m_submitGeneration)
+            return;
+
+        stopSubmitWorker();
+        emit submitCanceled();
+    });
+    connect(m_submitWorker, &CachedSqlSubmitWorker::errorOccurred, this, [this, generation](const QSqlError &error) {
+        if (generation != m_submitGeneration)
+            return;
+
+        //The worker has rolled back, the rows keep their pending changes
+        m_error = error;
+        stopSubmitWorker();
+        emit errorOccurred(m_error);
+        emit submitFinished(false);
+    });
+
+    m_submitThread->start();
+
+    CachedSqlSubmitWorker *worker = m_submitWorker;
+    QMetaObject::invokeMethod(worker, [worker, batches]() { worker->submit(batches); }, Qt::QueuedConnection);
+
     return true;
 }
 
-QString CachedSqlTableModel::filter() const
+bool CachedSqlTableModel::canCloneConnection() const
 {
-    return m_filter;
+    if (m_db.driverName() != QLatin1String("QSQLITE"))
+        return true;
+
+    //An in-memory database, or the temporary one an empty name opens, belongs to the connection that opened it. A clone opens an empty
+    //database of its own, unless a URI names a shared cache
+    const QString name = m_db.databaseName();
+
+    if (name.isEmpty() || name == QLatin1String(":memory:"))
+        return false;
+
+    if (!m_db.connectOptions().contains(QLatin1String("QSQLITE_OPEN_URI")))
+        return true;
+
+    const bool memory = name.contains(QLatin1String(":memory:")) || name.contains(QLatin1String("mode=memory"));
+    return !memory || name.contains(QLatin1String("cache=shared"));
 }
 
-void CachedSqlTableModel::setFilter(const QString &filter)
+bool CachedSqlTableModel::isSubmitting() const
 {
-    m_filter = filter;
+    return m_submitWorker != nullptr;
 }
 
-void CachedSqlTableModel::setFetchBatchSize(int size)
+void CachedSqlTableModel::cancelSubmit()
 {
-    if (size > 0)
-        m_fetchBatchSize = size;
+    //The worker rolls back at the next statement, or in place of the commit, and reports submitCanceled() unless it has already committed
+    if (m_submitWorker)
+        m_submitWorker->cancel();
 }
 
-int CachedSqlTableModel::fetchBatchSize() const
+void CachedSqlTableModel::stopSubmitWorker()
 {
-    return m_fetchBatchSize;
+    if (!m_submitThread)
+        return;
+
+    //Invalidate anything still queued from this worker, then let the thread wind down on its own
+    ++m_submitGeneration;
+    m_submitWorker->cancel();
+    m_submitThread->quit();
+
+    m_submitThread = nullptr;
+    m_submitWorker = nullptr;
+    m_submitBatches.clear();
 }
 
-void CachedSqlTableModel::sort(int column, Qt::SortOrder order)
+void CachedSqlTableModel::submitWorkerFinished(const QVariantList &insertIds)
 {
+    const QVector<SubmitBatch> batches = m_submitBatches;
+    stopSubmitWorker();
 
-    if (m_cache.isEmpty())
-        return;
+    //The transaction has been committed, apply the outcome to the cache in one pass
+    applySubmitted(batches, insertIds);
 
-    if (column < 0 || column >= m_record.count())
+    emit submitFinished(true);
+}
+
+bool CachedSqlTableModel::appendRecords(const QList<QSqlRecord> &records)
+{
+    if (isSubmitting() || m_record.isEmpty())
+        return false;
+
+    QVector<CachedRow> rows;
+    rows.reserve(records.count());
+
+    //Records usually share one layout, the field name lookup is only redone when it changes
+    QSqlRecord layout;
+    QVector<int> columns;
+
+    for (const QSqlRecord &record : records) {
+        bool sameLayout = record.count() == layout.count();
+
+        for (int i = 0; sameLayout && i < record.count(); ++i)
+            sameLayout = record.fieldName(i) == layout.fieldName(i);
+
+        if (!sameLayout) {
+            layout = record;
+            columns.clear();
+
+            for (int i = 0; i < record.count(); ++i)
+                columns.append(m_record.indexOf(record.fieldName(i)));
+        }
+
+        //NULL and non-generated values are left to the database, the same as columns setData() never touched
+        CachedRow cr(CachedRow::Insert, CachedRowValues(m_record.count()));
+
+        for (int i = 0; i < record.count(); ++i) {
+            if (columns.at(i) != -1 && record.isGenerated(i) && !record.isNull(i))
+                cr.setValue(columns.at(i), record.value(i));
+        }
+
+        rows.append(cr);
+    }
+
+    appendStagedRows(rows);
+
+    return true;
+}
+
+bool CachedSqlTableModel::importCsv(const QString &fileName, QChar separator, bool hasHeader)
+{
+    CachedSqlImportWorker *worker = startImportWorker(separator, hasHeader);
+
+    if (!worker)
+        return false;
+
+    QMetaObject::invokeMethod(worker, [worker, fileName]() { worker->importFile(fileName); }, Qt::QueuedConnection);
+
+    return true;
+}
+
+bool CachedSqlTableModel::importCsv(QIODevice *device, QChar separator, bool hasHeader)
+{
+    if (!device || !device->isReadable()) {
+        m_error = QSqlError("Device not readable", QString(), QSqlError::UnknownError);
+        emit errorOccurred(m_error);
+        return false;
+    }
+
+    if (!startImportWorker(separator, hasHeader))
+        return false;
+
+    //Devices belong to the calling thread. They are read here a chunk at a time, as the worker keeps up and as data arrives
+    m_importDevice = device;
+    m_importInputDone = false;
+
+    connect(device, &QIODevice::readyRead, this, &CachedSqlTableModel::pumpImport);
+    connect(device, &QIODevice::readChannelFinished, this, [this]() {
+        m_importInputDone = true;
+        pumpImport();
+    });
+
+    pumpImport();
+
+    return true;
+}
+
+bool CachedSqlTableModel::isImporting() const
+{
+    return m_importWorker != nullptr;
+}
+
+void CachedSqlTableModel::cancelImport()
+{
+    if (!m_importWorker)
         return;
 
-    emit layoutAboutToBeChanged();
+    //Rows imported so far stay staged, revertAll() drops them
+    stopImportWorker();
+    emit importCanceled();
+}
 
-    std::sort(m_cache.begin(), m_cache.end(),
-              [column, order](const CachedRow &a, const CachedRow &b)
-              {
-                  const QVariant va = a.value(column);
-                  const QVariant vb = b.value(column);
+CachedSqlImportWorker *CachedSqlTableModel::startImportWorker(QChar separator, bool hasHeader)
+{
+    if (isSubmitting() || isImporting() || m_record.isEmpty())
+        return nullptr;
 
-                  // Handle nulls safely
-                  if (va.isNull() && vb.isNull()) return false;
-                  if (va.isNull()) return (order == Qt::AscendingOrder);
-                  if (vb.isNull()) return (order == Qt::DescendingOrder);
+    if (separator.unicode() == 0 || separator.unicode() > 0x7f || separator == QLatin1Char('"') || separator == QLatin1Char('\n')) {
+        m_error = QSqlError("Unsupported CSV separator", QString(), QSqlError::UnknownError);
+        emit errorOccurred(m_error);
+        return nullptr;
+    }
 
-                  // Modern, type-safe comparator
-                  QPartialOrdering cmp = QVariant::compare(va, vb);
-                  bool less = (cmp < 0);
+    //Results of a canceled worker that are still queued are discarded by comparing generations
+    const int generation = ++m_importGeneration;
+    m_importedCount = 0;
+
+    m_importThread = new QThread;
+    m_importWorker = new CachedSqlImportWorker(m_record, char(separator.unicode()), hasHeader);
+    m_importWorker->moveToThread(m_importThread);
+
+    //Both objects clean themselves up once the thread's event loop exits
+    connect(m_importThread, &QThread::finished, m_importWorker, &QObject::deleteLater);
+    connect(m_importThread, &QThread::finished, m_importThread, &QObject::deleteLater);
+
+    connect(m_importWorker, &CachedSqlImportWorker::imported, this, [this, generation](const QVector<CachedRowValues> &rows) {
+        if (generation == m_importGeneration)
+            importWorkerImported(rows);
+    });
+    connect(m_importWorker, &CachedSqlImportWorker::consumed, this, [this, generation]() {
+        if (generation != m_importGeneration)
+            return;
+
+        //A parsed chunk frees a slot in the queue, refill it
+        --m_importPending;
+        pumpImport();
+    });
+    connect(m_importWorker, &CachedSqlImportWorker::finished, this, [this, generation](int rows) {
+        if (generation != m_importGeneration)
+            return;
+
+        stopImportWorker();
+        emit importFinished(rows);
+    });
+    connect(m_importWorker, &CachedSqlImportWorker::errorOccurred, this, [this, generation](const QSqlError &error) {
+        if (generation != m_importGeneration)
+            return;
+
+        //Batches that were already staged are kept and reported, the rest of the source is skipped
+        m_error = error;
+        stopImportWorker();
+        emit errorOccurred(m_error);
+        emit importFailed(m_importedCount);
+    });
 
-                  return (order == Qt::AscendingOrder) ? less : !less;
-              });
+    m_importThread->start();
 
-    emit layoutChanged();
+    return m_importWorker;
+}
+
+void CachedSqlTableModel::stopImportWorker()
+{
+    if (!m_importThread)
+        return;
+
+    //Invalidate anything still queued from this worker, then let the thread wind down on its own
+    ++m_importGeneration;
+    m_importWorker->cancel();
+    m_importThread->quit();
+
+    m_importThread = nullptr;
+    m_importWorker = nullptr;
+
+    //The device stays with the caller, only stop listening to it
+    if (m_importDevice)
+        disconnect(m_importDevice, nullptr, this, nullptr);
+
+    m_importDevice = nullptr;
+    m_importPending = 0;
+    m_importFinishing = false;
+}
+
+void CachedSqlTableModel::pumpImport()
+{
+    if (!m_importWorker || m_importFinishing)
+        return;
+
+    if (!m_importDevice) {
+        m_error = QSqlError("Import device was destroyed", QString(), QSqlError::UnknownError);
+        stopImportWorker();
+        emit errorOccurred(m_error);
+        emit importFailed(m_importedCount);
+        return;
+    }
+
+    CachedSqlImportWorker *worker = m_importWorker;
+
+    //Never more than a few chunks in flight, the worker's pace bounds the memory the import holds
+    while (m_importPending < MaxImportChunks) {
+        const QByteArray chunk = m_importDevice->read(ImportChunkSize);
+
+        if (chunk.isEmpty()) {
+            //Random access devices end with their data, streams once their read channel has finished. Otherwise wait for readyRead()
+            const bool done = m_importDevice->isSequential() ? m_importInputDone || !m_importDevice->isOpen() : m_importDevice->atEnd();
+
+            if (done) {
+                //Queued behind the chunks still in flight, the worker parses the last record and finishes
+                m_importFinishing = true;
+                QMetaObject::invokeMethod(worker, [worker]() { worker->finish(); }, Qt::QueuedConnection);
+            }
+
+            return;
+        }
+
+        ++m_importPending;
+        QMetaObject::invokeMethod(worker, [worker, chunk]() { worker->append(chunk); }, Qt::QueuedConnection);
+    }
+}
+
+void CachedSqlTableModel::importWorkerImported(const QVector<CachedRowValues> &rows)
+{
+    //The worker converted the values already, only building the staged rows happens on this thread. A batch laid out for another
+    //record is dropped
+    if (!rows.isEmpty() && rows.constFirst().count() != m_record.count())
+        return;
+
+    QVector<CachedRow> staged;
+    staged.reserve(rows.count());
+
+    for (const CachedRowValues &values : rows) {
+        CachedRow cr(CachedRow::Insert, CachedRowValues(m_record.count()));
+
+        for (int c = 0; c < values.count() && c < m_record.count(); ++c) {
+            if (!values.at(c).isNull())
+                cr.setValue(c, values.at(c));
+        }
+
+        staged.append(cr);
+    }
+
+    appendStagedRows(staged);
+
+    m_importedCount += rows.count();
+    emit importProgress(m_importedCount);
+}
+
+void CachedSqlTableModel::appendStagedRows(const QVector<CachedRow> &rows)
+{
+    if (rows.isEmpty())
+        return;
+
+    //Staged rows go after the cached ones, ahead of a counted tail that has not been fetched yet
+    const int first = m_cache.count();
+    const int last = first + rows.count() - 1;
+    const int shown = m_clientFilter ? m_visibleRows.count() : first;
+
+    beginInsertRows(QModelIndex(), shown, shown + rows.count() - 1);
+
+    m_cache += rows;
+
+    //Staged inserts are dirty until submitted and always shown, the filter applies once they have been submitted
+    for (int row = first; row <= last; ++row) {
+        m_dirtyRows.insert(m_dirtyRows.end(), row);
+
+        if (m_cacheBudget > 0)
+            m_residentRows.insert(m_residentRows.end(), row);
+
+        if (m_clientFilter)
+            m_visibleRows.append(row);
+    }
+
+    endInsertRows();
+
+    syncRowIndexes();
+    enforceCacheBudget();
+}
+
+bool CachedSqlTableModel::exportRows(const QString &fileName, ExportFormat format, ExportValues values, bool drainQuery)
+{
+    if (isExporting() || m_record.isEmpty())
+        return false;
+
+    //The worker cannot open a private database, read the rest of the result into the cache on this thread instead
+    if (drainQuery && !canCloneConnection()) {
+        while (canFetchMore())
+            fetchMore();
+
+        drainQuery = false;
+    }
+
+    //Rows of the rest of the result are told apart from the cached ones by key
+    if (drainQuery && m_keyColumns.isEmpty()) {
+        m_error = QSqlError("Draining the query on export requires a primary key", QString(), QSqlError::StatementError);
+        emit errorOccurred(m_error);
+        return false;
+    }
+
+    //Results of a canceled worker that are still queued are discarded by comparing generations
+    const int generation = ++m_exportGeneration;
+
+    m_exportValues = values;
+    m_exportDrain = drainQuery;
+    m_exportRow = 0;
+    m_exportEnd = m_cache.count();
+    m_exportPending = 0;
+    m_exportedCount = 0;
+    m_exportFinishing = false;
+
+    m_exportThread = new QThread;
+    m_exportWorker = new CachedSqlExportWorker(fileName, format == ColumnarExport ? CachedSqlExportWorker::Columnar : CachedSqlExportWorker::Csv, m_record);
+    m_exportWorker->moveToThread(m_exportThread);
+
+    //Both objects clean themselves up once the thread's event loop exits
+    connect(m_exportThread, &QThread::finished, m_exportWorker, &QObject::deleteLater);
+    connect(m_exportThread, &QThread::finished, m_exportThread, &QObject::deleteLater);
+
+    connect(m_exportWorker, &CachedSqlExportWorker::written, this, [this, generation](int rows) {
+        if (generation != m_exportGeneration)
+            return;
+
+        //A written chunk frees a slot in the queue, refill it
+        --m_exportPending;
+        m_exportedCount += rows;
+        emit exportProgress(m_exportedCount);
+        pumpExport();
+    });
+    connect(m_exportWorker, &CachedSqlExportWorker::drained, this, [this, generation](int rows) {
+        if (generation != m_exportGeneration)
+            return;
+
+        m_exportedCount += rows;
+        emit exportProgress(m_exportedCount);
+    });
+    connect(m_exportWorker, &CachedSqlExportWorker::finished, this, [this, generation](qint64 rows) {
+        if (generation != m_exportGeneration)
+            return;
+
+        stopExportWorker();
+        emit exportFinished(rows);
+    });
+    connect(m_exportWorker, &CachedSqlExportWorker::errorOccurred, this, [this, generation](const QSqlError &error) {
+        if (generation != m_exportGeneration)
+            return;
+
+        m_error = error;
+        stopExportWorker();
+        emit errorOccurred(m_error);
+    });
+
+    m_exportThread->start();
+
+    CachedSqlExportWorker *worker = m_exportWorker;
+    QMetaObject::invokeMethod(worker, [worker]() { worker->open(); }, Qt::QueuedConnection);
+
+    pumpExport();
+
+    return true;
+}
+
+bool CachedSqlTableModel::isExporting() const
+{
+    return m_exportWorker != nullptr;
+}
+
+void CachedSqlTableModel::cancelExport()
+{
+    if (!m_exportWorker)
+        return;
+
+    //The worker discards the partial file
+    stopExportWorker();
+    emit exportCanceled();
+}
+
+void CachedSqlTableModel::pumpExport()
+{
+    if (!m_exportWorker || m_exportFinishing)
+        return;
+
+    //Never more than a few chunks in flight, the worker's pace bounds the memory the export holds
+    while (m_exportPending < MaxExportChunks) {
+        if (m_exportRow >= m_exportEnd) {
+            m_exportFinishing = true;
+            CachedSqlExportWorker *worker = m_exportWorker;
+
+            //The rest of the result is read by the worker on a cursor of its own, none of it passes through the cache
+            if (m_exportDrain && canFetchMore()) {
+                const CachedSqlExportSource source = exportSource();
+
+                if (!source.statement.isEmpty())
+                    QMetaObject::invokeMethod(worker, [worker, source]() { worker->drain(source); }, Qt::QueuedConnection);
+            }
+
+            //Queued behind the chunks still in flight, the worker finishes once they are written
+            QMetaObject::invokeMethod(worker, [worker]() { worker->finish(); }, Qt::QueuedConnection);
+            return;
+        }
+
+        const int first = m_exportRow;
+        const int last = qMin(m_exportEnd, first + ExportChunkRows) - 1;
+
+        //Evicted rows are read back one chunk at a time. A failed read has been reported already
+        if (m_evictedCount > 0 && !loadRows(first, last)) {
+            stopExportWorker();
+            return;
+        }
+
+        QVector<CachedRowValues> rows;
+        rows.reserve(last - first + 1);
+
+        for (int row = first; row <= last; ++row) {
+            const CachedRow &cr = m_cache.at(row);
+
+            //Only the rows the view shows, as they are now or as they are in the database
+            if (m_clientFilter && viewRow(row) == -1)
+                continue;
+
+            if (m_exportValues == CommittedValues ? cr.op() == CachedRow::Insert : cr.op() == CachedRow::Delete)
+                continue;
+
+            CachedRowValues values(m_record.count());
+
+            for (int c = 0; c < values.count(); ++c)
+                values[c] = m_exportValues == CommittedValues ? cr.committedValue(c) : cr.value(c);
+
+            rows.append(values);
+        }
+
+        m_exportRow = last + 1;
+
+        //The chunk has been copied, the rows it read back may be evicted again
+        enforceCacheBudget();
+
+        if (rows.isEmpty())
+            continue;
+
+        ++m_exportPending;
+
+        CachedSqlExportWorker *worker = m_exportWorker;
+        QMetaObject::invokeMethod(worker, [worker, rows]() { worker->write(rows); }, Qt::QueuedConnection);
+    }
+}
+
+CachedSqlExportSource CachedSqlTableModel::exportSource() const
+{
+    CachedSqlExportSource source;
+    source.connectionName = m_db.connectionName();
+    source.keyColumns = m_keyColumns;
+    source.statement = selectStatement();
+
+    if (m_clientFilter)
+        source.filter = m_rowFilter;
+
+    //The cursor reads the result from the start and steps over every row the cache has exported. A count or a seek past the last
+    //fetched row would not do: submitted deletes and inserts move rows in and out of the result, and rows fetched after the export
+    //began sit past its end in the cache without having been written
+    source.skipKeys.reserve(m_exportEnd);
+
+    for (int row = 0; row < m_exportEnd; ++row) {
+        const CachedRowKey key = m_cache.at(row).key(m_keyColumns);
+
+        if (!key.isNull())
+            source.skipKeys.insert(key);
+    }
+
+    return source;
+}
+
+void CachedSqlTableModel::abandonExport()
+{
+    if (!m_exportWorker)
+        return;
+
+    m_error = QSqlError("Export abandoned, the cached rows were reset or reordered", QString(), QSqlError::UnknownError);
+    stopExportWorker();
+    emit errorOccurred(m_error);
+}
+
+void CachedSqlTableModel::stopExportWorker()
+{
+    if (!m_exportThread)
+        return;
+
+    //Invalidate anything still queued from this worker, then let the thread wind down on its own. An unfinished file is discarded with the worker
+    ++m_exportGeneration;
+    m_exportWorker->cancel();
+    m_exportThread->quit();
+
+    m_exportThread = nullptr;
+    m_exportWorker = nullptr;
+    m_exportPending = 0;
+    m_exportFinishing = false;
+}
+
+bool CachedSqlTableModel::revertAll()
+{
+    if (isSubmitting())
+        return false;
+
+    QVector<int> revertedRows;
+    QVector<int> discardedRows;
+
+    for (int row : m_dirtyRows) {
+        CachedRow &cr = m_cache[row];
+
+        switch (cr.op()) {
+            case CachedRow::Insert:
+                discardedRows.append(row);
+                break;
+            case CachedRow::Update:
+            case CachedRow::Delete:
+                cr.revert(); // Reset to None and restore database values
+                revertedRows.append(row);
+                break;
+            case CachedRow::None:
+                break;
+        }
+    }
+
+    //Notify views in contiguous ranges, reverted rows first while their indices are still valid
+    emitRowsChanged(revertedRows);
+    removeCachedRows(discardedRows);
+
+    m_dirtyRows.clear();
+
+    return !revertedRows.isEmpty() || !discardedRows.isEmpty();
+}
+
+void CachedSqlTableModel::clear()
+{
+    stopLiveUpdates();
+    stopFetchWorker();
+    stopRefreshWorker();
+    stopSubmitWorker();
+    stopImportWorker();
+    stopExportWorker();
+    m_tableName.clear();
+    m_statements.clear();
+    m_cache.clear();
+    m_dirtyRows.clear();
+    invalidateKeyIndex();
+    m_keyColumns.clear();
+    m_record.clear();
+    m_primaryIndex.clear();
+    m_filter.clear();
+    m_rowFilter = CachedSqlFilter();
+    m_rowFilterSql.clear();
+    m_clientFilter = false;
+    m_visibleRows.clear();
+    m_searchIndexes.clear();
+    m_aggregates.clear();
+    m_changedAggregates.clear();
+    m_sortFields.clear();
+    m_autoColumn.clear();
+    m_pinnedKeys.clear();
+    m_keysetLast.clear();
+    m_versionColumn.clear();
+    m_lastVersion.clear();
+    m_liveChannel.clear();
+    m_residentRows.clear();
+    m_evictedCount = 0;
+    m_rowBytes = 0;
+    m_lastAccessedRow = 0;
+    ++m_countGeneration;
+    m_totalRowCount = -1;
+    m_unfetchedRows = 0;
+    m_fetchUntilRow = -1;
+    m_fetchedCount = 0;
+    m_queryExhausted = false;
+}
+
+QSqlRecord CachedSqlTableModel::primaryValues(int row) const
+{
+    //Use the primary index if available, otherwise fall back to the base record
+    const QSqlRecord &pIndex = m_primaryIndex.isEmpty() ? m_record : m_primaryIndex;
+
+    //Guard against invalid row indices
+    if (row < 0 || row >= m_cache.count())
+        return QSqlRecord();
+
+    //Get the cached row at the given index
+    const CachedRow &cr = m_cache.at(row);
+
+    //For rows marked as Insert, no database values exist yet, return an empty record
+    if (cr.op() == CachedRow::Insert)
+        return QSqlRecord();
+
+    //For None, Update, or Delete rows, return the baseline database primary key values
+    return cr.primaryValues(m_record, pIndex);
+}
+
+QString CachedSqlTableModel::editStatement(QSqlDriver *driver, const QString &table, CachedRow::Op op, const QSqlRecord &rec, const QSqlRecord &whereValues, bool prepStatement)
+{
+    switch (op) {
+        case CachedRow::Insert:
+            return driver->sqlStatement(QSqlDriver::InsertStatement, table, rec, prepStatement);
+
+        case CachedRow::Update:
+        case CachedRow::Delete: {
+            const QString stmt = driver->sqlStatement(op == CachedRow::Update ? QSqlDriver::UpdateStatement : QSqlDriver::DeleteStatement,
+                                                      table, op == CachedRow::Update ? rec : QSqlRecord(), prepStatement);
+            const QString where = driver->sqlStatement(QSqlDriver::WhereStatement, table, whereValues, prepStatement);
+
+            //Updates and deletes must never run without a where clause
+            if (stmt.isEmpty() || where.isEmpty())
+                return QString();
+
+            return CachedSql::concat(stmt, where);
+        }
+
+        default:
+            return QString();
+    }
+}
+
+QVariantList CachedSqlTableModel::bindValues(const QSqlRecord &rec, const QSqlRecord &whereValues)
+{
+    //Placeholders are generated for the generated fields followed by the non-NULL where fields
+    QVariantList values;
+
+    for (int i = 0; i < rec.count(); ++i) {
+        if (rec.isGenerated(i))
+            values.append(rec.value(i));
+    }
+    for (int i = 0; i < whereValues.count(); ++i) {
+        if (whereValues.isGenerated(i) && !whereValues.isNull(i))
+            values.append(whereValues.value(i));
+    }
+
+    return values;
+}
+
+QString CachedSqlTableModel::batchStatement(QSqlDriver *driver, const QString &table, CachedRow::Op op, const QSqlRecord &rec, const QSqlRecord &whereValues, int rows)
+{
+    switch (op) {
+        case CachedRow::Insert: {
+            //Multi-row insert, the driver's single row statement followed by one placeholder tuple per additional row
+            QString stmt = editStatement(driver, table, op, rec, QSqlRecord(), true);
+            QStringList placeholders;
+
+            for (int i = bindValues(rec, QSqlRecord()).count(); i > 0; --i)
+                placeholders.append(QStringLiteral("?"));
+
+            const QString tuple = CachedSql::paren(placeholders.join(CachedSql::comma()));
+
+            for (int i = 1; !stmt.isEmpty() && i < rows; ++i)
+                stmt = CachedSql::comma(stmt, tuple);
+
+            return stmt;
+        }
+
+        case CachedRow::Delete: {
+            //Delete on a single key column with an IN list
+            if (whereValues.count() != 1)
+                return QString();
+
+            const QString stmt = driver->sqlStatement(QSqlDriver::DeleteStatement, table, QSqlRecord(), true);
+            const QString field = driver->escapeIdentifier(whereValues.fieldName(0), QSqlDriver::FieldName);
+            QStringList placeholders;
+
+            for (int i = 0; i < rows; ++i)
+                placeholders.append(QStringLiteral("?"));
+
+            return CachedSql::concat(stmt, CachedSql::where(CachedSql::in(field, placeholders.join(CachedSql::comma()))));
+        }
+
+        default:
+            return QString();
+    }
+}
+
+void CachedSqlTableModel::setRowSubmitted(int row, const QSqlRecord &rec, const QVariant &insertId)
+{
+    CachedRow &cr = m_cache[row];
+    const CachedRowKey before = cr.key(m_keyColumns);
+
+    //Check if we have an auto generated row, if so populate the primary key value retrieved from the insertion
+    if (cr.op() == CachedRow::Insert && insertId.isValid()) {
+        int c = rec.indexOf(m_autoColumn); //Returns -1 if the autoColumn is not found (does not exist)
+
+        if(c != -1 && !rec.isGenerated(c)){
+            cr.setValue(c, insertId);
+            emit echoLastInsertId(insertId);
+        }
+    }
+
+    cr.setSubmitted();
+    m_dirtyRows.erase(row);
+
+    //Deleted rows leave the key index when they are removed from the cache
+    if (cr.op() != CachedRow::Delete)
+        rekeyRow(row, before);
+}
+
+QString CachedSqlTableModel::filter() const
+{
+    return m_filter;
+}
+
+void CachedSqlTableModel::setFilter(const QString &filter)
+{
+    m_filter = filter;
+}
+
+bool CachedSqlTableModel::setRowFilter(const CachedSqlFilter &filter)
+{
+    //Hiding rows changes the view positions an asynchronous submit reports back on
+    if (isSubmitting())
+        return false;
+
+    if (!filter.isValid(m_record.count())) {
+        m_error = QSqlError("Row filter refers to a column outside the record", QString(), QSqlError::StatementError);
+        emit errorOccurred(m_error);
+        return false;
+    }
+
+    m_rowFilter = filter;
+
+    //The cache only holds the whole result while the query is drained, nothing is evicted and no earlier filter narrowed it on the server
+    //A filter the driver cannot express exactly, such as a case-sensitive LIKE on MySQL, is always applied to the cache
+    const bool complete = m_rowFilterSql.isEmpty() && m_queryExhausted && m_evictedCount == 0;
+    const bool client = !filter.isEmpty() && (m_filterMode == ClientFilter || !filter.hasSql(m_db.driver()) || (m_filterMode == AutoFilter && complete));
+
+    if (!client) {
+        removeClientFilter();
+
+        const QString sql = filter.toSql(m_record, m_db.driver());
+
+        if (sql == m_rowFilterSql)
+            return true;
+
+        m_rowFilterSql = sql;
+        return requery(pendingRows());
+    }
+
+    //Rows the server filtered out before may match the new filter, start over from the full result
+    if (!m_rowFilterSql.isEmpty()) {
+        m_rowFilterSql.clear();
+
+        if (!requery(pendingRows()))
+            return false;
+    }
+
+    applyClientFilter();
+    return true;
+}
+
+CachedSqlFilter CachedSqlTableModel::rowFilter() const
+{
+    return m_rowFilter;
+}
+
+void CachedSqlTableModel::setFilterMode(FilterMode mode)
+{
+    m_filterMode = mode;
+}
+
+CachedSqlTableModel::FilterMode CachedSqlTableModel::filterMode() const
+{
+    return m_filterMode;
+}
+
+QString CachedSqlTableModel::effectiveFilter() const
+{
+    if (m_rowFilterSql.isEmpty())
+        return m_filter;
+
+    return CachedSql::et(CachedSql::paren(m_filter), CachedSql::paren(m_rowFilterSql));
+}
+
+int CachedSqlTableModel::sourceRow(int row) const
+{
+    if (!m_clientFilter)
+        return row;
+
+    //One past the last shown row maps to the end of the cache, where appended rows go
+    return row >= 0 && row < m_visibleRows.count() ? m_visibleRows.at(row) : m_cache.count();
+}
+
+int CachedSqlTableModel::viewRow(int row) const
+{
+    if (!m_clientFilter)
+        return row;
+
+    const auto it = std::lower_bound(m_visibleRows.cbegin(), m_visibleRows.cend(), row);
+    return it != m_visibleRows.cend() && *it == row ? int(it - m_visibleRows.cbegin()) : -1;
+}
+
+QVector<int> CachedSqlTableModel::matchingRows(const QVector<int> &rows) const
+{
+    const std::vector<char> mask = m_rowFilter.evaluate(m_cache, rows, m_record);
+    QVector<int> matching;
+    matching.reserve(rows.count());
+
+    for (int i = 0; i < rows.count(); ++i) {
+        const int row = rows.at(i);
+        const CachedRow &cr = m_cache.at(row);
+
+        //Rows with pending changes stay in view until submitted, evicted rows cannot be tested and keep their state
+        if (cr.op() != CachedRow::None || !cr.submitted())
+            matching.append(row);
+        else if (cr.isEvicted() ? viewRow(row) != -1 : mask[i] != 0)
+            matching.append(row);
+    }
+
+    return matching;
+}
+
+void CachedSqlTableModel::applyClientFilter()
+{
+    //Every value is needed to test the rows, read back evicted ones first
+    if (m_evictedCount > 0 && !m_cache.isEmpty())
+        loadRows(0, m_cache.count() - 1);
+
+    QVector<int> rows(m_cache.count());
+    std::iota(rows.begin(), rows.end(), 0);
+
+    //Switch to showing rows through m_visibleRows, hiding the counted tail which cannot be filtered
+    if (!m_clientFilter) {
+        const int tail = m_unfetchedRows;
+
+        if (tail > 0)
+            beginRemoveRows(QModelIndex(), m_cache.count(), m_cache.count() + tail - 1);
+
+        m_visibleRows = rows;
+        m_clientFilter = true;
+
+        if (tail > 0)
+            endRemoveRows();
+    }
+
+    applyVisibleRows(matchingRows(rows));
+    enforceCacheBudget();
+}
+
+void CachedSqlTableModel::removeClientFilter()
+{
+    if (!m_clientFilter)
+        return;
+
+    QVector<int> rows(m_cache.count());
+    std::iota(rows.begin(), rows.end(), 0);
+    applyVisibleRows(rows);
+
+    const int tail = m_unfetchedRows;
+
+    if (tail > 0)
+        beginInsertRows(QModelIndex(), m_cache.count(), m_cache.count() + tail - 1);
+
+    m_clientFilter = false;
+    m_visibleRows.clear();
+
+    if (tail > 0)
+        endInsertRows();
+}
+
+void CachedSqlTableModel::applyVisibleRows(const QVector<int> &rows)
+{
+    //Hide rows missing from the new set, bottom up in contiguous view ranges so earlier ranges keep their positions
+    for (int i = m_visibleRows.count() - 1; i >= 0; --i) {
+        if (std::binary_search(rows.cbegin(), rows.cend(), m_visibleRows.at(i)))
+            continue;
+
+        const int last = i;
+
+        while (i > 0 && !std::binary_search(rows.cbegin(), rows.cend(), m_visibleRows.at(i - 1)))
+            --i;
+
+        beginRemoveRows(QModelIndex(), i, last);
+        m_visibleRows.remove(i, last - i + 1);
+        endRemoveRows();
+    }
+
+    //What is left is a subset of the new set, show the missing rows top down in contiguous view ranges
+    for (int i = 0; i < rows.count();) {
+        if (i < m_visibleRows.count() && m_visibleRows.at(i) == rows.at(i)) {
+            ++i;
+            continue;
+        }
+
+        //Every new row before the next already shown one goes in at this position
+        const int next = i < m_visibleRows.count() ? m_visibleRows.at(i) : std::numeric_limits<int>::max();
+        int end = i;
+
+        while (end < rows.count() && rows.at(end) < next)
+            ++end;
+
+        beginInsertRows(QModelIndex(), i, end - 1);
+        m_visibleRows.insert(i, end - i, 0);
+        std::copy(rows.cbegin() + i, rows.cbegin() + end, m_visibleRows.begin() + i);
+        endInsertRows();
+
+        i = end;
+    }
+}
+
+void CachedSqlTableModel::refilterRows(const QVector<int> &rows)
+{
+    //Keep every shown row that was not retested, then add back the retested rows that match
+    const QVector<int> matching = matchingRows(rows);
+    QVector<int> kept;
+    QVector<int> visible;
+
+    std::set_difference(m_visibleRows.cbegin(), m_visibleRows.cend(), rows.cbegin(), rows.cend(), std::back_inserter(kept));
+    std::set_union(kept.cbegin(), kept.cend(), matching.cbegin(), matching.cend(), std::back_inserter(visible));
+
+    if (visible != m_visibleRows)
+        applyVisibleRows(visible);
+}
+
+void CachedSqlTableModel::showAppendedRows(int first, int last)
+{
+    QVector<int> rows(last - first + 1);
+    std::iota(rows.begin(), rows.end(), first);
+
+    const QVector<int> matching = matchingRows(rows);
+
+    if (matching.isEmpty())
+        return;
+
+    const int shown = m_visibleRows.count();
+
+    beginInsertRows(QModelIndex(), shown, shown + matching.count() - 1);
+    m_visibleRows += matching;
+    endInsertRows();
+}
+
+void CachedSqlTableModel::setVersionColumn(const QString &name)
+{
+    m_versionColumn = name;
+    m_lastVersion.clear();
+
+    //Pick up the versions of the rows already cached
+    for (const CachedRow &cr : std::as_const(m_cache)) {
+        if (cr.op() != CachedRow::Insert && !cr.isEvicted()) {
+            CachedRowValues values;
+            values.reserve(cr.count());
+
+            for (int c = 0; c < cr.count(); ++c)
+                values.append(cr.value(c));
+
+            trackVersion(values);
+        }
+    }
+}
+
+QString CachedSqlTableModel::versionColumn() const
+{
+    return m_versionColumn;
+}
+
+void CachedSqlTableModel::trackVersion(const CachedRowValues &values)
+{
+    const int c = m_record.indexOf(m_versionColumn);
+
+    if (c == -1 || c >= values.count() || values.at(c).isNull())
+        return;
+
+    if (!m_lastVersion.isValid() || QVariant::compare(values.at(c), m_lastVersion) == QPartialOrdering::Greater)
+        m_lastVersion = values.at(c);
+}
+
+void CachedSqlTableModel::setFetchBatchSize(int size)
+{
+    if (size > 0)
+        m_fetchBatchSize = size;
+}
+
+int CachedSqlTableModel::fetchBatchSize() const
+{
+    return m_fetchBatchSize;
+}
+
+void CachedSqlTableModel::setAdaptiveFetch(bool enabled)
+{
+    m_adaptiveFetch = enabled;
+}
+
+bool CachedSqlTableModel::adaptiveFetch() const
+{
+    return m_adaptiveFetch;
+}
+
+void CachedSqlTableModel::setFetchBatchLimits(int minimum, int maximum)
+{
+    if (minimum <= 0 || maximum < minimum)
+        return;
+
+    m_minFetchBatchSize = minimum;
+    m_maxFetchBatchSize = maximum;
+}
+
+int CachedSqlTableModel::minimumFetchBatchSize() const
+{
+    return m_minFetchBatchSize;
+}
+
+int CachedSqlTableModel::maximumFetchBatchSize() const
+{
+    return m_maxFetchBatchSize;
+}
+
+void CachedSqlTableModel::setFetchTargetDuration(int msecs)
+{
+    if (msecs > 0)
+        m_fetchTargetDuration = msecs;
+}
+
+int CachedSqlTableModel::fetchTargetDuration() const
+{
+    return m_fetchTargetDuration;
+}
+
+void CachedSqlTableModel::adaptFetchBatchSize(qint64 nsecs, int rows)
+{
+    if (!m_adaptiveFetch || rows <= 0)
+        return;
+
+    //Size the next batch so that it takes the target duration at the cost per row just measured
+    const double perRow = qMax(1.0, double(nsecs) / rows);
+    const double target = m_fetchTargetDuration * 1000000.0 / perRow;
+
+    //Change by at most a factor of two per batch so a single outlier does not swing the size
+    int size = int(qBound(m_fetchBatchSize / 2.0, target, m_fetchBatchSize * 2.0));
+    size = qBound(m_minFetchBatchSize, size, m_maxFetchBatchSize);
+
+    if (size == m_fetchBatchSize)
+        return;
+
+    m_fetchBatchSize = size;
+    emit fetchBatchSizeChanged(size);
+}
+
+void CachedSqlTableModel::sort(int column, Qt::SortOrder order)
+{
+    sort(QList<CachedSqlSortColumn>{{column, order}});
+}
+
+void CachedSqlTableModel::sort(const QList<CachedSqlSortColumn> &columns)
+{
+    if (columns.isEmpty())
+        return;
+
+    //Sorting moves rows, which would invalidate the rows an asynchronous submit reports back on
+    if (isSubmitting())
+        return;
+
+    CachedSqlScopedTimer statsTimer(statsHistogram(m_stats.sortTime), "sort");
+
+    for (const CachedSqlSortColumn &sortColumn : columns) {
+        if (sortColumn.column < 0 || sortColumn.column >= m_record.count())
+            return;
+    }
+
+    //While the query is not exhausted or rows have been evicted only part of the result is cached, let the server order the full result instead.
+    //A stored procedure call cannot take an ORDER BY, its rows are always sorted in the cache
+    if (isComposable() && (m_sortMode == ServerSort || (m_sortMode == AutoSort && (!m_queryExhausted || m_evictedCount > 0)))) {
+        m_sortFields.clear();
+
+        for (const CachedSqlSortColumn &sortColumn : columns)
+            m_sortFields.append({m_record.fieldName(sortColumn.column), sortColumn.order});
+
+        requery(pendingRows());
+        return;
+    }
+
+    if (m_cache.isEmpty())
+        return;
+
+    //A forced client sort needs every value, read back evicted rows first
+    if (m_evictedCount > 0 && !loadRows(0, m_cache.count() - 1))
+        return;
+
+    //The cache order is now the client sort, a later requery must not bring back an earlier server order
+    m_sortFields.clear();
+
+    for (const CachedSqlSortColumn &sortColumn : columns)
+        m_sortFields.append({m_record.fieldName(sortColumn.column), sortColumn.order});
+
+    //Sort a permutation over pre-extracted keys, then move every row once into its new position
+    m_floatingRows = 0;
+    applyRowOrder(CachedSqlSorter::sort(m_cache, m_record, columns));
+
+    enforceCacheBudget();
+}
+
+void CachedSqlTableModel::applyRowOrder(const QVector<int> &order)
+{
+    //Search indexes and aggregates follow the rows, bring them up to date before the rows move
+    syncRowIndexes();
+
+    //An export walks the cache in order, it cannot follow the rows to their new positions
+    abandonExport();
+
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+
+    const QVector<int> visibleRows = m_visibleRows;
+
+    QVector<int> newRows(order.count());
+    CacheVec sorted;
+    sorted.reserve(m_cache.count());
+
+    for (int row = 0; row < order.count(); ++row) {
+        sorted.append(std::move(m_cache[order.at(row)]));
+        newRows[order.at(row)] = row;
+    }
+
+    m_cache.swap(sorted);
+
+    for (CachedSqlSearchIndex &index : m_searchIndexes)
+        index.permute(newRows);
+
+    for (CachedSqlAggregate &aggregate : m_aggregates)
+        aggregate.permute(newRows);
+
+    //Move the key index with the rows. With duplicate keys the first of them may have changed, find it again on the next lookup
+    if (m_duplicateKeys) {
+        invalidateKeyIndex();
+    } else {
+        for (auto it = m_keyIndex.begin(); it != m_keyIndex.end(); ++it)
+            it.value() = newRows.at(it.value());
+    }
+
+    //Rows have moved, map the dirty rows to their new positions
+    std::set<int> dirtyRows;
+    for (int row : m_dirtyRows)
+        dirtyRows.insert(newRows.at(row));
+    m_dirtyRows.swap(dirtyRows);
+
+    if (m_cacheBudget > 0) {
+        std::set<int> residentRows;
+        for (int row : m_residentRows)
+            residentRows.insert(newRows.at(row));
+        m_residentRows.swap(residentRows);
+    }
+
+    //The filtered rows stay the same, shown in their new order
+    if (m_clientFilter) {
+        for (int &row : m_visibleRows)
+            row = newRows.at(row);
+        std::sort(m_visibleRows.begin(), m_visibleRows.end());
+    }
+
+    //Keep persistent indexes (selection, current index) on the rows they referred to
+    const QModelIndexList from = persistentIndexList();
+    QModelIndexList to;
+    to.reserve(from.count());
+
+    for (const QModelIndex &idx : from) {
+        const int row = m_clientFilter ? visibleRows.at(idx.row()) : idx.row();
+
+        //Rows of the counted tail are not cached yet and do not move
+        if (row >= newRows.count()) {
+            to.append(idx);
+            continue;
+        }
+
+        to.append(index(viewRow(newRows.at(row)), idx.column()));
+    }
+
+    changePersistentIndexList(from, to);
+
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
+
+void CachedSqlTableModel::floatPinnedRows(int count)
+{
+    //Pinned rows are put at the top, under a server sort move them to where the sorted result puts them as it is fetched
+    m_floatingRows = m_sortFields.isEmpty() ? 0 : count;
+    placePinnedRows(m_floatingRows);
+}
+
+void CachedSqlTableModel::placePinnedRows(int first)
+{
+    if (m_floatingRows == 0 || m_sortFields.isEmpty())
+        return;
+
+    QList<CachedSqlSortColumn> columns;
+
+    for (const auto &sortField : std::as_const(m_sortFields)) {
+        const int column = m_record.indexOf(sortField.first);
+
+        if (column != -1)
+            columns.append({column, sortField.second});
+    }
+
+    if (columns.isEmpty()) {
+        m_floatingRows = 0;
+        return;
+    }
+
+    //Only the rows fetched from first on are new to the waiting rows, every row before them sorts ahead of all waiting rows
+    first = qMax(first, m_floatingRows);
+
+    if (m_evictedCount > 0 && first < m_cache.count() && !loadRows(first, m_cache.count() - 1))
+        return;
+
+    CacheVec rows;
+    QVector<int> source;   //Position in rows -> cache row
+
+    for (int row = 0; row < m_floatingRows; ++row) {
+        rows.append(m_cache.at(row));
+        source.append(row);
+    }
+
+    for (int row = first; row < m_cache.count(); ++row) {
+        rows.append(m_cache.at(row));
+        source.append(row);
+    }
+
+    //The sort is stable, a waiting row goes ahead of a fetched row it ties with
+    const QVector<int> merged = CachedSqlSorter::sort(rows, m_record, columns);
+
+    //Waiting rows that sort after the last fetched row keep waiting for the result to reach them, once it is drained they go last
+    int placed = merged.count();
+
+    if (!m_queryExhausted) {
+        while (placed > 0 && merged.at(placed - 1) < m_floatingRows)
+            --placed;
+    }
+
+    QVector<int> waiting;
+
+    for (int i = placed; i < merged.count(); ++i)
+        waiting.append(source.at(merged.at(i)));
+
+    if (waiting.count() == m_floatingRows)
+        return;
+
+    QVector<int> order;
+    order.reserve(m_cache.count());
+    order += waiting;
+
+    for (int row = m_floatingRows; row < first; ++row)
+        order.append(row);
+
+    for (int i = 0; i < placed; ++i)
+        order.append(source.at(merged.at(i)));
+
+    m_floatingRows = waiting.count();
+    applyRowOrder(order);
+}
+
+void CachedSqlTableModel::setFetchMode(FetchMode mode)
+{
+    if (mode == m_fetchMode)
+        return;
+
+    //The worker would open an empty database, keep fetching on this thread
+    if (mode == FetchInBackground && !canCloneConnection()) {
+        m_error = QSqlError("Background fetching needs a connection other threads can open, an in-memory SQLite database is private to its connection",
+                            QString(), QSqlError::ConnectionError);
+        emit errorOccurred(m_error);
+        return;
+    }
+
+    //Switching modes abandons any result set that is still being streamed
+    stopFetchWorker();
+    m_fetchMode = mode;
+
+    //The rows fetched so far were read by the previous mode, the new one has no position to continue from. Query again rather than
+    //starting over behind the cached rows
+    if (!m_record.isEmpty() && !m_queryExhausted)
+        requery(pendingRows());
+}
+
+CachedSqlTableModel::FetchMode CachedSqlTableModel::fetchMode() const
+{
+    return m_fetchMode;
+}
+
+bool CachedSqlTableModel::isFetching() const
+{
+    return m_fetchWorker && !m_queryExhausted;
+}
+
+void CachedSqlTableModel::cancelFetch()
+{
+    if (!m_fetchWorker)
+        return;
+
+    //Keep the rows fetched so far and stop offering more
+    stopFetchWorker();
+    m_queryExhausted = true;
+    resizeUnfetchedRows(0);
+    emit fetchCanceled();
+}
+
+void CachedSqlTableModel::setRecord(const QSqlRecord &record)
+{
+    m_record = record;
+    m_autoColumn.clear();
+
+    //Prepared statements bind by the old column layout
+    m_statements.clear();
+
+    //Force NULL values for base record to allow setData generated flags to accurately track updates. Certain types (i.e. INT, BOOL) default to non-NULL values (i.e. INT, BOOL)
+    for (int i = 0; i < m_record.count(); ++i) {
+        m_record.setValue(i, QVariant());
+    }
+
+    //Search for any auto incremented fields and save the result if one exists
+    for (int i = 0; i < m_record.count(); ++i) {
+        if (m_record.field(i).isAutoValue()) {
+            m_autoColumn = m_record.fieldName(i);
+            break;
+        }
+    }
+
+    //Resolve the key columns the same way primaryValues() does, falling back to the full record without a primary index
+    m_keyColumns.clear();
+    const QSqlRecord &pIndex = m_primaryIndex.isEmpty() ? m_record : m_primaryIndex;
+
+    for (int i = 0; i < pIndex.count(); ++i) {
+        const int c = m_record.indexOf(pIndex.fieldName(i));
+
+        if (c == -1) {
+            m_keyColumns.clear();
+            break;
+        }
+
+        m_keyColumns.append(c);
+    }
+
+    invalidateKeyIndex();
+}
+
+void CachedSqlTableModel::startFetchWorker(const QString &stmt)
+{
+    stopFetchWorker();
+
+    //Results of a previous worker that are still queued are discarded by comparing generations
+    const int generation = ++m_fetchGeneration;
+
+    m_fetchThread = new QThread;
+    m_fetchWorker = new CachedSqlFetchWorker(m_db.connectionName());
+    m_fetchWorker->moveToThread(m_fetchThread);
+
+    //Both objects clean themselves up once the thread's event loop exits
+    connect(m_fetchThread, &QThread::finished, m_fetchWorker, &QObject::deleteLater);
+    connect(m_fetchThread, &QThread::finished, m_fetchThread, &QObject::deleteLater);
+
+    connect(m_fetchWorker, &CachedSqlFetchWorker::opened, this, [this, generation](const QSqlRecord &record) {
+        if (generation == m_fetchGeneration)
+            fetchWorkerOpened(record);
+    });
+    connect(m_fetchWorker, &CachedSqlFetchWorker::fetched, this, [this, generation](const QVector<CachedRowValues> &rows, bool exhausted) {
+        if (generation == m_fetchGeneration)
+            fetchWorkerFetched(rows, exhausted);
+    });
+    connect(m_fetchWorker, &CachedSqlFetchWorker::errorOccurred, this, [this, generation](const QSqlError &error) {
+        if (generation != m_fetchGeneration)
+            return;
+
+        m_error = error;
+        m_queryExhausted = true;
+        stopFetchWorker();
+        resizeUnfetchedRows(0);
+        emit errorOccurred(m_error);
+    });
+
+    m_fetchThread->start();
+
+    CachedSqlFetchWorker *worker = m_fetchWorker;
+    QMetaObject::invokeMethod(worker, [worker, stmt]() { worker->open(stmt); }, Qt::QueuedConnection);
+}
+
+void CachedSqlTableModel::stopFetchWorker()
+{
+    if (!m_fetchThread)
+        return;
+
+    //Invalidate anything still queued from this worker, then let the thread wind down on its own
+    ++m_fetchGeneration;
+    m_fetchWorker->cancel();
+    m_fetchThread->quit();
+
+    m_fetchThread = nullptr;
+    m_fetchWorker = nullptr;
+    m_fetchPending = false;
+}
+
+void CachedSqlTableModel::fetchWorkerOpened(const QSqlRecord &record)
+{
+    //A statement without columns has no rows to fetch, treat it as exhausted rather than waiting on batches that are never requested
+    if (record.isEmpty()) {
+        m_queryExhausted = true;
+        stopFetchWorker();
+        resizeUnfetchedRows(0);
+        emit fetchFinished();
+        return;
+    }
+
+    //The column layout is only known once the worker has executed the statement
+    beginInsertColumns(QModelIndex(), 0, record.count() - 1);
+    setRecord(record);
+    endInsertColumns();
+
+    //Fetch the first batch of data
+    fetchMore();
+}
+
+void CachedSqlTableModel::fetchWorkerFetched(const QVector<CachedRowValues> &rows, bool exhausted)
+{
+    m_fetchPending = false;
+
+    //Append the decoded batch and notify view, only this part runs on the model's thread and is worth timing
+    {
+        CachedSqlScopedTimer statsTimer(statsHistogram(m_stats.fetchTime), "fetchMore");
+        QElapsedTimer timer;
+        timer.start();
+
+        appendFetchedRows(rows);
+        adaptFetchBatchSize(timer.nsecsElapsed(), rows.count());
+    }
+
+    emit fetchProgress(m_fetchedCount);
+
+    //Handle query exhaustion, the worker has already released its cursor
+    if (exhausted) {
+        m_queryExhausted = true;
+        stopFetchWorker();
+        resizeUnfetchedRows(0);
+        emit fetchFinished();
+        return;
+    }
+
+    //Keep streaming while data() is waiting on a row further down
+    if (m_fetchUntilRow >= 0)
+        fetchUnfetchedRows();
+}
+
+void CachedSqlTableModel::requestWorkerBatch(int count)
+{
+    if (!m_fetchWorker || m_fetchPending || m_queryExhausted || m_record.isEmpty())
+        return;
+
+    m_fetchPending = true;
+    CachedSqlFetchWorker *worker = m_fetchWorker;
+    QMetaObject::invokeMethod(worker, [worker, count]() { worker->fetch(count); }, Qt::QueuedConnection);
+}
+
+void CachedSqlTableModel::setStatementCacheSize(int size)
+{
+    m_statements.setCapacity(size);
+}
+
+int CachedSqlTableModel::statementCacheSize() const
+{
+    return m_statements.capacity();
+}
+
+quint64 CachedSqlTableModel::statementCacheHits() const
+{
+    return m_statements.hits();
+}
+
+quint64 CachedSqlTableModel::statementCacheMisses() const
+{
+    return m_statements.misses();
+}
+
+void CachedSqlTableModel::setSearchIndexed(int column, bool enabled)
+{
+    if (!enabled) {
+        m_searchIndexes.remove(column);
+        return;
+    }
+
+    if (column < 0 || column >= m_record.count() || m_searchIndexes.contains(column))
+        return;
+
+    //The index is built from the values, read back evicted rows first
+    if (m_evictedCount > 0 && !m_cache.isEmpty())
+        loadRows(0, m_cache.count() - 1);
+
+    m_searchIndexes.insert(column, CachedSqlSearchIndex());
+    syncSearchIndexes();
+    enforceCacheBudget();
+}
+
+bool CachedSqlTableModel::isSearchIndexed(int column) const
+{
+    return m_searchIndexes.contains(column);
+}
+
+QVector<int> CachedSqlTableModel::findRows(int column, const QString &text, Qt::MatchFlags flags) const
+{
+    QVector<int> rows;
+
+    if (column < 0 || column >= m_record.count())
+        return rows;
+
+    CachedSqlSearchIndex::MatchType type;
+    const bool caseSensitive = flags.testFlag(Qt::MatchCaseSensitive) || (flags & Qt::MatchTypeMask).toInt() == Qt::MatchExactly;
+
+    //Without an index, or for match types it cannot answer, look through the rows the way QAbstractItemModel::match() does
+    if (!m_searchIndexes.contains(column) || !searchMatchType(flags, type)) {
+        const QModelIndexList found = QAbstractTableModel::match(index(0, column), Qt::DisplayRole, text, -1, flags & ~Qt::MatchFlags(Qt::MatchWrap));
+
+        for (const QModelIndex &idx : found)
+            rows.append(idx.row());
+
+        return rows;
+    }
+
+    syncSearchIndexes();
+
+    //The index keeps the text as given next to the folded one, a case sensitive search needs no values from the cache, evicted rows included
+    for (int row : m_searchIndexes.find(column).value().find(text, type, caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive)) {
+        const int shown = viewRow(row);
+
+        if (shown != -1)
+            rows.append(shown);
+    }
+
+    return rows;
+}
+
+QModelIndexList CachedSqlTableModel::match(const QModelIndex &start, int role, const QVariant &value, int hits, Qt::MatchFlags flags) const
+{
+    CachedSqlSearchIndex::MatchType type;
+
+    //Only plain text matches on an indexed column are answered from the index
+    if (!start.isValid() || (role != Qt::DisplayRole && role != Qt::EditRole) || !m_searchIndexes.contains(start.column())
+        || !searchMatchType(flags, type) || (type == CachedSqlSearchIndex::Exactly && value.typeId() != QMetaType::QString))
+        return QAbstractTableModel::match(start, role, value, hits, flags);
+
+    const QVector<int> rows = findRows(start.column(), value.toString(), flags);
+    const auto from = std::lower_bound(rows.cbegin(), rows.cend(), start.row());
+    QModelIndexList result;
+
+    //From the start row down, then from the top if wrapping
+    for (auto it = from; it != rows.cend() && (hits == -1 || result.count() < hits); ++it)
+        result.append(index(*it, start.column()));
+
+    if (flags.testFlag(Qt::MatchWrap)) {
+        for (auto it = rows.cbegin(); it != from && (hits == -1 || result.count() < hits); ++it)
+            result.append(index(*it, start.column()));
+    }
+
+    return result;
+}
+
+void CachedSqlTableModel::syncSearchIndexes() const
+{
+    for (auto it = m_searchIndexes.begin(); it != m_searchIndexes.end(); ++it) {
+        CachedSqlSearchIndex &index = it.value();
+
+        if (index.count() > m_cache.count())
+            index.clear();
+
+        for (int row = index.count(); row < m_cache.count(); ++row)
+            index.append(m_cache.at(row).value(it.key()).toString());
+    }
+}
+
+void CachedSqlTableModel::syncRowIndexes()
+{
+    syncSearchIndexes();
+
+    for (auto it = m_aggregates.begin(); it != m_aggregates.end(); ++it) {
+        CachedSqlAggregate &aggregate = it.value();
+        bool changed = false;
+
+        for (int row = aggregate.count(); row < m_cache.count(); ++row) {
+            const CachedRow &cr = m_cache.at(row);
+            changed = aggregate.append(cr.value(aggregate.column()), cr.value(aggregate.groupColumn()), cr.op() != CachedRow::Delete) || changed;
+        }
+
+        if (changed)
+            markAggregateChanged(it.key());
+    }
+}
+
+void CachedSqlTableModel::updateRowIndexes(int row)
+{
+    //Evicted rows have no values to look at, they keep what they had
+    if (row < 0 || row >= m_cache.count() || m_cache.at(row).isEvicted())
+        return;
+
+    const CachedRow &cr = m_cache.at(row);
+
+    for (auto it = m_searchIndexes.begin(); it != m_searchIndexes.end(); ++it)
+        it.value().set(row, cr.value(it.key()).toString());
+
+    //Staged deletes drop out of the aggregates, reverting them brings them back
+    for (auto it = m_aggregates.begin(); it != m_aggregates.end(); ++it) {
+        CachedSqlAggregate &aggregate = it.value();
+
+        if (aggregate.set(row, cr.value(aggregate.column()), cr.value(aggregate.groupColumn()), cr.op() != CachedRow::Delete))
+            markAggregateChanged(it.key());
+    }
+}
+
+int CachedSqlTableModel::addAggregate(int column, CachedSqlAggregate::Function function, int groupColumn)
+{
+    if (column < 0 || column >= m_record.count() || groupColumn < -1 || groupColumn >= m_record.count())
+        return -1;
+
+    //The aggregate starts from the values, read back evicted rows first
+    if (m_evictedCount > 0 && !m_cache.isEmpty())
+        loadRows(0, m_cache.count() - 1);
+
+    const int id = m_nextAggregateId++;
+    m_aggregates.insert(id, CachedSqlAggregate(column, function, groupColumn));
+    syncRowIndexes();
+    enforceCacheBudget();
+
+    return id;
+}
+
+void CachedSqlTableModel::removeAggregate(int id)
+{
+    m_aggregates.remove(id);
+    m_changedAggregates.remove(id);
+}
+
+QVariant CachedSqlTableModel::aggregate(int id) const
+{
+    const auto it = m_aggregates.constFind(id);
+    return it == m_aggregates.cend() ? QVariant() : it.value().result();
+}
+
+QVariant CachedSqlTableModel::aggregate(int id, const QVariant &group) const
+{
+    const auto it = m_aggregates.constFind(id);
+    return it == m_aggregates.cend() ? QVariant() : it.value().result(group);
+}
+
+QVariantList CachedSqlTableModel::aggregateGroups(int id) const
+{
+    const auto it = m_aggregates.constFind(id);
+    return it == m_aggregates.cend() ? QVariantList() : it.value().groups();
+}
+
+void CachedSqlTableModel::markAggregateChanged(int id)
+{
+    //A burst of edits ends up as one signal per aggregate once control returns to the event loop
+    if (m_changedAggregates.isEmpty())
+        QMetaObject::invokeMethod(this, &CachedSqlTableModel::emitAggregateChanges, Qt::QueuedConnection);
+
+    m_changedAggregates.insert(id);
+}
+
+void CachedSqlTableModel::emitAggregateChanges()
+{
+    const QSet<int> ids = std::exchange(m_changedAggregates, QSet<int>());
+
+    for (int id : ids) {
+        if (m_aggregates.contains(id))
+            emit aggregateChanged(id);
+    }
+}
+
+bool CachedSqlTableModel::searchMatchType(Qt::MatchFlags flags, CachedSqlSearchIndex::MatchType &type)
+{
+    switch ((flags & Qt::MatchTypeMask).toInt()) {
+        case Qt::MatchExactly:
+        case Qt::MatchFixedString:
+            type = CachedSqlSearchIndex::Exactly;
+            return true;
+        case Qt::MatchContains:
+            type = CachedSqlSearchIndex::Contains;
+            return true;
+        case Qt::MatchStartsWith:
+            type = CachedSqlSearchIndex::StartsWith;
+            return true;
+        default:
+            return false;
+    }
+}
+
+int CachedSqlTableModel::rowForKey(const QSqlRecord &key) const
+{
+    if (m_keyColumns.isEmpty())
+        return -1;
+
+    //Pick the key values out of the given record by field name, in key column order
+    CachedRowValues values;
+    values.reserve(m_keyColumns.count());
+
+    for (int c : m_keyColumns) {
+        const int i = key.indexOf(m_record.fieldName(c));
+
+        if (i == -1)
+            return -1;
+
+        values.append(key.value(i));
+    }
+
+    //The index is built on the first lookup after a reset and then kept up to date as rows change
+    if (!m_keyIndexValid)
+        rebuildKeyIndex();
+
+    const int row = m_keyIndex.value(CachedRowKey(values), -1);
+    return row == -1 ? -1 : viewRow(row);
+}
+
+QModelIndex CachedSqlTableModel::indexForKey(const QSqlRecord &key, int column) const
+{
+    const int row = rowForKey(key);
+
+    if (row == -1)
+        return QModelIndex();
+
+    return index(row, column);
+}
+
+void CachedSqlTableModel::indexRows(int first, int last)
+{
+    //Only maintain an index that has been built, otherwise the next lookup builds it
+    if (!m_keyIndexValid)
+        return;
+
+    for (int row = first; row <= last; ++row) {
+        const CachedRowKey key = m_cache.at(row).key(m_keyColumns);
+
+        if (key.isNull())
+            continue;
+
+        if (m_keyIndex.contains(key))
+            m_duplicateKeys = true;
+        else
+            m_keyIndex.insert(key, row);
+    }
+}
+
+void CachedSqlTableModel::rekeyRow(int row, const CachedRowKey &before)
+{
+    //Inserted rows get their key on submit and updates may change it
+    const CachedRowKey after = m_cache.at(row).key(m_keyColumns);
+
+    if (!m_keyIndexValid || after == before)
+        return;
+
+    if (!before.isNull() && m_keyIndex.value(before, -1) == row) {
+        //Another row may hold the old key too, only a rebuild finds it
+        if (m_duplicateKeys) {
+            invalidateKeyIndex();
+            return;
+        }
+
+        m_keyIndex.remove(before);
+    }
+
+    if (after.isNull())
+        return;
+
+    const int other = m_keyIndex.value(after, -1);
+
+    if (other != -1)
+        m_duplicateKeys = true;
+
+    if (other == -1 || row < other)
+        m_keyIndex.insert(after, row);
+}
+
+void CachedSqlTableModel::invalidateKeyIndex()
+{
+    m_keyIndex.clear();
+    m_keyIndexValid = false;
+    m_duplicateKeys = false;
+}
+
+void CachedSqlTableModel::rebuildKeyIndex() const
+{
+    m_keyIndex.clear();
+    m_keyIndex.reserve(m_cache.count());
+    m_duplicateKeys = false;
+
+    //Walk backwards so the first row wins when keys are not unique
+    for (int row = m_cache.count() - 1; row >= 0; --row) {
+        const CachedRowKey key = m_cache.at(row).key(m_keyColumns);
+
+        if (key.isNull())
+            continue;
+
+        if (m_keyIndex.contains(key))
+            m_duplicateKeys = true;
+
+        m_keyIndex.insert(key, row);
+    }
+
+    m_keyIndexValid = true;
+}
+
+void CachedSqlTableModel::shiftRows(int first, int delta)
+{
+    //A row inserted or removed among the waiting pinned rows ends the wait, they stay where they are
+    if (qMin(first, first + delta) < m_floatingRows)
+        m_floatingRows = 0;
+
+    shiftRows(m_dirtyRows, first, delta);
+    shiftRows(m_residentRows, first, delta);
+
+    //Keep the export cursor and end on the same rows, rows inserted behind the cursor are not part of the export
+    if (m_exportWorker) {
+        auto shift = [first, delta](int &row) {
+            if (delta > 0 && first < row)
+                row += delta;
+            else if (delta < 0)
+                row = row >= first ? row + delta : qMin(row, first + delta);
+        };
+
+        shift(m_exportRow);
+        shift(m_exportEnd);
+    }
+
+    //Patch the key index rather than rebuilding it, removed rows drop out and the rows behind them move along
+    if (m_keyIndexValid && delta < 0 && m_duplicateKeys) {
+        //A removed row may have been the first of several with its key, only a rebuild finds the next one
+        invalidateKeyIndex();
+    } else if (m_keyIndexValid) {
+        for (auto it = m_keyIndex.begin(); it != m_keyIndex.end();) {
+            if (it.value() >= first) {
+                it.value() += delta;
+                ++it;
+            } else if (it.value() >= first + delta) {
+                it = m_keyIndex.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    for (CachedSqlSearchIndex &index : m_searchIndexes) {
+        if (delta > 0)
+            index.insert(first, delta);
+        else
+            index.remove(first + delta, -delta);
+    }
+
+    for (auto it = m_aggregates.begin(); it != m_aggregates.end(); ++it) {
+        if (delta > 0)
+            it.value().insert(first, delta);
+        else if (it.value().remove(first + delta, -delta))
+            markAggregateChanged(it.key());
+    }
+
+    if (m_clientFilter) {
+        if (delta < 0)
+            m_visibleRows.erase(std::lower_bound(m_visibleRows.begin(), m_visibleRows.end(), first + delta), std::lower_bound(m_visibleRows.begin(), m_visibleRows.end(), first));
+
+        for (auto it = std::lower_bound(m_visibleRows.begin(), m_visibleRows.end(), first); it != m_visibleRows.end(); ++it)
+            *it += delta;
+    }
+}
+
+void CachedSqlTableModel::shiftRows(std::set<int> &rows, int first, int delta)
+{
+    //A negative delta means the rows in [first + delta, first) have been removed
+    if (delta < 0)
+        rows.erase(rows.lower_bound(first + delta), rows.lower_bound(first));
+
+    //Move every row index at or after first by delta, rows before first keep their position
+    const auto it = rows.lower_bound(first);
+    const QVector<int> tail(it, rows.end());
+
+    rows.erase(it, rows.end());
+
+    for (int row : tail)
+        rows.insert(rows.end(), row + delta);
+}
+
+void CachedSqlTableModel::setSortMode(SortMode mode)
+{
+    m_sortMode = mode;
+}
+
+CachedSqlTableModel::SortMode CachedSqlTableModel::sortMode() const
+{
+    return m_sortMode;
+}
+
+void CachedSqlTableModel::setCacheBudget(qint64 budget, CacheBudgetUnit unit)
+{
+    m_cacheBudget = qMax<qint64>(0, budget);
+    m_cacheBudgetUnit = unit;
+
+    //Resident rows are only tracked while a budget is set, evicted rows are still read back on access after it is lifted
+    m_residentRows.clear();
+
+    if (m_cacheBudget == 0)
+        return;
+
+    for (int row = 0; row < m_cache.count(); ++row) {
+        if (!m_cache.at(row).isEvicted())
+            m_residentRows.insert(m_residentRows.end(), row);
+    }
+
+    enforceCacheBudget();
+}
+
+qint64 CachedSqlTableModel::cacheBudget() const
+{
+    return m_cacheBudget;
+}
+
+CachedSqlTableModel::CacheBudgetUnit CachedSqlTableModel::cacheBudgetUnit() const
+{
+    return m_cacheBudgetUnit;
+}
+
+int CachedSqlTableModel::residentRowCount() const
+{
+    return m_cache.count() - m_evictedCount;
+}
+
+void CachedSqlTableModel::setRowCountMode(RowCountMode mode)
+{
+    if (mode == m_rowCountMode)
+        return;
+
+    m_rowCountMode = mode;
+
+    //Going back to fetched counting drops the counted tail, a count takes effect with the next select()
+    if (mode == FetchedRowCount) {
+        ++m_countGeneration;
+        resizeUnfetchedRows(0);
+    }
+}
+
+CachedSqlTableModel::RowCountMode CachedSqlTableModel::rowCountMode() const
+{
+    return m_rowCountMode;
+}
+
+qint64 CachedSqlTableModel::totalRowCount() const
+{
+    return m_totalRowCount;
+}
+
+bool CachedSqlTableModel::saveSnapshot(const QString &path)
+{
+    if (m_record.isEmpty()) {
+        m_error = QSqlError("Nothing to snapshot", QString(), QSqlError::StatementError);
+        emit errorOccurred(m_error);
+        return false;
+    }
+
+    CachedSqlSnapshot snapshot;
+    snapshot.tableName = m_tableName;
+    snapshot.selectStatement = m_select;
+    snapshot.filter = effectiveFilter();
+    snapshot.record = m_record;
+    snapshot.primaryIndex = m_primaryIndex;
+    snapshot.versionColumn = m_versionColumn;
+
+    //Only rows matching the database are stored, pending changes and evicted rows are left to the refresh after loading
+    snapshot.rows.reserve(m_cache.count() - int(m_dirtyRows.size()) - m_evictedCount);
+
+    const int versionColumn = m_record.indexOf(m_versionColumn);
+    QVariant lastVersion;
+
+    for (const CachedRow &cr : std::as_const(m_cache)) {
+        if (cr.op() != CachedRow::None || !cr.submitted() || cr.isEvicted())
+            continue;
+
+        CachedRowValues values(cr.count());
+
+        for (int c = 0; c < cr.count(); ++c)
+            values[c] = cr.value(c);
+
+        if (versionColumn != -1 && !values.at(versionColumn).isNull()
+            && (!lastVersion.isValid() || QVariant::compare(values.at(versionColumn), lastVersion) == QPartialOrdering::Greater))
+            lastVersion = values.at(versionColumn);
+
+        snapshot.rows.append(values);
+    }
+
+    //Rows left out may be older than every row written, a version filter would never read them back.
+    //Only a snapshot of the whole result keeps a version, a partial one makes the refresh after loading compare keys instead
+    const bool complete = snapshot.rows.count() == m_cache.count() && m_queryExhausted && m_unfetchedRows == 0;
+    snapshot.lastVersion = complete ? lastVersion : QVariant();
+
+    QString error;
+
+    if (!snapshot.write(path, error)) {
+        m_error = QSqlError(error, QString(), QSqlError::UnknownError);
+        emit errorOccurred(m_error);
+        return false;
+    }
+
+    return true;
+}
+
+bool CachedSqlTableModel::loadSnapshot(const QString &path, bool refreshAfterLoad)
+{
+    if (isSubmitting())
+        return false;
+
+    CachedSqlSnapshot snapshot;
+    QString error;
+
+    if (!snapshot.read(path, error)) {
+        m_error = QSqlError(error, QString(), QSqlError::UnknownError);
+        emit errorOccurred(m_error);
+        return false;
+    }
+
+    //A snapshot of another result, or of a table whose columns have changed since, would show the wrong rows
+    bool stale = !snapshot.matches(m_tableName, m_select, effectiveFilter());
+
+    if (!stale && m_select.isEmpty() && m_db.isOpen()) {
+        const QSqlRecord live = m_db.record(m_tableName);
+        stale = live.count() != snapshot.record.count();
+
+        for (int i = 0; !stale && i < live.count(); ++i)
+            stale = live.fieldName(i) != snapshot.record.fieldName(i);
+    }
+
+    if (stale) {
+        m_error = QSqlError("Snapshot does not match the model's table, statement or filter", QString(), QSqlError::StatementError);
+        emit errorOccurred(m_error);
+        return false;
+    }
+
+    stopFetchWorker();
+
+    beginResetModel();
+    m_selectQuery = QSqlQuery(m_db);
+    resetCache(CacheVec(), QSet<CachedRowKey>());
+
+    if (!snapshot.primaryIndex.isEmpty())
+        m_primaryIndex = snapshot.primaryIndex;
+
+    setRecord(snapshot.record);
+
+    m_cache.reserve(snapshot.rows.count());
+
+    for (const CachedRowValues &values : std::as_const(snapshot.rows))
+        m_cache.append(CachedRow(CachedRow::None, values));
+
+    if (m_cacheBudget > 0) {
+        for (int row = 0; row < m_cache.count(); ++row)
+            m_residentRows.insert(m_residentRows.end(), row);
+    }
+
+    if (m_clientFilter) {
+        QVector<int> rows(m_cache.count());
+        std::iota(rows.begin(), rows.end(), 0);
+        m_visibleRows = matchingRows(rows);
+    }
+
+    if (snapshot.versionColumn == m_versionColumn)
+        m_lastVersion = snapshot.lastVersion;
+
+    //There is no cursor behind the rows, the refresh below adds whatever the snapshot missed
+    m_fetchedCount = m_cache.count();
+    m_queryExhausted = true;
+    endResetModel();
+
+    syncRowIndexes();
+    enforceCacheBudget();
+
+    //Show the snapshot first and validate it against the database on a worker, only merging the differences costs this thread. A
+    //private database can only be read on this connection
+    if (refreshAfterLoad && canCloneConnection())
+        startRefreshWorker();
+    else if (refreshAfterLoad)
+        QMetaObject::invokeMethod(this, [this]() { refresh(); }, Qt::QueuedConnection);
+
+    return true;
+}
+
+bool CachedSqlTableModel::setLiveUpdates(bool enabled)
+{
+    if (enabled == m_liveUpdates)
+        return true;
+
+    if (!enabled) {
+        stopLiveUpdates();
+        return true;
+    }
+
+    return startLiveUpdates();
+}
+
+bool CachedSqlTableModel::liveUpdates() const
+{
+    return m_liveUpdates;
+}
+
+void CachedSqlTableModel::setLiveUpdateChannel(const QString &channel)
+{
+    if (channel == m_liveChannel)
+        return;
+
+    //Resubscribe on the new channel
+    const bool live = m_liveUpdates;
+    stopLiveUpdates();
+    m_liveChannel = channel;
+
+    if (live)
+        startLiveUpdates();
+}
+
+QString CachedSqlTableModel::liveUpdateChannel() const
+{
+    return m_liveChannel.isEmpty() ? m_tableName : m_liveChannel;
+}
+
+void CachedSqlTableModel::setLiveUpdateInterval(int msecs)
+{
+    m_livePollTimer.setInterval(qMax(1, msecs));
+}
+
+int CachedSqlTableModel::liveUpdateInterval() const
+{
+    return m_livePollTimer.interval();
+}
+
+void CachedSqlTableModel::setLiveUpdateDelay(int msecs)
+{
+    m_liveDelayTimer.setInterval(qMax(0, msecs));
+}
+
+int CachedSqlTableModel::liveUpdateDelay() const
+{
+    return m_liveDelayTimer.interval();
+}
+
+void CachedSqlTableModel::setLiveProbeInterval(int msecs)
+{
+    m_liveProbeInterval = qMax(0, msecs);
+}
+
+int CachedSqlTableModel::liveProbeInterval() const
+{
+    return m_liveProbeInterval;
+}
+
+bool CachedSqlTableModel::startLiveUpdates()
+{
+    QSqlDriver *driver = m_db.driver();
+
+    if (!m_db.isOpen() || !driver) {
+        m_error = QSqlError("Database not open", QString(), QSqlError::ConnectionError);
+        emit errorOccurred(m_error);
+        return false;
+    }
+
+    m_liveKeys.clear();
+    m_liveRefreshAll = false;
+
+    if (driver->hasFeature(QSqlDriver::EventNotifications)) {
+        const QString channel = liveUpdateChannel();
+
+        if (channel.isEmpty()) {
+            m_error = QSqlError("No notification channel given", QString(), QSqlError::StatementError);
+            emit errorOccurred(m_error);
+            return false;
+        }
+
+        //The driver is shared by every model on the connection, only subscribe a channel nobody else has
+        if (!driver->subscribedToNotifications().contains(channel)) {
+            if (!driver->subscribeToNotification(channel)) {
+                m_error = driver->lastError();
+                emit errorOccurred(m_error);
+                return false;
+            }
+
+            m_liveSubscribed = true;
+        }
+
+        m_liveConnection = connect(driver, &QSqlDriver::notification, this, [this](const QString &name, QSqlDriver::NotificationSource source, const QVariant &payload) {
+            //Our own submits have already updated the cache
+            if (name != liveUpdateChannel() || source == QSqlDriver::SelfSource)
+                return;
+
+            //A payload naming a single column key reloads just that row, anything else refreshes the whole cache
+            CachedRowKey key;
+
+            if (m_keyColumns.count() == 1 && !payload.toString().isEmpty()) {
+                QVariant value = payload;
+
+                if (value.convert(m_record.field(m_keyColumns.front()).metaType()))
+                    key = CachedRowKey(CachedRowValues { value });
+            }
+
+            scheduleLiveUpdate(key);
+        });
+    } else if (driver->dbmsType() == QSqlDriver::SQLite) {
+        //PRAGMA data_version changes whenever another connection commits, a cheap check against the file header
+        if (!readDataVersion(m_dataVersion))
+            return false;
+
+        m_liveRowid = maxRowid();
+
+        m_livePollTimer.start();
+    } else {
+        //Nothing to listen to, refresh() on every interval
+        m_livePollTimer.start();
+    }
+
+    m_liveUpdates = true;
+    return true;
+}
+
+void CachedSqlTableModel::stopLiveUpdates()
+{
+    if (!m_liveUpdates)
+        return;
+
+    m_livePollTimer.stop();
+    m_liveDelayTimer.stop();
+    m_liveProbeTimer.stop();
+    m_liveProbeClock.invalidate();
+    disconnect(m_liveConnection);
+
+    if (m_liveSubscribed && m_db.driver())
+        m_db.driver()->unsubscribeFromNotification(liveUpdateChannel());
+
+    m_liveSubscribed = false;
+    m_liveKeys.clear();
+    m_liveRefreshAll = false;
+    m_liveDelta = false;
+    m_dataVersion = -1;
+    m_liveRowid = -1;
+    m_liveUpdates = false;
+}
+
+void CachedSqlTableModel::pollLiveUpdates()
+{
+    if (m_db.driver() && m_db.driver()->dbmsType() == QSqlDriver::SQLite) {
+        qint64 version = -1;
+
+        if (!readDataVersion(version) || version == m_dataVersion)
+            return;
+
+        //Another connection committed, reload what it changed rather than refreshing everything
+        m_dataVersion = version;
+        m_liveDelta = true;
+
+        if (!m_liveDelayTimer.isActive())
+            m_liveDelayTimer.start();
+
+        return;
+    }
+
+    scheduleLiveUpdate(CachedRowKey());
+}
+
+bool CachedSqlTableModel::readDataVersion(qint64 &version)
+{
+    QSqlQuery query(m_db);
+
+    if (!query.exec(QStringLiteral("PRAGMA data_version")) || !query.next()) {
+        m_error = query.lastError();
+        emit errorOccurred(m_error);
+        return false;
+    }
+
+    version = query.value(0).toLongLong();
+    return true;
+}
+
+qint64 CachedSqlTableModel::maxRowid()
+{
+    //Custom statements and tables declared WITHOUT ROWID have no rowid to tell new rows by
+    if (!m_select.isEmpty() || m_tableName.isEmpty())
+        return -1;
+
+    const QString table = m_db.driver()->escapeIdentifier(m_tableName, QSqlDriver::TableName);
+    QSqlQuery query(m_db);
+
+    if (!query.exec(CachedSql::concat(CachedSql::select(QStringLiteral("max(rowid)")), CachedSql::from(table))) || !query.next())
+        return -1;
+
+    //An empty table has no rowid yet, every row inserted later is new
+    return query.value(0).isNull() ? 0 : query.value(0).toLongLong();
+}
+
+void CachedSqlTableModel::scheduleLiveUpdate(const CachedRowKey &key)
+{
+    if (key.isNull())
+        m_liveRefreshAll = true;
+    else
+        m_liveKeys.insert(key);
+
+    //Changes arriving while the timer runs join the pending update
+    if (!m_liveDelayTimer.isActive())
+        m_liveDelayTimer.start();
+}
+
+void CachedSqlTableModel::applyLiveUpdates()
+{
+    //The cache cannot change under a running submit, try again once it is done
+    if (isSubmitting()) {
+        m_liveDelayTimer.start();
+        return;
+    }
+
+    const bool refreshAll = m_liveRefreshAll;
+    const bool delta = m_liveDelta;
+    const QVector<CachedRowKey> keys(m_liveKeys.cbegin(), m_liveKeys.cend());
+
+    m_liveKeys.clear();
+    m_liveRefreshAll = false;
+    m_liveDelta = false;
+
+    if (refreshAll)
+        refresh();
+    else if (delta)
+        reloadChanges();
+    else if (!keys.isEmpty())
+        reloadKeys(keys);
+}
+
+bool CachedSqlTableModel::reloadChanges()
+{
+    if (m_primaryIndex.isEmpty() || m_keyColumns.isEmpty() || m_record.isEmpty())
+        return select();
+
+    const int versionColumn = m_record.indexOf(m_versionColumn);
+    const bool byVersion = versionColumn != -1 && m_lastVersion.isValid();
+
+    //With neither a rowid nor a version there is no telling new rows apart, only a full refresh finds them
+    if (!byVersion && m_liveRowid < 0)
+        return refresh();
+
+    if (!m_keyIndexValid)
+        rebuildKeyIndex();
+
+    //Read past the rowid before the rows, a row committed in between is read twice rather than missed
+    const qint64 rowid = m_liveRowid >= 0 ? maxRowid() : -1;
+
+    //New rows past the last rowid and, with a version column, rows changed since the last version. Both are index range reads
+    QString changed;
+    QVariantList binds;
+
+    if (byVersion) {
+        changed = CachedSql::gt(m_db.driver()->escapeIdentifier(m_versionColumn, QSqlDriver::FieldName), QStringLiteral("?"));
+        binds.append(m_lastVersion);
+    }
+
+    if (m_liveRowid >= 0) {
+        changed = CachedSql::vel(changed, CachedSql::gt(QStringLiteral("rowid"), QStringLiteral("?")));
+        binds.append(m_liveRowid);
+    }
+
+    QVector<CachedRowValues> current;
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+
+    if (!query.prepare(composeSelect(baseSelectStatement(), CachedSql::et(CachedSql::paren(effectiveFilter()), CachedSql::paren(changed))))) {
+        m_error = query.lastError();
+        emit errorOccurred(m_error);
+        return false;
+    }
+
+    for (int i = 0; i < binds.count(); ++i)
+        query.bindValue(i, binds.at(i));
+
+    if (!query.exec()) {
+        m_error = query.lastError();
+        emit errorOccurred(m_error);
+        return false;
+    }
+
+    const int count = m_record.count();
+
+    while (query.next()) {
+        CachedRowValues values(count);
+
+        for (int i = 0; i < count; ++i)
+            values[i] = query.value(i);
+
+        current.push_back(values);
+    }
+
+    if (rowid >= 0)
+        m_liveRowid = rowid;
+
+    //Deletes leave no trace in either, look the cached keys up instead. Without a version column an update leaves none either,
+    //the resident rows are read again by key
+    QVector<CachedRowKey> residentKeys;
+    QVector<CachedRowKey> probeKeys;
+
+    for (const CachedRow &cr : std::as_const(m_cache)) {
+        if (cr.op() != CachedRow::None || !cr.submitted())
+            continue;
+
+        if (byVersion || cr.isEvicted())
+            probeKeys.append(cr.key(m_keyColumns));
+        else
+            residentKeys.append(cr.key(m_keyColumns));
+    }
+
+    //The probe below costs an IN list read over every cached key. On a large cache it runs at most once per probe interval, until
+    //then only the range reads above are merged and a deferred probe is queued for when the interval is up
+    if (residentKeys.count() + probeKeys.count() > LiveProbeRows && m_liveProbeClock.isValid() && m_liveProbeClock.elapsed() < m_liveProbeInterval) {
+        if (!m_liveProbeTimer.isActive())
+            m_liveProbeTimer.start(int(m_liveProbeInterval - m_liveProbeClock.elapsed()));
+
+        mergeRows(current, QVector<int>());
+        return true;
+    }
+
+    m_liveProbeTimer.stop();
+    m_liveProbeClock.start();
+
+    QVector<CachedRowValues> reread;
+    QVector<CachedRowValues> probed;
+
+    if (!selectByKeys(residentKeys, reread, effectiveFilter()) || !selectByKeys(probeKeys, probed, effectiveFilter(), true))
+        return false;
+
+    QSet<CachedRowKey> found;
+
+    for (const CachedRowValues &values : std::as_const(reread))
+        found.insert(keyOf(values));
+
+    for (const CachedRowValues &values : std::as_const(probed))
+        found.insert(CachedRowKey(values));
+
+    QVector<int> removedRows;
+
+    for (int row = 0; row < m_cache.count(); ++row) {
+        const CachedRow &cr = m_cache.at(row);
+
+        if (cr.op() == CachedRow::None && cr.submitted() && !found.contains(cr.key(m_keyColumns)))
+            removedRows.append(row);
+    }
+
+    mergeRows(current + reread, removedRows);
+    return true;
+}
+
+bool CachedSqlTableModel::reloadKeys(const QVector<CachedRowKey> &keys)
+{
+    if (m_primaryIndex.isEmpty() || m_keyColumns.isEmpty() || m_record.isEmpty())
+        return select();
+
+    QVector<CachedRowValues> current;
+
+    if (!selectByKeys(keys, current, effectiveFilter()))
+        return false;
+
+    QSet<CachedRowKey> found;
+
+    for (const CachedRowValues &values : std::as_const(current))
+        found.insert(keyOf(values));
+
+    if (!m_keyIndexValid)
+        rebuildKeyIndex();
+
+    //Keys that no longer come back were deleted or no longer match the filter
+    QVector<int> removedRows;
+
+    for (const CachedRowKey &key : keys) {
+        const int row = m_keyIndex.value(key, -1);
+
+        if (row == -1 || found.contains(key))
+            continue;
+
+        const CachedRow &cr = m_cache.at(row);
+
+        if (cr.op() == CachedRow::None && cr.submitted())
+            removedRows.append(row);
+    }
+
+    mergeRows(current, removedRows);
+    return true;
+}
+
+void CachedSqlTableModel::setStatsEnabled(bool enabled)
+{
+    m_statsEnabled = enabled;
+}
+
+bool CachedSqlTableModel::statsEnabled() const
+{
+    return m_statsEnabled;
+}
+
+CachedSqlStats CachedSqlTableModel::stats() const
+{
+    CachedSqlStats snapshot = m_stats;
+    snapshot.cachedRows = m_cache.count();
+    snapshot.residentRows = residentRowCount();
+    snapshot.cacheBytes = cacheFootprint();
+
+    return snapshot;
+}
+
+void CachedSqlTableModel::resetStats()
+{
+    m_stats = CachedSqlStats();
+}
+
+CachedSqlHistogram *CachedSqlTableModel::statsHistogram(CachedSqlHistogram &histogram)
+{
+    //Timers constructed with no histogram do not even read the clock
+    return m_statsEnabled ? &histogram : nullptr;
+}
+
+qint64 CachedSqlTableModel::cacheFootprint() const
+{
+    //Sample resident rows spread across the cache rather than walking every value
+    const int SampleRows = 256;
+    const int step = qMax(1, int(m_cache.count()) / SampleRows);
+    qint64 sampledBytes = 0;
+    int sampled = 0;
+
+    for (int row = 0; row < m_cache.count(); row += step) {
+        const CachedRow &cr = m_cache.at(row);
+
+        if (cr.isEvicted())
+            continue;
+
+        CachedRowValues values;
+        values.reserve(cr.count());
+
+        for (int c = 0; c < cr.count(); ++c)
+            values.append(cr.value(c));
+
+        sampledBytes += estimatedRowBytes(values);
+        ++sampled;
+    }
+
+    const qint64 resident = sampled > 0 ? sampledBytes * residentRowCount() / sampled : 0;
+    const qint64 evicted = qint64(m_evictedCount) * (qint64(sizeof(CachedRow)) + m_keyColumns.count() * qint64(sizeof(QVariant)));
+
+    return resident + evicted;
+}
+
+QString CachedSqlTableModel::countStatement() const
+{
+    const QString stmt = baseSelectStatement();
+
+    if (stmt.isEmpty())
+        return QString();
+
+    //Count over the filtered statement as a derived table so custom selects with joins or grouping count correctly
+    const QString select = composeSelect(stmt, effectiveFilter());
+
+    return CachedSql::concat(CachedSql::select(QStringLiteral("COUNT(*)")),
+                             CachedSql::from(CachedSql::as(CachedSql::paren(select), QStringLiteral("cached_count"))));
+}
+
+void CachedSqlTableModel::startRowCount()
+{
+    //Nothing to count when fetching is disabled or the first batch already drained the result
+    if (m_rowCountMode == FetchedRowCount || m_queryExhausted)
+        return;
+
+    const QString count = countStatement();
+
+    if (count.isEmpty())
+        return;
+
+    const QString select = composeSelect(baseSelectStatement(), effectiveFilter());
+    const QString connectionName = m_db.connectionName();
+    const bool estimate = m_rowCountMode == EstimatedRowCount;
+    const int generation = m_countGeneration;
+
+    //A clone of a private database would count an empty one, count on this connection and deliver the result the same way
+    if (!canCloneConnection()) {
+        const qint64 rows = countRows(m_db, select, count, estimate);
+
+        QMetaObject::invokeMethod(this, [this, rows, generation]() {
+            if (generation == m_countGeneration && rows >= 0)
+                setTotalRowCount(rows);
+        }, Qt::QueuedConnection);
+
+        return;
+    }
+
+    //The count runs on its own connection so a slow COUNT(*) never blocks fetching or the UI
+    QThread *thread = QThread::create([this, connectionName, select, count, estimate, generation]() {
+        const qint64 rows = countRows(connectionName, select, count, estimate);
+
+        QMetaObject::invokeMethod(this, [this, rows, generation]() {
+            if (generation == m_countGeneration && rows >= 0)
+                setTotalRowCount(rows);
+        }, Qt::QueuedConnection);
+    });
+
+    m_countThreads.insert(thread);
+
+    connect(thread, &QThread::finished, this, [this, thread]() { m_countThreads.remove(thread); });
+    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+
+    thread->start();
+}
+
+void CachedSqlTableModel::setTotalRowCount(qint64 count)
+{
+    m_totalRowCount = count;
+    emit totalRowCountChanged(count);
+
+    if (m_queryExhausted)
+        return;
+
+    //Pinned rows already take their place at the top of the cache, the rest of the count becomes the unfetched tail
+    const qint64 unfetched = qBound<qint64>(0, count - m_fetchedCount, std::numeric_limits<int>::max() - m_cache.count());
+    resizeUnfetchedRows(int(unfetched));
+}
+
+void CachedSqlTableModel::resizeUnfetchedRows(int count)
+{
+    //The tail is hidden while a client filter is applied
+    if (m_clientFilter) {
+        m_unfetchedRows = count;
+        return;
+    }
+
+    const int end = m_cache.count() + m_unfetchedRows;
+
+    if (count > m_unfetchedRows) {
+        beginInsertRows(QModelIndex(), end, m_cache.count() + count - 1);
+        m_unfetchedRows = count;
+        endInsertRows();
+    } else if (count < m_unfetchedRows) {
+        beginRemoveRows(QModelIndex(), m_cache.count() + count, end - 1);
+        m_unfetchedRows = count;
+        endRemoveRows();
+    }
+}
+
+void CachedSqlTableModel::fetchUntil(int row) const
+{
+    //Coalesce every request made while painting into a single queued fetch
+    const bool queued = m_fetchUntilRow >= 0;
+    m_fetchUntilRow = qMax(m_fetchUntilRow, row);
+
+    if (!queued)
+        QMetaObject::invokeMethod(const_cast<CachedSqlTableModel *>(this), &CachedSqlTableModel::fetchUnfetchedRows, Qt::QueuedConnection);
+}
+
+void CachedSqlTableModel::fetchUnfetchedRows()
+{
+    const int row = m_fetchUntilRow;
+
+    //A worker batch in flight picks the request up once it arrives
+    if (row < 0 || (m_fetchMode == FetchInBackground && m_fetchPending))
+        return;
+
+    m_fetchUntilRow = -1;
+
+    if (m_fetchMode == FetchInBackground) {
+        //A far away row is reached over several requests, each batch arriving keeps the stream going
+        if (row >= m_cache.count()) {
+            requestWorkerBatch(qMin(row - m_cache.count() + m_fetchBatchSize, MaxDrainBatches * m_fetchBatchSize));
+
+            if (m_fetchPending)
+                m_fetchUntilRow = row;
+        }
+        return;
+    }
+
+    //Drain the result towards the requested row, rows past the cache budget are evicted along the way
+    QElapsedTimer timer;
+    timer.start();
+
+    while (row >= m_cache.count() && canFetchMore()) {
+        const int fetched = m_fetchedCount;
+        fetchMore();
+
+        if (m_fetchedCount == fetched)
+            return;
+
+        //Hand control back to the event loop between slices rather than blocking until a far away row is reached
+        if (row >= m_cache.count() && timer.nsecsElapsed() > MaxDrainNsecs) {
+            fetchUntil(row);
+            return;
+        }
+    }
+}
+
+bool CachedSqlTableModel::fetchThrough(int row)
+{
+    if (row < m_cache.count())
+        return true;
+
+    //The worker delivers rows asynchronously, queue the fetch so the row is there when asked again
+    if (m_fetchMode == FetchInBackground) {
+        fetchUntil(row);
+        return false;
+    }
+
+    //An explicit edit needs the row itself, drain up to it now
+    while (row >= m_cache.count() && canFetchMore()) {
+        const int fetched = m_fetchedCount;
+        fetchMore();
+
+        if (m_fetchedCount == fetched)
+            break;
+    }
+
+    return row < m_cache.count();
+}
+
+qint64 CachedSqlTableModel::cacheBudgetRows() const
+{
+    if (m_cacheBudgetUnit == RowBudget)
+        return m_cacheBudget;
+
+    //Key values stay resident for every row, so an evicted row is not free either
+    return m_rowBytes > 0 ? m_cacheBudget / m_rowBytes : m_cacheBudget;
+}
+
+void CachedSqlTableModel::enforceCacheBudget()
+{
+    //Evicted rows are read back by key, without a primary key there is nothing to save
+    if (m_cacheBudget == 0 || m_primaryIndex.isEmpty() || m_keyColumns.isEmpty())
+        return;
+
+    const qint64 limit = qMax<qint64>(m_fetchBatchSize, cacheBudgetRows());
+
+    if (qint64(m_residentRows.size()) <= limit)
+        return;
+
+    //Trim well below the limit so that eviction does not run again on every fetched batch
+    const qint64 target = limit * 3 / 4;
+    const int anchor = qBound(0, m_lastAccessedRow, m_cache.count() - 1);
+    QVector<int> pinned;
+
+    while (qint64(m_residentRows.size()) > target && !m_residentRows.empty()) {
+        const int first = *m_residentRows.cbegin();
+        const int last = *m_residentRows.crbegin();
+
+        //Drop whichever end of the resident rows is farthest from the rows last looked at
+        const int row = anchor - first >= last - anchor ? first : last;
+        m_residentRows.erase(row);
+
+        CachedRow &cr = m_cache[row];
+
+        //Rows with pending changes are pinned
+        if (cr.op() != CachedRow::None || !cr.submitted()) {
+            pinned.append(row);
+            continue;
+        }
+
+        cr.evict(m_keyColumns);
+        ++m_evictedCount;
+    }
+
+    for (int row : std::as_const(pinned))
+        m_residentRows.insert(row);
+}
+
+bool CachedSqlTableModel::loadRows(int first, int last)
+{
+    if (m_evictedCount == 0)
+        return true;
+
+    //Read evicted rows back by key, as many keys per statement as the bind value limit allows
+    const int chunkSize = qMax(1, MaxBatchBindValues / qMax(1, m_keyColumns.count()));
+    QVector<int> rows;
+
+    for (int row = first; row <= last; ++row) {
+        if (!m_cache.at(row).isEvicted())
+            continue;
+
+        rows.append(row);
+
+        if (rows.count() == chunkSize) {
+            if (!loadRowChunk(rows))
+                return false;
+
+            rows.clear();
+        }
+    }
+
+    if (!rows.isEmpty() && !loadRowChunk(rows))
+        return false;
+
+    //Callers still have to read the rows, they enforce the budget once they are done with them
+    return true;
+}
+
+void CachedSqlTableModel::readBackRows(int row) const
+{
+    //data() is const but reads evicted rows back from the database synchronously, together with their neighbours.
+    //Nothing is evicted here, trimming the cache is left to a queued pass so that painting never drops rows it is about to show
+    CachedSqlTableModel *self = const_cast<CachedSqlTableModel *>(this);
+    const int half = m_fetchBatchSize / 2;
+
+    if (!self->loadRows(qMax(0, row - half), qMin(m_cache.count() - 1, row + half)))
+        return;
+
+    if (!m_budgetQueued) {
+        m_budgetQueued = true;
+        QMetaObject::invokeMethod(self, [self]() {
+            self->m_budgetQueued = false;
+            self->enforceCacheBudget();
+        }, Qt::QueuedConnection);
+    }
+}
+
+bool CachedSqlTableModel::loadRowChunk(const QVector<int> &rows)
+{
+    QHash<CachedRowKey, int> pending;
+    QVector<CachedRowKey> keys;
+    keys.reserve(rows.count());
+
+    for (int row : rows) {
+        const CachedRowKey key = m_cache.at(row).key(m_keyColumns);
+        pending.insert(key, row);
+        keys.append(key);
+    }
+
+    QVector<CachedRowValues> fetched;
+
+    if (!selectByKeys(keys, fetched))
+        return false;
+
+    for (const CachedRowValues &values : std::as_const(fetched)) {
+        const auto it = pending.constFind(keyOf(values));
+
+        if (it == pending.cend())
+            continue;
+
+        restoreRow(it.value(), values);
+        pending.erase(it);
+    }
+
+    //Rows deleted from the table since they were fetched keep their key and show empty values until the next select
+    const int count = m_record.count();
+
+    for (auto it = pending.cbegin(); it != pending.cend(); ++it) {
+        CachedRowValues values(count);
+
+        for (int i = 0; i < m_keyColumns.count(); ++i)
+            values[m_keyColumns.at(i)] = it.key().values().at(i);
+
+        restoreRow(it.value(), values);
+    }
+
+    return true;
+}
+
+QString CachedSqlTableModel::keyPredicate(const QStringList &fields, int keys)
+{
+    //A single key column uses "key IN (?, ...)", a composite key "(a = ? AND b = ?) OR ..."
+    if (fields.count() == 1) {
+        QStringList placeholders;
+
+        for (int k = 0; k < keys; ++k)
+            placeholders.append(QStringLiteral("?"));
+
+        return CachedSql::in(fields.front(), placeholders.join(CachedSql::comma()));
+    }
+
+    QString term;
+    for (const QString &field : fields)
+        term = CachedSql::et(term, CachedSql::eq(field, QStringLiteral("?")));
+
+    QString predicate;
+    for (int k = 0; k < keys; ++k)
+        predicate = CachedSql::vel(predicate, CachedSql::paren(term));
+
+    return predicate;
+}
+
+bool CachedSqlTableModel::selectByKeys(const QVector<CachedRowKey> &keys, QVector<CachedRowValues> &rows, const QString &filter, bool keysOnly)
+{
+    if (keys.isEmpty())
+        return true;
+
+    QString stmt = baseSelectStatement();
+
+    if (stmt.isEmpty())
+        return false;
+
+    QSqlDriver *driver = m_db.driver();
+    QStringList fields;
+
+    for (int c : std::as_const(m_keyColumns))
+        fields.append(driver->escapeIdentifier(m_record.fieldName(c), QSqlDriver::FieldName));
+
+    //Only telling which keys still exist, read nothing but the key columns of the filtered result
+    QString rowFilter = filter;
+
+    if (keysOnly) {
+        const QString select = composeSelect(stmt, filter);
+        stmt = CachedSql::concat(CachedSql::select(fields.join(CachedSql::comma())), CachedSql::from(CachedSql::as(CachedSql::paren(select), QStringLiteral("cached_keys"))));
+        rowFilter.clear();
+    }
+
+    //As many keys per statement as the bind value limit allows
+    const int chunkSize = qMax(1, MaxBatchBindValues / qMax(1, int(fields.count())));
+    const int count = keysOnly ? fields.count() : m_record.count();
+
+    for (int start = 0; start < keys.count(); start += chunkSize) {
+        const int end = qMin(int(keys.count()), start + chunkSize);
+
+        QVariantList binds;
+
+        for (int k = start; k < end; ++k)
+            binds += keys.at(k).values();
+
+        QString predicate = keyPredicate(fields, end - start);
+        predicate = CachedSql::et(CachedSql::paren(rowFilter), rowFilter.isEmpty() ? predicate : CachedSql::paren(predicate));
+
+        QSqlQuery query(m_db);
+        query.setForwardOnly(true);
+
+        if (!query.prepare(keysOnly ? CachedSql::concat(stmt, CachedSql::where(predicate)) : composeSelect(stmt, predicate))) {
+            m_error = query.lastError();
+            emit errorOccurred(m_error);
+            return false;
+        }
+
+        for (int i = 0; i < binds.count(); ++i)
+            query.bindValue(i, binds.at(i));
+
+        if (!query.exec()) {
+            m_error = query.lastError();
+            emit errorOccurred(m_error);
+            return false;
+        }
+
+        while (query.next()) {
+            CachedRowValues values(count);
+
+            for (int i = 0; i < count; ++i)
+                values[i] = query.value(i);
+
+            rows.push_back(values);
+        }
+    }
+
+    return true;
+}
+
+CachedRowKey CachedSqlTableModel::keyOf(const CachedRowValues &values) const
+{
+    CachedRowValues keyValues;
+    keyValues.reserve(m_keyColumns.count());
+
+    for (int c : std::as_const(m_keyColumns))
+        keyValues.append(values.value(c));
+
+    return CachedRowKey(keyValues);
+}
+
+void CachedSqlTableModel::restoreRow(int row, const CachedRowValues &values)
+{
+    m_cache[row].restore(values);
+    --m_evictedCount;
+
+    if (m_cacheBudget > 0)
+        m_residentRows.insert(row);
+}
+
+bool CachedSqlTableModel::requery(const CacheVec &pinned)
+{
+    //Rows being submitted must keep their positions until the worker reports back
+    if (isSubmitting())
+        return false;
+
+    //Rows committed from here on are new to the result, read the rowid before the result so none of them is missed
+    if (m_liveRowid >= 0)
+        m_liveRowid = maxRowid();
+
+    QString stmt = selectStatement();
+
+    //Ensure we have a valid statement
+    if (stmt.isEmpty())
+        return false;
+
+    //Pinned rows carry pending changes across the re-query, their database rows are skipped when fetched again
+    QSet<CachedRowKey> pinnedKeys;
+
+    for (const CachedRow &cr : pinned) {
+        const CachedRowKey key = cr.key(m_keyColumns);
+
+        if (!key.isNull())
+            pinnedKeys.insert(key);
+    }
+
+    stopFetchWorker();
+
+    //In background mode reset to the pinned rows and return immediately, columns and rows arrive from the worker
+    if (m_fetchMode == FetchInBackground) {
+        beginResetModel();
+        m_selectQuery = QSqlQuery(m_db);
+        resetCache(pinned, pinnedKeys);
+        m_record.clear();
+        m_keyColumns.clear();
+        m_autoColumn.clear();
+        endResetModel();
+
+        //Pending rows wait at the top until the sorted rows reach their position
+        m_floatingRows = m_sortFields.isEmpty() ? 0 : pinned.count();
+
+        startFetchWorker(stmt);
+        startRowCount();
+        return true;
+    }
+
+    //In keyset mode every batch is an independent query, the first one also provides the record
+    if (m_fetchMode == FetchByKeyset) {
+        if (m_primaryIndex.isEmpty()) {
+            m_error = QSqlError("Keyset fetching requires a primary key", QString(), QSqlError::StatementError);
+            emit errorOccurred(m_error);
+            return false;
+        }
+
+        beginResetModel();
+        m_selectQuery = QSqlQuery(m_db);
+        resetCache(pinned, pinnedKeys);
+        m_record.clear();
+        const bool success = fetchKeysetBatch();
+        endResetModel();
+
+        if (success) {
+            floatPinnedRows(pinned.count());
+            startRowCount();
+        }
+
+        return success;
+    }
+
+    //Prepare and execute the query
+    m_selectQuery = QSqlQuery(m_db);
+    m_selectQuery.setForwardOnly(true);
+
+    if (!m_selectQuery.exec(stmt)) {
+        m_error = m_selectQuery.lastError();
+        emit errorOccurred(m_error);
+        return false;
+    }
+
+    beginResetModel();
+
+    //Clear data structures and reset flags and variables
+    resetCache(pinned, pinnedKeys);
+    setRecord(m_selectQuery.record());
+
+    //Fetch the first batch of data
+    fetchMore();
+    endResetModel();
+
+    floatPinnedRows(pinned.count());
+    startRowCount();
+
+    return true;
+}
+
+void CachedSqlTableModel::resetCache(const CacheVec &pinned, const QSet<CachedRowKey> &pinnedKeys)
+{
+    abandonExport();
+
+    //The record may change with the new result, batches parsed against the old one must not be staged. Rows staged so far are kept
+    if (m_importWorker) {
+        stopImportWorker();
+        emit importCanceled();
+    }
+
+    //A refresh still reading compares against rows that are about to go
+    stopRefreshWorker();
+
+    m_cache = pinned;
+    m_pinnedKeys = pinnedKeys;
+    m_floatingRows = 0;
+    m_keysetLast.clear();
+    m_lastVersion.clear();
+    invalidateKeyIndex();
+    m_fetchedCount = 0;
+    m_queryExhausted = false;
+
+    //Counts still running for the previous result are discarded when they arrive
+    ++m_countGeneration;
+    m_totalRowCount = -1;
+    m_unfetchedRows = 0;
+    m_fetchUntilRow = -1;
+
+    //Only rows with pending changes are ever pinned, they are never evicted
+    m_dirtyRows.clear();
+    m_residentRows.clear();
+    m_evictedCount = 0;
+    m_visibleRows.clear();
+
+    for (CachedSqlSearchIndex &index : m_searchIndexes)
+        index.clear();
+
+    for (auto it = m_aggregates.begin(); it != m_aggregates.end(); ++it) {
+        it.value().clear();
+        markAggregateChanged(it.key());
+    }
+
+    for (int row = 0; row < m_cache.count(); ++row) {
+        m_dirtyRows.insert(m_dirtyRows.end(), row);
+
+        //Pinned rows have pending changes, they are always shown
+        if (m_clientFilter)
+            m_visibleRows.append(row);
+
+        if (m_cacheBudget > 0)
+            m_residentRows.insert(m_residentRows.end(), row);
+    }
+}
+
+CacheVec CachedSqlTableModel::pendingRows() const
+{
+    CacheVec pending;
+    pending.reserve(int(m_dirtyRows.size()));
+
+    for (int row : m_dirtyRows)
+        pending.append(m_cache.at(row));
+
+    return pending;
+}
+
+void CachedSqlTableModel::appendFetchedRows(const QVector<CachedRowValues> &rows)
+{
+    QVector<CachedRow> newRows;
+    newRows.reserve(rows.count());
+
+    for (const CachedRowValues &values : rows) {
+        CachedRow cr(CachedRow::None, values);
+
+        //Rows pinned by a re-query are already cached along with their pending changes
+        if (!m_pinnedKeys.isEmpty() && m_pinnedKeys.contains(cr.key(m_keyColumns)))
+            continue;
+
+        newRows.push_back(cr);
+    }
+
+    m_fetchedCount += rows.count();
+
+    if (m_statsEnabled) {
+        ++m_stats.fetchBatches;
+        m_stats.fetchedRows += rows.count();
+
+        for (const CachedRowValues &values : rows)
+            m_stats.fetchedBytes += estimatedRowBytes(values);
+    }
+
+    if (!m_versionColumn.isEmpty()) {
+        for (const CachedRowValues &values : rows)
+            trackVersion(values);
+    }
+
+    //Skipped database rows were part of the counted tail, they are already shown pinned at the top
+    const int skipped = rows.count() - newRows.count();
+
+    if (skipped > 0 && m_unfetchedRows > 0)
+        resizeUnfetchedRows(qMax(0, m_unfetchedRows - skipped));
+
+    if (newRows.isEmpty()) {
+        if (m_queryExhausted) {
+            resizeUnfetchedRows(0);
+            placePinnedRows(m_cache.count());
+        }
+        return;
+    }
+
+    //Sample one row per batch to keep the per-row memory estimate of a byte budget current
+    const qint64 sample = estimatedRowBytes(rows.front());
+    m_rowBytes = m_rowBytes == 0 ? sample : (m_rowBytes * 7 + sample) / 8;
+
+    //If we do have rows to add, append to the cache and notify view
+    const int first = m_cache.count();
+    const int last = first + newRows.count() - 1;
+
+    //Rows replacing the counted tail are already known to the view, only rows beyond it are inserted. A client filter shows the matching ones after appending
+    const int covered = qMin(m_unfetchedRows, int(newRows.count()));
+    const bool notify = !m_clientFilter;
+
+    if (notify && covered < newRows.count())
+        beginInsertRows(QModelIndex(), first + covered, last);
+
+    m_cache += newRows;
+    m_unfetchedRows -= covered;
+    indexRows(first, last);
+
+    if (m_cacheBudget > 0) {
+        for (int row = first; row <= last; ++row)
+            m_residentRows.insert(m_residentRows.end(), row);
+    }
+
+    if (notify && covered < newRows.count())
+        endInsertRows();
+
+    if (notify && covered > 0)
+        emit dataChanged(index(first, 0), index(first + covered - 1, columnCount() - 1));
+
+    if (!notify)
+        showAppendedRows(first, last);
+
+    //The count may have been an estimate, once the result is drained the cache is the truth
+    if (m_queryExhausted)
+        resizeUnfetchedRows(0);
+
+    placePinnedRows(first);
+
+    //Index and aggregate the new rows while their values are still resident
+    syncRowIndexes();
+    enforceCacheBudget();
+}
+
+QVector<QPair<QString, Qt::SortOrder>> CachedSqlTableModel::keysetColumns() const
+{
+    //Server side sort columns first, then the primary key as a unique tie breaker
+    QVector<QPair<QString, Qt::SortOrder>> columns = m_sortFields;
+
+    for (int i = 0; i < m_primaryIndex.count(); ++i) {
+        const QString name = m_primaryIndex.fieldName(i);
+        bool sorted = false;
+
+        for (const auto &column : std::as_const(columns))
+            sorted = sorted || column.first == name;
+
+        if (!sorted)
+            columns.append({name, Qt::AscendingOrder});
+    }
+
+    return columns;
+}
+
+QString CachedSqlTableModel::keysetStatement(const QVector<QPair<QString, Qt::SortOrder>> &columns, QVariantList &binds, bool limited) const
+{
+    const QString stmt = baseSelectStatement();
+
+    if (stmt.isEmpty())
+        return QString();
+
+    QSqlDriver *driver = m_db.driver();
+    QStringList fields;
+
+    for (const auto &column : columns)
+        fields.append(driver->escapeIdentifier(column.first, QSqlDriver::FieldName));
+
+    //Seek past the last fetched row: (c1 > ?) OR (c1 = ? AND c2 > ?) OR ..., with < for descending columns.
+    //Sort columns may hold NULL, which compares as unknown and sorts differently per DBMS. Rank NULL below every value, the same
+    //as the client sort, with an explicit term ahead of the column and seek over it with IS NULL / IS NOT NULL
+    QString order;
+    QString seek;
+
+    for (int i = 0; i < columns.count(); ++i) {
+        const bool ascending = columns.at(i).second == Qt::AscendingOrder;
+        const bool nullable = !m_primaryIndex.contains(columns.at(i).first);
+
+        if (nullable) {
+            const QString rank = QStringLiteral("CASE WHEN %1 THEN 0 ELSE 1 END").arg(CachedSql::isNull(fields.at(i)));
+            order = CachedSql::comma(order, ascending ? CachedSql::asc(rank) : CachedSql::desc(rank));
+        }
+
+        order = CachedSql::comma(order, ascending ? CachedSql::asc(fields.at(i)) : CachedSql::desc(fields.at(i)));
+
+        if (m_keysetLast.isEmpty())
+            continue;
+
+        QString term;
+        QVariantList termBinds;
+
+        for (int j = 0; j < i; ++j) {
+            if (m_keysetLast.at(j).isNull()) {
+                term = CachedSql::et(term, CachedSql::isNull(fields.at(j)));
+            } else {
+                term = CachedSql::et(term, CachedSql::eq(fields.at(j), QStringLiteral("?")));
+                termBinds.append(m_keysetLast.at(j));
+            }
+        }
+
+        if (m_keysetLast.at(i).isNull()) {
+            //Nothing sorts below NULL, a descending column has no rows left past it
+            if (!ascending)
+                continue;
+
+            term = CachedSql::et(term, CachedSql::isNotNull(fields.at(i)));
+        } else if (ascending) {
+            term = CachedSql::et(term, CachedSql::gt(fields.at(i), QStringLiteral("?")));
+            termBinds.append(m_keysetLast.at(i));
+        } else {
+            const QString below = CachedSql::lt(fields.at(i), QStringLiteral("?"));
+            term = CachedSql::et(term, nullable ? CachedSql::paren(CachedSql::vel(below, CachedSql::isNull(fields.at(i)))) : below);
+            termBinds.append(m_keysetLast.at(i));
+        }
+
+        binds += termBinds;
+        seek = CachedSql::vel(seek, CachedSql::paren(term));
+    }
+
+    const QString where = CachedSql::et(CachedSql::paren(effectiveFilter()), CachedSql::paren(seek));
+
+    const QString ordered = composeSelect(stmt, where, order);
+
+    return limited ? CachedSql::concat(ordered, CachedSql::limit(QString::number(m_fetchBatchSize))) : ordered;
+}
+
+bool CachedSqlTableModel::fetchKeysetBatch()
+{
+    const QVector<QPair<QString, Qt::SortOrder>> columns = keysetColumns();
+    QVariantList binds;
+    const QString stmt = keysetStatement(columns, binds);
+
+    //The statement reports its own error
+    if (stmt.isEmpty()) {
+        m_queryExhausted = true;
+        resizeUnfetchedRows(0);
+        return false;
+    }
+
+    //No connection is held between batches, reopen one that has been dropped instead of failing
+    if (!m_db.isOpen() && !m_db.open())
+        return failKeysetBatch(m_db.lastError());
+
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+
+    if (!query.prepare(stmt))
+        return failKeysetBatch(query.lastError());
+
+    for (int i = 0; i < binds.count(); ++i)
+        query.bindValue(i, binds.at(i));
+
+    if (!query.exec())
+        return failKeysetBatch(query.lastError());
+
+    const QSqlRecord record = query.record();
+
+    //Locate the keyset columns in the result to remember where the next batch starts, before the record is taken over
+    QVector<int> positions;
+
+    for (const auto &column : columns) {
+        const int position = record.indexOf(column.first);
+
+        if (position == -1)
+            return failKeysetBatch(QSqlError("Keyset column missing from the select statement", QString(), QSqlError::StatementError));
+
+        positions.append(position);
+    }
+
+    if (m_record.isEmpty())
+        setRecord(record);
+
+    const int count = record.count();
+    QVector<CachedRowValues> newRows;
+    newRows.reserve(m_fetchBatchSize);
+
+    while (query.next()) {
+        CachedRowValues values(count);
+
+        for (int i = 0; i < count; ++i)
+            values[i] = query.value(i);
+
+        newRows.push_back(values);
+    }
+
+    //Handle query exhaustian with explicit flag, a short batch means no more rows are available
+    if (newRows.count() < m_fetchBatchSize)
+        m_queryExhausted = true;
+
+    if (!newRows.isEmpty()) {
+        m_keysetLast.clear();
+
+        for (int position : positions)
+            m_keysetLast.append(newRows.constLast().at(position));
+    }
+
+    appendFetchedRows(newRows);
+
+    return true;
+}
+
+bool CachedSqlTableModel::failKeysetBatch(const QSqlError &error)
+{
+    //A batch that failed would fail again, stop offering more rows instead of re-running it on every fetchMore()
+    m_queryExhausted = true;
+    resizeUnfetchedRows(0);
+
+    m_error = error;
+    emit errorOccurred(m_error);
+    return false;
 }
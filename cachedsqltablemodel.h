@@ -2,13 +2,37 @@
 #define CACHEDSQLTABLEMODEL_H
 
 #include "cachedrow.h"
+#include "cachedsqlaggregate.h"
+#include "cachedsqlfilter.h"
+#include "cachedsqlsearchindex.h"
+#include "cachedsqlsorter.h"
+#include "cachedsqlstatementcache.h"
+#include "cachedsqlstats.h"
+#include "cachedsqlsubmitworker.h"
 
 #include <QAbstractTableModel>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPointer>
+#include <QSet>
 #include <QSqlDatabase>
 #include <QSqlError>
 #include <QSqlIndex>
 #include <QSqlQuery>
 #include <QSqlRecord>
+#include <QStringList>
+#include <QTimer>
+
+#include <set>
+
+class CachedSqlExportWorker;
+struct CachedSqlExportSource;
+class CachedSqlFetchWorker;
+class CachedSqlImportWorker;
+class CachedSqlRefreshWorker;
+class QIODevice;
+class QSqlDriver;
+class QThread;
 
 typedef QVector<CachedRow> CacheVec;
 
@@ -17,12 +41,60 @@ class CachedSqlTableModel : public QAbstractTableModel
     Q_OBJECT
 
 public:
+    enum FetchMode {
+        FetchOnDemand,      //fetchMore() reads the next batch on the calling thread
+        FetchInBackground,  //A worker thread with a cloned connection streams batches back to the model. Not available for in-memory SQLite
+        FetchByKeyset       //Every batch is an independent "WHERE key > last ORDER BY key LIMIT n" query, no cursor is held
+    };
+    Q_ENUM(FetchMode)
+
+    enum SortMode {
+        AutoSort,     //Sort on the server while the query still has unfetched rows, otherwise sort the cache
+        ClientSort,   //Always sort the cached rows
+        ServerSort    //Always re-query with an ORDER BY on the sort column
+    };
+    Q_ENUM(SortMode)
+
+    enum FilterMode {
+        AutoFilter,     //Filter the cache while it holds the whole result, otherwise add the filter to the query
+        ClientFilter,   //Always filter the cached rows, rows fetched later are filtered as they arrive
+        ServerFilter    //Re-query with the filter added to the WHERE clause, unless the driver cannot match it exactly (see CachedSqlFilter::hasSql())
+    };
+    Q_ENUM(FilterMode)
+
+    enum ExportFormat {
+        CsvExport,        //Comma separated text with a header row
+        ColumnarExport    //Compact binary, one block per column for every chunk of rows
+    };
+    Q_ENUM(ExportFormat)
+
+    enum ExportValues {
+        StagedValues,     //Rows as shown, pending edits applied and staged deletes left out
+        CommittedValues   //Rows as last read from the database, staged inserts left out
+    };
+    Q_ENUM(ExportValues)
+
+    enum CacheBudgetUnit {
+        RowBudget,    //The budget is a number of resident rows
+        ByteBudget    //The budget is an estimate of the memory held by resident rows
+    };
+    Q_ENUM(CacheBudgetUnit)
+
+    enum RowCountMode {
+        FetchedRowCount,    //rowCount() grows as batches are fetched
+        ExactRowCount,      //A background SELECT COUNT(*) reports the full result up front
+        EstimatedRowCount   //Like ExactRowCount, but uses the driver's planner estimate where one is available
+    };
+    Q_ENUM(RowCountMode)
+
     explicit CachedSqlTableModel(QObject *parent = nullptr, const QSqlDatabase &db = QSqlDatabase());
+    ~CachedSqlTableModel() override;
 
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
     int columnCount(const QModelIndex &parent = QModelIndex()) const override;
 
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    //Reading an evicted row through data() queries the database for it and its neighbours on the calling thread
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
 
     bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override;
@@ -52,20 +124,132 @@ public:
     QString filter() const;
     void setFilter(const QString &filter);
 
+    bool setRowFilter(const CachedSqlFilter &filter);
+    CachedSqlFilter rowFilter() const;
+
+    void setFilterMode(FilterMode mode);
+    FilterMode filterMode() const;
+
+    void setVersionColumn(const QString &name);
+    QString versionColumn() const;
+
     void setFetchBatchSize(int size);
     int fetchBatchSize() const;
 
+    void setAdaptiveFetch(bool enabled);
+    bool adaptiveFetch() const;
+    void setFetchBatchLimits(int minimum, int maximum);
+    int minimumFetchBatchSize() const;
+    int maximumFetchBatchSize() const;
+    void setFetchTargetDuration(int msecs);
+    int fetchTargetDuration() const;
+
+    void setFetchMode(FetchMode mode);
+    FetchMode fetchMode() const;
+    bool isFetching() const;
+
+    void setStatementCacheSize(int size);
+    int statementCacheSize() const;
+    quint64 statementCacheHits() const;
+    quint64 statementCacheMisses() const;
+
     void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+    void sort(const QList<CachedSqlSortColumn> &columns);
+
+    void setSortMode(SortMode mode);
+    SortMode sortMode() const;
+
+    bool submitAllAsync();
+    bool isSubmitting() const;
+
+    bool appendRecords(const QList<QSqlRecord> &records);
+    bool importCsv(const QString &fileName, QChar separator = QLatin1Char(','), bool hasHeader = true);
+    bool importCsv(QIODevice *device, QChar separator = QLatin1Char(','), bool hasHeader = true);
+    bool isImporting() const;
+
+    bool exportRows(const QString &fileName, ExportFormat format = CsvExport, ExportValues values = StagedValues, bool drainQuery = false);
+    bool isExporting() const;
+
+    void setSearchIndexed(int column, bool enabled);
+    bool isSearchIndexed(int column) const;
+    QVector<int> findRows(int column, const QString &text, Qt::MatchFlags flags = Qt::MatchContains) const;
+    QModelIndexList match(const QModelIndex &start, int role, const QVariant &value, int hits = 1, Qt::MatchFlags flags = Qt::MatchFlags(Qt::MatchStartsWith | Qt::MatchWrap)) const override;
+
+    int addAggregate(int column, CachedSqlAggregate::Function function, int groupColumn = -1);
+    void removeAggregate(int id);
+    QVariant aggregate(int id) const;
+    QVariant aggregate(int id, const QVariant &group) const;
+    QVariantList aggregateGroups(int id) const;
+
+    int rowForKey(const QSqlRecord &key) const;
+    QModelIndex indexForKey(const QSqlRecord &key, int column = 0) const;
+
+    void setCacheBudget(qint64 budget, CacheBudgetUnit unit = RowBudget);
+    qint64 cacheBudget() const;
+    CacheBudgetUnit cacheBudgetUnit() const;
+    int residentRowCount() const;
+
+    void setRowCountMode(RowCountMode mode);
+    RowCountMode rowCountMode() const;
+    qint64 totalRowCount() const;
+
+    bool saveSnapshot(const QString &path);
+    bool loadSnapshot(const QString &path, bool refreshAfterLoad = true);
+
+    bool setLiveUpdates(bool enabled);
+    bool liveUpdates() const;
+    void setLiveUpdateChannel(const QString &channel);
+    QString liveUpdateChannel() const;
+    void setLiveUpdateInterval(int msecs);
+    int liveUpdateInterval() const;
+    void setLiveUpdateDelay(int msecs);
+    int liveUpdateDelay() const;
+    //Deletes, and updates without a version column, are found by probing every cached key. A cache of more than 10000 rows is probed
+    //at most once per interval, between probes only new and newer-versioned rows are picked up. refresh() always probes
+    void setLiveProbeInterval(int msecs);
+    int liveProbeInterval() const;
+
+    void setStatsEnabled(bool enabled);
+    bool statsEnabled() const;
+    CachedSqlStats stats() const;
+    void resetStats();
 
 public slots:
     bool select();
+    bool refresh();
     bool submitAll();
     bool revertAll();
     void clear();
+    void cancelFetch();
+    void cancelSubmit();
+    void cancelImport();
+    void cancelExport();
 
 signals:
     void errorOccurred(const QSqlError &error) const;
 
+    void fetchProgress(int fetched);
+    void fetchFinished();
+    void fetchCanceled();
+    void fetchBatchSizeChanged(int size);
+
+    void totalRowCountChanged(qint64 count);
+
+    void aggregateChanged(int id);
+
+    void submitProgress(int done, int total);
+    void submitFinished(bool success);
+    void submitCanceled();
+
+    void importProgress(int rows);
+    void importFinished(int rows);
+    void importCanceled();
+    void importFailed(int rows);   //Follows errorOccurred() with the rows staged before the error, revertAll() drops them
+
+    void exportProgress(qint64 rows);
+    void exportFinished(qint64 rows);
+    void exportCanceled();
+
     void beforeInsert(QSqlRecord &record);
     void beforeUpdate(int row, QSqlRecord &record);
     void beforeDelete(int row);
@@ -73,17 +257,132 @@ signals:
     void echoLastInsertId(const QVariant &id);
 
 protected:
-    bool updateRowInTable(int row, const QSqlRecord &values);
-    bool insertRowInTable(const QSqlRecord &values);
-    bool deleteRowFromTable(int row);
-
     QSqlRecord primaryValues(int row) const;
 
-    bool exec(const QString &stmt, bool prepStatement, const QSqlRecord &rec, const QSqlRecord &whereValues);
+private:
+    friend class CachedSqlRefreshWorker;
+    friend class CachedSqlSubmitter;
+
+    typedef CachedSqlSubmitBatch SubmitBatch;
+
+    //Upper bound of bind values per batched statement, the lowest common limit across drivers (SQLite before 3.32)
+    static const int MaxBatchBindValues = 999;
+
+    static QString editStatement(QSqlDriver *driver, const QString &table, CachedRow::Op op, const QSqlRecord &rec, const QSqlRecord &whereValues, bool prepStatement);
+    static QString batchStatement(QSqlDriver *driver, const QString &table, CachedRow::Op op, const QSqlRecord &rec, const QSqlRecord &whereValues, int rows);
+    static QVariantList bindValues(const QSqlRecord &rec, const QSqlRecord &whereValues);
+    void setRowSubmitted(int row, const QSqlRecord &rec, const QVariant &insertId);
+    bool collectSubmitBatches(QVector<SubmitBatch> &batches);
+    void applySubmitted(const QVector<SubmitBatch> &batches, const QVariantList &insertIds);
+    void removeCachedRows(QVector<int> rows);
+    void emitRowsChanged(QVector<int> rows);
+
+    void stopSubmitWorker();
+    void submitWorkerFinished(const QVariantList &insertIds);
+
+    bool canCloneConnection() const;
+    CachedSqlImportWorker *startImportWorker(QChar separator, bool hasHeader);
+    void stopImportWorker();
+    void importWorkerImported(const QVector<CachedRowValues> &rows);
+    void pumpImport();
+    void appendStagedRows(const QVector<CachedRow> &rows);
+
+    void pumpExport();
+    CachedSqlExportSource exportSource() const;
+    void abandonExport();
+    void stopExportWorker();
+
+    void setRecord(const QSqlRecord &record);
+
+    bool requery(const CacheVec &pinned);
+    void resetCache(const CacheVec &pinned, const QSet<CachedRowKey> &pinnedKeys);
+    CacheVec pendingRows() const;
+    void appendFetchedRows(const QVector<CachedRowValues> &rows);
+
+    QString baseSelectStatement() const;
+    QString composeSelect(const QString &stmt, const QString &where, const QString &order = QString()) const;
+    bool isComposable() const;
+    QString effectiveFilter() const;
+
+    int sourceRow(int row) const;
+    int viewRow(int row) const;
+    QVector<int> matchingRows(const QVector<int> &rows) const;
+    void applyClientFilter();
+    void removeClientFilter();
+    void applyVisibleRows(const QVector<int> &rows);
+    void refilterRows(const QVector<int> &rows);
+    void showAppendedRows(int first, int last);
+
+    void syncSearchIndexes() const;
+    void syncRowIndexes();
+    void updateRowIndexes(int row);
+    void markAggregateChanged(int id);
+    void emitAggregateChanges();
+    static bool searchMatchType(Qt::MatchFlags flags, CachedSqlSearchIndex::MatchType &type);
+    QVector<QPair<QString, Qt::SortOrder>> keysetColumns() const;
+    QString keysetStatement(const QVector<QPair<QString, Qt::SortOrder>> &columns, QVariantList &binds, bool limited = true) const;
+    bool fetchKeysetBatch();
+    bool failKeysetBatch(const QSqlError &error);
+
+    void startFetchWorker(const QString &stmt);
+    void stopFetchWorker();
+    void fetchWorkerOpened(const QSqlRecord &record);
+    void fetchWorkerFetched(const QVector<CachedRowValues> &rows, bool exhausted);
+    void requestWorkerBatch(int count);
+    void adaptFetchBatchSize(qint64 nsecs, int rows);
+
+    QString countStatement() const;
+    void startRowCount();
+    void setTotalRowCount(qint64 count);
+    void resizeUnfetchedRows(int count);
+    void fetchUntil(int row) const;
+    void fetchUnfetchedRows();
+    bool fetchThrough(int row);
+
+    void indexRows(int first, int last);
+    void rekeyRow(int row, const CachedRowKey &before);
+    void invalidateKeyIndex();
+    void rebuildKeyIndex() const;
+
+    void shiftRows(int first, int delta);
+    void applyRowOrder(const QVector<int> &order);   //new row -> old row
+    void floatPinnedRows(int count);
+    void placePinnedRows(int first);
+    static void shiftRows(std::set<int> &rows, int first, int delta);
+
+    qint64 cacheBudgetRows() const;
+    void enforceCacheBudget();
+    bool loadRows(int first, int last);
+    void readBackRows(int row) const;
+    bool loadRowChunk(const QVector<int> &rows);
+    bool selectByKeys(const QVector<CachedRowKey> &keys, QVector<CachedRowValues> &rows, const QString &filter = QString(), bool keysOnly = false);
+    static QString keyPredicate(const QStringList &fields, int keys);
+    CachedRowKey keyOf(const CachedRowValues &values) const;
+
+    QString keysStatement() const;
+    bool selectKeys(QSet<CachedRowKey> &keys);
+    void trackVersion(const CachedRowValues &values);
+    void mergeRows(const QVector<CachedRowValues> &rows, const QVector<int> &removedRows);
+    QVector<int> missingRows(const QSet<CachedRowKey> &keys, const QSet<CachedRowKey> *candidates = nullptr) const;   //Clean rows whose key is not in keys, only among candidates if given
+    void startRefreshWorker();
+    void stopRefreshWorker();
+
+    bool startLiveUpdates();
+    void stopLiveUpdates();
+    void pollLiveUpdates();
+    bool readDataVersion(qint64 &version);
+    qint64 maxRowid();
+    void scheduleLiveUpdate(const CachedRowKey &key);
+    void applyLiveUpdates();
+    bool reloadKeys(const QVector<CachedRowKey> &keys);
+    bool reloadChanges();
+    void restoreRow(int row, const CachedRowValues &values);
+
+    CachedSqlHistogram *statsHistogram(CachedSqlHistogram &histogram);
+    qint64 cacheFootprint() const;
 
 protected:
     QSqlDatabase m_db;
-    QSqlQuery m_editQuery;
 
     QSqlRecord m_record;
     QSqlIndex m_primaryIndex;
@@ -102,6 +401,110 @@ protected:
     int m_fetchBatchSize;
     QSqlQuery m_selectQuery;
     bool m_queryExhausted;
+
+    bool m_adaptiveFetch;
+    int m_minFetchBatchSize;
+    int m_maxFetchBatchSize;
+    int m_fetchTargetDuration;   //Milliseconds one batch may keep the model's thread busy
+
+    FetchMode m_fetchMode;
+    QThread *m_fetchThread;
+    CachedSqlFetchWorker *m_fetchWorker;
+    int m_fetchGeneration;
+    bool m_fetchPending;
+
+    CachedSqlStatementCache m_statements;
+
+    QVector<int> m_keyColumns;
+    mutable QHash<CachedRowKey, int> m_keyIndex;   //Built lazily on the first lookup, then patched as rows are added, moved, removed or submitted
+    mutable bool m_keyIndexValid;
+    mutable bool m_duplicateKeys;   //Some key is held by more than one row, the index is rebuilt instead of patched when one of them goes
+
+    std::set<int> m_dirtyRows;   //Rows with unsubmitted changes, in cache order
+
+    SortMode m_sortMode;
+    QVector<QPair<QString, Qt::SortOrder>> m_sortFields;   //Server side ORDER BY, field names survive a schema reset
+    int m_floatingRows;   //Pinned rows at the top that the server sorted rows fetched so far have not reached yet
+    QSet<CachedRowKey> m_pinnedKeys;
+
+    FilterMode m_filterMode;
+    CachedSqlFilter m_rowFilter;
+    QString m_rowFilterSql;       //Row filter added to the query's WHERE clause when it is applied on the server
+    bool m_clientFilter;          //The row filter is applied to the cache, rows are shown through m_visibleRows
+    QVector<int> m_visibleRows;   //Cache rows passing the row filter in cache order, view row -> cache row
+
+    mutable QHash<int, CachedSqlSearchIndex> m_searchIndexes;   //By column, rows appended to the cache are indexed on the next sync
+
+    QHash<int, CachedSqlAggregate> m_aggregates;   //By the id addAggregate() handed out
+    int m_nextAggregateId;
+    QSet<int> m_changedAggregates;   //Aggregates to signal once control returns to the event loop
+
+    QVariantList m_keysetLast;   //Keyset column values of the last fetched row
+
+    QString m_versionColumn;   //Column bumped on every change, lets refresh() ask only for newer rows
+    QVariant m_lastVersion;    //Highest version seen so far
+
+    qint64 m_cacheBudget;   //0 keeps every fetched row resident
+    CacheBudgetUnit m_cacheBudgetUnit;
+    std::set<int> m_residentRows;   //Rows holding their values, only tracked while a budget is set
+    int m_evictedCount;
+    qint64 m_rowBytes;   //Running estimate of the memory held by one resident row
+    mutable int m_lastAccessedRow;
+    mutable bool m_budgetQueued;   //A read through data() queued a pass of enforceCacheBudget()
+
+    RowCountMode m_rowCountMode;
+    qint64 m_totalRowCount;   //-1 until a count has been reported
+    int m_unfetchedRows;      //Counted rows past the cache, reported by rowCount() but not materialized yet
+    int m_countGeneration;
+    QSet<QThread *> m_countThreads;
+    mutable int m_fetchUntilRow;   //Furthest unfetched row data() has been asked for, -1 when none is queued
+
+    bool m_liveUpdates;
+    QString m_liveChannel;              //Notification channel, the table name when empty
+    bool m_liveSubscribed;              //The model subscribed the channel itself and has to unsubscribe it
+    QMetaObject::Connection m_liveConnection;
+    QTimer m_livePollTimer;             //Polls PRAGMA data_version, or refreshes on drivers without notifications
+    QTimer m_liveDelayTimer;            //Collapses a burst of changes into one update
+    qint64 m_dataVersion;
+    qint64 m_liveRowid;                 //Highest SQLite rowid seen, -1 when rows cannot be told apart by rowid
+    QSet<CachedRowKey> m_liveKeys;      //Rows named by notifications since the last update
+    bool m_liveRefreshAll;              //A change that could not be tied to a row, refresh() everything
+    bool m_liveDelta;                   //SQLite reported a commit, reload the rows it changed
+    int m_liveProbeInterval;            //Shortest time between two probes of a large cache's keys
+    QTimer m_liveProbeTimer;            //Runs a probe that was deferred to the end of the interval
+    QElapsedTimer m_liveProbeClock;     //Time since the cached keys were last probed, invalid before the first probe
+
+    bool m_statsEnabled;
+    CachedSqlStats m_stats;
+
+    QThread *m_refreshThread;
+    CachedSqlRefreshWorker *m_refreshWorker;
+    int m_refreshGeneration;
+
+    QThread *m_submitThread;
+    CachedSqlSubmitWorker *m_submitWorker;
+    int m_submitGeneration;
+    QVector<SubmitBatch> m_submitBatches;   //Snapshot handed to the submit worker, applied to the cache once it commits
+
+    QThread *m_importThread;
+    CachedSqlImportWorker *m_importWorker;
+    int m_importGeneration;
+    int m_importedCount;
+    QPointer<QIODevice> m_importDevice;   //Source of importCsv(QIODevice *), read on this thread
+    int m_importPending;                  //Chunks handed to the worker and not parsed yet
+    bool m_importInputDone;               //A sequential device has finished its read channel
+    bool m_importFinishing;
+
+    QThread *m_exportThread;
+    CachedSqlExportWorker *m_exportWorker;
+    int m_exportGeneration;
+    ExportValues m_exportValues;
+    bool m_exportDrain;                 //The worker reads the rest of the result once the cached rows are written
+    int m_exportRow;                    //Next cache row to hand to the worker
+    int m_exportEnd;                    //Cached rows at the start of the export, rows fetched later come from the worker's cursor
+    int m_exportPending;                //Chunks handed to the worker and not written yet
+    qint64 m_exportedCount;
+    bool m_exportFinishing;
 };
 
 // helpers for building SQL expressions
@@ -117,13 +520,21 @@ public:
     // "and" is a C++ keyword
     inline const static QLatin1StringView et() { return QLatin1StringView("AND"); }
     inline const static QLatin1StringView from() { return QLatin1StringView("FROM"); }
+    inline const static QLatin1StringView gt() { return QLatin1StringView(">"); }
+    inline const static QLatin1StringView in() { return QLatin1StringView("IN"); }
+    inline const static QLatin1StringView isNotNull() { return QLatin1StringView("IS NOT NULL"); }
+    inline const static QLatin1StringView isNull() { return QLatin1StringView("IS NULL"); }
     inline const static QLatin1StringView leftJoin() { return QLatin1StringView("LEFT JOIN"); }
+    inline const static QLatin1StringView limit() { return QLatin1StringView("LIMIT"); }
+    inline const static QLatin1StringView lt() { return QLatin1StringView("<"); }
     inline const static QLatin1StringView on() { return QLatin1StringView("ON"); }
     inline const static QLatin1StringView orderBy() { return QLatin1StringView("ORDER BY"); }
     inline const static QLatin1StringView parenClose() { return QLatin1StringView(")"); }
     inline const static QLatin1StringView parenOpen() { return QLatin1StringView("("); }
     inline const static QLatin1StringView select() { return QLatin1StringView("SELECT"); }
     inline const static QLatin1StringView sp() { return QLatin1StringView(" "); }
+    // "or" is a C++ keyword
+    inline const static QLatin1StringView vel() { return QLatin1StringView("OR"); }
     inline const static QLatin1StringView where() { return QLatin1StringView("WHERE"); }
 
     // Build expressions based on key words
@@ -135,11 +546,18 @@ public:
     inline const static QString eq(const QString &a, const QString &b) { return QString(a).append(eq()).append(b); }
     inline const static QString et(const QString &a, const QString &b) { return a.isEmpty() ? b : b.isEmpty() ? a : concat(concat(a, et()), b); }
     inline const static QString from(const QString &s) { return concat(from(), s); }
+    inline const static QString gt(const QString &a, const QString &b) { return QString(a).append(gt()).append(b); }
+    inline const static QString in(const QString &a, const QString &b) { return concat(concat(a, in()), paren(b)); }
+    inline const static QString isNotNull(const QString &s) { return concat(s, isNotNull()); }
+    inline const static QString isNull(const QString &s) { return concat(s, isNull()); }
     inline const static QString leftJoin(const QString &s) { return concat(leftJoin(), s); }
+    inline const static QString limit(const QString &s) { return s.isEmpty() ? s : concat(limit(), s); }
+    inline const static QString lt(const QString &a, const QString &b) { return QString(a).append(lt()).append(b); }
     inline const static QString on(const QString &s) { return concat(on(), s); }
     inline const static QString orderBy(const QString &s) { return s.isEmpty() ? s : concat(orderBy(), s); }
     inline const static QString paren(const QString &s) { return s.isEmpty() ? s : parenOpen() + s + parenClose(); }
     inline const static QString select(const QString &s) { return concat(select(), s); }
+    inline const static QString vel(const QString &a, const QString &b) { return a.isEmpty() ? b : b.isEmpty() ? a : concat(concat(a, vel()), b); }
     inline const static QString where(const QString &s) { return s.isEmpty() ? s : concat(where(), s); }
 };
 
@@ -0,0 +1,106 @@
+#ifndef CACHEDSQLTESTDATABASE_H
+#define CACHEDSQLTESTDATABASE_H
+
+#include "cachedsqltablemodel.h"
+
+#include <QDebug>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+
+//Temporary SQLite file shared by the tests: one connection for the model and a second one standing in for another client
+class CachedSqlTestDatabase
+{
+public:
+    bool open(const QString &name)
+    {
+        if (!m_dir.isValid())
+            return false;
+
+        const QString path = m_dir.filePath(name + QStringLiteral(".sqlite"));
+
+        m_db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), QStringLiteral("model"));
+        m_db.setDatabaseName(path);
+
+        m_writerDb = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), QStringLiteral("writer"));
+        m_writerDb.setDatabaseName(path);
+
+        return m_db.open() && m_writerDb.open()
+            && exec(QStringLiteral("CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT, amount REAL, version INTEGER NOT NULL DEFAULT 1)"));
+    }
+
+    void close()
+    {
+        m_db = QSqlDatabase();
+        m_writerDb = QSqlDatabase();
+        QSqlDatabase::removeDatabase(QStringLiteral("model"));
+        QSqlDatabase::removeDatabase(QStringLiteral("writer"));
+    }
+
+    QSqlDatabase db() const { return m_db; }
+    QSqlDatabase writer() const { return m_writerDb; }
+    QString filePath(const QString &name) const { return m_dir.filePath(name); }
+
+    //Statements run on the writer connection, as another client would run them
+    bool exec(const QString &stmt)
+    {
+        QSqlQuery query(m_writerDb);
+
+        if (query.exec(stmt))
+            return true;
+
+        qWarning() << stmt << query.lastError().text();
+        return false;
+    }
+
+    //Rows 1..count named "item <id>" with an amount of id / 2
+    bool fillItems(int count)
+    {
+        if (!m_writerDb.transaction())
+            return false;
+
+        QSqlQuery query(m_writerDb);
+
+        if (!query.prepare(QStringLiteral("INSERT INTO items (id, name, amount) VALUES (?, ?, ?)")))
+            return false;
+
+        for (int id = 1; id <= count; ++id) {
+            query.bindValue(0, id);
+            query.bindValue(1, QStringLiteral("item %1").arg(id));
+            query.bindValue(2, id * 0.5);
+
+            if (!query.exec()) {
+                qWarning() << query.lastError().text();
+                m_writerDb.rollback();
+                return false;
+            }
+        }
+
+        return m_writerDb.commit();
+    }
+
+    //-1 when the table cannot be read
+    qint64 count(const QString &where = QString())
+    {
+        QSqlQuery query(m_writerDb);
+
+        if (!query.exec(QStringLiteral("SELECT COUNT(*) FROM items") + (where.isEmpty() ? QString() : QStringLiteral(" WHERE ") + where)) || !query.next())
+            return -1;
+
+        return query.value(0).toLongLong();
+    }
+
+    static void fetchAll(CachedSqlTableModel &model)
+    {
+        while (model.canFetchMore())
+            model.fetchMore();
+    }
+
+private:
+    QTemporaryDir m_dir;
+    QSqlDatabase m_db;
+    QSqlDatabase m_writerDb;
+};
+
+#endif // CACHEDSQLTESTDATABASE_H
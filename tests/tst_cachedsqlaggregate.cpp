@@ -0,0 +1,195 @@
+//Incremental aggregates over the cache against a temporary SQLite file
+#include "cachedsqltestdatabase.h"
+
+#include <QCoreApplication>
+#include <QSet>
+#include <QSignalSpy>
+#include <QTest>
+
+class tst_CachedSqlAggregate : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void matchesSql();
+    void followsEdits();
+    void exactDecimalSum();
+    void emptySum();
+
+private:
+    QVariant select(const QString &expr, const QString &where = QString());
+
+    CachedSqlTestDatabase m_db;
+};
+
+void tst_CachedSqlAggregate::init()
+{
+    QVERIFY(m_db.open(QString::fromLatin1(QTest::currentTestFunction())));
+}
+
+void tst_CachedSqlAggregate::cleanup()
+{
+    m_db.close();
+}
+
+void tst_CachedSqlAggregate::matchesSql()
+{
+    QVERIFY(m_db.fillItems(1000));
+    QVERIFY(m_db.exec(QStringLiteral("UPDATE items SET version = id % 5")));
+    QVERIFY(m_db.exec(QStringLiteral("UPDATE items SET amount = NULL WHERE id % 13 = 0")));
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    QVERIFY(model.select());
+    CachedSqlTestDatabase::fetchAll(model);
+
+    const int count = model.addAggregate(2, CachedSqlAggregate::Count);
+    const int sum = model.addAggregate(2, CachedSqlAggregate::Sum, 3);
+    const int average = model.addAggregate(2, CachedSqlAggregate::Average, 3);
+    const int minimum = model.addAggregate(2, CachedSqlAggregate::Minimum, 3);
+    const int maximum = model.addAggregate(2, CachedSqlAggregate::Maximum, 3);
+    const int idSum = model.addAggregate(0, CachedSqlAggregate::Sum);
+
+    //The same results SQLite gives over the table, NULL amounts are skipped
+    QCOMPARE(model.aggregate(count).toLongLong(), select(QStringLiteral("COUNT(amount)")).toLongLong());
+    QCOMPARE(model.aggregate(sum).toDouble(), select(QStringLiteral("SUM(amount)")).toDouble());
+    QCOMPARE(model.aggregate(idSum).typeId(), int(QMetaType::LongLong));
+    QCOMPARE(model.aggregate(idSum).toLongLong(), select(QStringLiteral("SUM(id)")).toLongLong());
+
+    const QVariantList groups = model.aggregateGroups(sum);
+    QCOMPARE(groups.count(), 5);
+
+    for (const QVariant &group : groups) {
+        const QString where = QStringLiteral("version = %1").arg(group.toInt());
+
+        QCOMPARE(model.aggregate(sum, group).toDouble(), select(QStringLiteral("SUM(amount)"), where).toDouble());
+        QCOMPARE(model.aggregate(average, group).toDouble(), select(QStringLiteral("AVG(amount)"), where).toDouble());
+        QCOMPARE(model.aggregate(minimum, group).toDouble(), select(QStringLiteral("MIN(amount)"), where).toDouble());
+        QCOMPARE(model.aggregate(maximum, group).toDouble(), select(QStringLiteral("MAX(amount)"), where).toDouble());
+    }
+}
+
+void tst_CachedSqlAggregate::followsEdits()
+{
+    QVERIFY(m_db.fillItems(10));
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    QVERIFY(model.select());
+    CachedSqlTestDatabase::fetchAll(model);
+
+    const int count = model.addAggregate(2, CachedSqlAggregate::Count);
+    const int sum = model.addAggregate(2, CachedSqlAggregate::Sum, 3);
+    const int maximum = model.addAggregate(2, CachedSqlAggregate::Maximum);
+    const int idSum = model.addAggregate(0, CachedSqlAggregate::Sum);
+
+    QCOMPARE(model.aggregate(sum).toDouble(), 27.5);
+
+    QSignalSpy changed(&model, &CachedSqlTableModel::aggregateChanged);
+
+    //Staged edits count straight away, a staged delete no longer does
+    QVERIFY(model.setData(model.index(0, 2), 100.0));
+    QVERIFY(model.removeRows(9, 1));
+
+    QSqlRecord rec = model.record();
+    rec.setValue(QStringLiteral("id"), 11);
+    rec.setValue(QStringLiteral("name"), QStringLiteral("new 11"));
+    rec.setValue(QStringLiteral("amount"), 1.0);
+    rec.setValue(QStringLiteral("version"), 2);
+    QVERIFY(model.appendRecords({rec}));
+
+    //Moving a row to another group takes it out of the first one
+    QVERIFY(model.setData(model.index(1, 3), 2));
+
+    QCOMPARE(model.aggregate(count).toLongLong(), qint64(10));
+    QCOMPARE(model.aggregate(sum).toDouble(), 123.0);
+    QCOMPARE(model.aggregate(sum, 1).toDouble(), 121.0);
+    QCOMPARE(model.aggregate(sum, 2).toDouble(), 2.0);
+    QCOMPARE(model.aggregate(maximum).toDouble(), 100.0);
+    QCOMPARE(model.aggregate(idSum).toLongLong(), qint64(56));
+
+    //The burst is reported once per aggregate when control returns to the event loop
+    QCOMPARE(changed.count(), 0);
+    QCoreApplication::processEvents();
+
+    QSet<int> ids;
+
+    for (const QList<QVariant> &args : changed)
+        ids.insert(args.front().toInt());
+
+    QCOMPARE(changed.count(), 4);
+    QCOMPARE(ids, (QSet<int>{count, sum, maximum, idSum}));
+
+    //Submitting leaves the results where the table now is
+    QVERIFY2(model.submitAll(), qPrintable(model.lastError().text()));
+
+    QCOMPARE(model.aggregate(sum).toDouble(), select(QStringLiteral("SUM(amount)")).toDouble());
+    QCOMPARE(model.aggregate(sum, 2).toDouble(), select(QStringLiteral("SUM(amount)"), QStringLiteral("version = 2")).toDouble());
+    QCOMPARE(model.aggregate(idSum).toLongLong(), select(QStringLiteral("SUM(id)")).toLongLong());
+}
+
+void tst_CachedSqlAggregate::exactDecimalSum()
+{
+    //Decimal text as a NUMERIC column reads, 0.01 to 10.00
+    QVERIFY(m_db.fillItems(1000));
+    QVERIFY(m_db.exec(QStringLiteral("UPDATE items SET name = printf('%d.%02d', id / 100, id % 100)")));
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    QVERIFY(model.select());
+    CachedSqlTestDatabase::fetchAll(model);
+
+    const int sum = model.addAggregate(1, CachedSqlAggregate::Sum);
+    QVERIFY(model.aggregate(sum).toDouble() == 5005.0);
+
+    //Taking every value out and putting it back leaves no rounding error behind
+    for (int row = 0; row < 1000; ++row) {
+        const QString text = model.data(model.index(row, 1)).toString();
+        QVERIFY(model.setData(model.index(row, 1), QStringLiteral("0.1")));
+        QVERIFY(model.setData(model.index(row, 1), text));
+    }
+
+    QVERIFY(model.aggregate(sum).toDouble() == 5005.0);
+}
+
+void tst_CachedSqlAggregate::emptySum()
+{
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    QVERIFY(model.select());
+
+    //NULL over no values as in SQL, COUNT is zero
+    const int sum = model.addAggregate(0, CachedSqlAggregate::Sum);
+    const int count = model.addAggregate(0, CachedSqlAggregate::Count);
+
+    QVERIFY(model.aggregate(sum).isNull());
+    QCOMPARE(model.aggregate(count).toLongLong(), qint64(0));
+
+    QSqlRecord rec = model.record();
+    rec.setValue(QStringLiteral("id"), 7);
+    rec.setValue(QStringLiteral("version"), 1);
+    QVERIFY(model.appendRecords({rec}));
+
+    QCOMPARE(model.aggregate(sum), QVariant(qlonglong(7)));
+    QCOMPARE(model.aggregate(count).toLongLong(), qint64(1));
+
+    QVERIFY(model.removeRows(0, 1));
+    QVERIFY(model.aggregate(sum).isNull());
+}
+
+QVariant tst_CachedSqlAggregate::select(const QString &expr, const QString &where)
+{
+    QSqlQuery query(m_db.writer());
+
+    if (!query.exec(QStringLiteral("SELECT %1 FROM items").arg(expr) + (where.isEmpty() ? QString() : QStringLiteral(" WHERE ") + where)) || !query.next())
+        return QVariant();
+
+    return query.value(0);
+}
+
+QTEST_GUILESS_MAIN(tst_CachedSqlAggregate)
+
+#include "tst_cachedsqlaggregate.moc"
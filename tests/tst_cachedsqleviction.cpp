@@ -0,0 +1,79 @@
+//Bounded caches that evict rows, against a temporary SQLite file
+#include "cachedsqltestdatabase.h"
+
+#include <QCoreApplication>
+#include <QTest>
+
+class tst_CachedSqlEviction : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void deleteEvictedRow();
+    void deleteEvictedRange();
+
+private:
+    CachedSqlTestDatabase m_db;
+};
+
+void tst_CachedSqlEviction::init()
+{
+    QVERIFY(m_db.open(QString::fromLatin1(QTest::currentTestFunction())));
+}
+
+void tst_CachedSqlEviction::cleanup()
+{
+    m_db.close();
+}
+
+void tst_CachedSqlEviction::deleteEvictedRow()
+{
+    QVERIFY(m_db.fillItems(500));
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    model.setCacheBudget(50);
+    QVERIFY(model.select());
+    CachedSqlTestDatabase::fetchAll(model);
+
+    //Reading the top row keeps the rows around it, the far end of the cache is evicted
+    QCOMPARE(model.data(model.index(0, 0)).toInt(), 1);
+    QCoreApplication::processEvents();
+    QVERIFY(model.residentRowCount() < model.rowCount());
+
+    QVERIFY(model.removeRows(450, 1));
+    QVERIFY2(model.submitAll(), qPrintable(model.lastError().text()));
+
+    QCOMPARE(m_db.count(), qint64(499));
+    QCOMPARE(m_db.count(QStringLiteral("id = 451")), qint64(0));
+}
+
+void tst_CachedSqlEviction::deleteEvictedRange()
+{
+    QVERIFY(m_db.fillItems(500));
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    model.setCacheBudget(50);
+    QVERIFY(model.select());
+    CachedSqlTestDatabase::fetchAll(model);
+
+    QCOMPARE(model.data(model.index(0, 0)).toInt(), 1);
+    QCoreApplication::processEvents();
+    QVERIFY(model.residentRowCount() < model.rowCount());
+
+    //Reading the range back takes most of the budget, its keys must survive until the deletes are staged
+    QVERIFY(model.removeRows(400, 40));
+    QVERIFY2(model.submitAll(), qPrintable(model.lastError().text()));
+
+    QCOMPARE(m_db.count(), qint64(460));
+    QCOMPARE(m_db.count(QStringLiteral("id BETWEEN 401 AND 440")), qint64(0));
+    QCOMPARE(m_db.count(QStringLiteral("id = 400 OR id = 441")), qint64(2));
+}
+
+QTEST_GUILESS_MAIN(tst_CachedSqlEviction)
+
+#include "tst_cachedsqleviction.moc"
@@ -0,0 +1,136 @@
+//Row filters in the cache and on the server against a temporary SQLite file
+#include "cachedsqltestdatabase.h"
+
+#include <QSet>
+#include <QTest>
+
+class tst_CachedSqlFilter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void textMatch_data();
+    void textMatch();
+    void numericTree_data();
+    void numericTree();
+
+private:
+    static QSet<int> ids(CachedSqlTableModel &model);
+
+    CachedSqlTestDatabase m_db;
+};
+
+void tst_CachedSqlFilter::init()
+{
+    QVERIFY(m_db.open(QString::fromLatin1(QTest::currentTestFunction())));
+}
+
+void tst_CachedSqlFilter::cleanup()
+{
+    m_db.close();
+}
+
+void tst_CachedSqlFilter::textMatch_data()
+{
+    QTest::addColumn<CachedSqlTableModel::FilterMode>("mode");
+    QTest::addColumn<int>("op");
+    QTest::addColumn<QString>("needle");
+    QTest::addColumn<Qt::CaseSensitivity>("cs");
+    QTest::addColumn<QList<int>>("expected");
+
+    const QList<QPair<const char *, CachedSqlTableModel::FilterMode>> modes = {
+        {"auto", CachedSqlTableModel::AutoFilter},
+        {"client", CachedSqlTableModel::ClientFilter},
+        {"server", CachedSqlTableModel::ServerFilter}
+    };
+
+    //The same rows whether the cache or SQLite matches them
+    for (const auto &mode : modes) {
+        QTest::addRow("%s contains sensitive", mode.first) << mode.second << int(CachedSqlFilter::Contains) << QStringLiteral("apple") << Qt::CaseSensitive << QList<int>{2};
+        QTest::addRow("%s contains insensitive", mode.first) << mode.second << int(CachedSqlFilter::Contains) << QStringLiteral("apple") << Qt::CaseInsensitive << QList<int>{1, 2, 3};
+        QTest::addRow("%s starts sensitive", mode.first) << mode.second << int(CachedSqlFilter::StartsWith) << QStringLiteral("App") << Qt::CaseSensitive << QList<int>{1};
+        QTest::addRow("%s starts insensitive", mode.first) << mode.second << int(CachedSqlFilter::StartsWith) << QStringLiteral("app") << Qt::CaseInsensitive << QList<int>{1, 2, 3};
+        QTest::addRow("%s wildcard literal", mode.first) << mode.second << int(CachedSqlFilter::Contains) << QStringLiteral("100%") << Qt::CaseInsensitive << QList<int>{5};
+        QTest::addRow("%s non-ascii insensitive", mode.first) << mode.second << int(CachedSqlFilter::Contains) << QStringLiteral("ÄPFEL") << Qt::CaseInsensitive << QList<int>{6};
+    }
+}
+
+void tst_CachedSqlFilter::textMatch()
+{
+    QFETCH(CachedSqlTableModel::FilterMode, mode);
+    QFETCH(int, op);
+    QFETCH(QString, needle);
+    QFETCH(Qt::CaseSensitivity, cs);
+    QFETCH(QList<int>, expected);
+
+    QVERIFY(m_db.exec(QStringLiteral("INSERT INTO items (id, name) VALUES (1, 'Apple'), (2, 'apple pie'), (3, 'APPLE'), (4, 'banana'), "
+                                     "(5, '100% juice'), (6, 'äpfel'), (7, NULL)")));
+
+    //Partly fetched, so the automatic mode filters on the server
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    model.setAdaptiveFetch(false);
+    model.setFetchBatchSize(2);
+    model.setFilterMode(mode);
+    QVERIFY(model.select());
+
+    QVERIFY(model.setRowFilter(CachedSqlFilter(1, CachedSqlFilter::Op(op), needle, cs)));
+
+    QCOMPARE(ids(model), QSet<int>(expected.cbegin(), expected.cend()));
+}
+
+void tst_CachedSqlFilter::numericTree_data()
+{
+    QTest::addColumn<CachedSqlTableModel::FilterMode>("mode");
+
+    QTest::newRow("client") << CachedSqlTableModel::ClientFilter;
+    QTest::newRow("server") << CachedSqlTableModel::ServerFilter;
+}
+
+void tst_CachedSqlFilter::numericTree()
+{
+    QFETCH(CachedSqlTableModel::FilterMode, mode);
+
+    QVERIFY(m_db.fillItems(100));
+    QVERIFY(m_db.exec(QStringLiteral("UPDATE items SET amount = NULL WHERE id % 10 = 0")));
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    model.setFilterMode(mode);
+    QVERIFY(model.select());
+    CachedSqlTestDatabase::fetchAll(model);
+
+    //amount >= 40.5 AND (id < 90 OR amount IS NULL), a fractional constant compares as double, NULL amounts never compare
+    const CachedSqlFilter filter = CachedSqlFilter::all({
+        CachedSqlFilter(2, CachedSqlFilter::GreaterEqual, 40.5),
+        CachedSqlFilter::any({CachedSqlFilter(0, CachedSqlFilter::Less, 90), CachedSqlFilter(2, CachedSqlFilter::IsNull)})
+    });
+
+    QVERIFY(model.setRowFilter(filter));
+
+    QSet<int> expected;
+
+    for (int id = 81; id < 90; ++id)
+        expected.insert(id);
+
+    QCOMPARE(ids(model), expected);
+}
+
+QSet<int> tst_CachedSqlFilter::ids(CachedSqlTableModel &model)
+{
+    CachedSqlTestDatabase::fetchAll(model);
+
+    QSet<int> ids;
+
+    for (int row = 0; row < model.rowCount(); ++row)
+        ids.insert(model.data(model.index(row, 0)).toInt());
+
+    return ids;
+}
+
+QTEST_GUILESS_MAIN(tst_CachedSqlFilter)
+
+#include "tst_cachedsqlfilter.moc"
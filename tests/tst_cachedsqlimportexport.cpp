@@ -0,0 +1,223 @@
+//CSV import and export of the cache against a temporary SQLite file
+#include "cachedsqltestdatabase.h"
+
+#include <QBuffer>
+#include <QFile>
+#include <QSet>
+#include <QSignalSpy>
+#include <QTest>
+
+#include <cstring>
+
+//Sequential device whose bytes arrive when the test feeds them, like a socket or a pipe
+class StreamDevice : public QIODevice
+{
+public:
+    StreamDevice() { open(QIODevice::ReadOnly); }
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override { return m_data.size() + QIODevice::bytesAvailable(); }
+
+    void feed(const QByteArray &data)
+    {
+        m_data += data;
+        emit readyRead();
+    }
+
+    void finish() { emit readChannelFinished(); }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override
+    {
+        const qint64 size = qMin<qint64>(maxSize, m_data.size());
+        std::memcpy(data, m_data.constData(), size);
+        m_data.remove(0, size);
+        return size;
+    }
+
+    qint64 writeData(const char *, qint64) override { return -1; }
+
+private:
+    QByteArray m_data;
+};
+
+class tst_CachedSqlImportExport : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void importExportRoundTrip();
+    void importStream();
+    void importFailureReportsStagedRows();
+    void drainAfterSubmit();
+
+private:
+    CachedSqlTestDatabase m_db;
+};
+
+void tst_CachedSqlImportExport::init()
+{
+    QVERIFY(m_db.open(QString::fromLatin1(QTest::currentTestFunction())));
+}
+
+void tst_CachedSqlImportExport::cleanup()
+{
+    m_db.close();
+}
+
+void tst_CachedSqlImportExport::importExportRoundTrip()
+{
+    const QByteArray csv = "\"id\",\"name\",\"amount\",\"version\"\r\n"
+                           "1,alpha,1.5,1\r\n"
+                           "2,\"with, comma\",-2,1\r\n"
+                           "3,,0.25,2\r\n"
+                           "4,\"\",1e+20,3\r\n";
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    QVERIFY(model.select());
+
+    QBuffer buffer;
+    buffer.setData(csv);
+    QVERIFY(buffer.open(QIODevice::ReadOnly));
+
+    QSignalSpy imported(&model, &CachedSqlTableModel::importFinished);
+    QVERIFY(model.importCsv(&buffer));
+    QVERIFY(imported.wait());
+    QCOMPARE(imported.front().front().toInt(), 4);
+
+    QVERIFY2(model.submitAll(), qPrintable(model.lastError().text()));
+    QCOMPARE(m_db.count(), qint64(4));
+
+    const QString fileName = m_db.filePath(QStringLiteral("items.csv"));
+    QSignalSpy exported(&model, &CachedSqlTableModel::exportFinished);
+    QVERIFY(model.exportRows(fileName));
+    QVERIFY(exported.wait());
+    QCOMPARE(exported.front().front().toLongLong(), qint64(4));
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.readAll(), csv);
+}
+
+void tst_CachedSqlImportExport::importStream()
+{
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    QVERIFY(model.select());
+
+    StreamDevice device;
+    QSignalSpy finished(&model, &CachedSqlTableModel::importFinished);
+    QSignalSpy progress(&model, &CachedSqlTableModel::importProgress);
+    QVERIFY(model.importCsv(&device));
+
+    //Chunks cut through the header, a record and a quoted field with a newline in it
+    device.feed("id,na");
+    device.feed("me,amount\r\n1,alpha,1.5\r\n2,\"two");
+    QTRY_COMPARE(progress.count(), 1);
+    QCOMPARE(model.rowCount(), 1);
+
+    device.feed("\nlines\",2\r\n3,gamma");
+    QTRY_COMPARE(model.rowCount(), 2);
+
+    //The last record has no newline, it is parsed once the stream ends
+    QVERIFY(finished.isEmpty());
+    device.finish();
+
+    QVERIFY(finished.wait());
+    QCOMPARE(finished.front().front().toInt(), 3);
+    QCOMPARE(model.rowCount(), 3);
+    QCOMPARE(model.data(model.index(1, 1)).toString(), QStringLiteral("two\nlines"));
+    QCOMPARE(model.data(model.index(2, 1)).toString(), QStringLiteral("gamma"));
+    QVERIFY(!model.isImporting());
+}
+
+void tst_CachedSqlImportExport::importFailureReportsStagedRows()
+{
+    //Several chunks of good records, then one whose amount does not convert
+    QByteArray csv = "id,name,amount\n";
+
+    for (int id = 1; id <= 100000; ++id)
+        csv += QByteArray::number(id) + ",item " + QByteArray::number(id) + "," + QByteArray::number(id * 0.5) + "\n";
+
+    csv += "100001,bad,not a number\n";
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    QVERIFY(model.select());
+
+    QBuffer buffer;
+    buffer.setData(csv);
+    QVERIFY(buffer.open(QIODevice::ReadOnly));
+
+    QSignalSpy failed(&model, &CachedSqlTableModel::importFailed);
+    QSignalSpy errors(&model, &CachedSqlTableModel::errorOccurred);
+    QVERIFY(model.importCsv(&buffer));
+    QVERIFY(failed.wait());
+
+    //Everything before the failing chunk is staged and reported, nothing after it
+    QCOMPARE(errors.count(), 1);
+    QVERIFY(model.lastError().text().contains(QStringLiteral("record 100001")));
+
+    const int staged = failed.front().front().toInt();
+    QVERIFY(staged > 0);
+    QVERIFY(staged < 100000);
+    QCOMPARE(model.rowCount(), staged);
+    QVERIFY(!model.isImporting());
+
+    QVERIFY(model.revertAll());
+    QCOMPARE(model.rowCount(), 0);
+}
+
+void tst_CachedSqlImportExport::drainAfterSubmit()
+{
+    QVERIFY(m_db.fillItems(100));
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    model.setAdaptiveFetch(false);
+    model.setFetchBatchSize(10);
+    QVERIFY(model.select());
+    QCOMPARE(model.rowCount(), 10);
+
+    //Submitted deletes and inserts change which rows the rest of the result holds
+    QVERIFY(model.removeRows(0, 3));
+    QVERIFY2(model.submitAll(), qPrintable(model.lastError().text()));
+
+    QVERIFY(model.insertRows(0, 1));
+    QVERIFY(model.setData(model.index(0, 0), 1000));
+    QVERIFY(model.setData(model.index(0, 1), QStringLiteral("inserted")));
+    QVERIFY(model.setData(model.index(0, 3), 1));
+    QVERIFY2(model.submitAll(), qPrintable(model.lastError().text()));
+    QCOMPARE(m_db.count(), qint64(98));
+
+    const QString fileName = m_db.filePath(QStringLiteral("items.csv"));
+    QSignalSpy exported(&model, &CachedSqlTableModel::exportFinished);
+    QVERIFY(model.exportRows(fileName, CachedSqlTableModel::CsvExport, CachedSqlTableModel::StagedValues, true));
+    QVERIFY(exported.wait());
+    QCOMPARE(exported.front().front().toLongLong(), qint64(98));
+
+    //Every row of the table exactly once
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QList<QByteArray> lines = file.readAll().split('\n');
+
+    QSet<int> ids;
+
+    for (int i = 1; i < lines.count(); ++i) {
+        if (!lines.at(i).trimmed().isEmpty())
+            ids.insert(lines.at(i).split(',').constFirst().toInt());
+    }
+
+    QCOMPARE(ids.count(), 98);
+    QVERIFY(ids.contains(1000));
+    QVERIFY(!ids.contains(1));
+    QVERIFY(ids.contains(100));
+}
+
+QTEST_GUILESS_MAIN(tst_CachedSqlImportExport)
+
+#include "tst_cachedsqlimportexport.moc"
@@ -0,0 +1,121 @@
+//Work that normally runs on cloned connections against an in-memory SQLite database, which a clone cannot open
+#include "cachedsqltablemodel.h"
+
+#include <QSignalSpy>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+#include <QTest>
+
+class tst_CachedSqlInMemory : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void backgroundFetchIsRefused();
+    void rowCount();
+    void asyncSubmit();
+    void drainingExport();
+
+private:
+    QSqlDatabase m_db;
+    QTemporaryDir m_dir;
+};
+
+void tst_CachedSqlInMemory::init()
+{
+    m_db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), QStringLiteral("memory"));
+    m_db.setDatabaseName(QStringLiteral(":memory:"));
+    QVERIFY(m_db.open());
+
+    QSqlQuery query(m_db);
+    QVERIFY(query.exec(QStringLiteral("CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT)")));
+    QVERIFY(query.exec(QStringLiteral("WITH RECURSIVE n(id) AS (SELECT 1 UNION ALL SELECT id + 1 FROM n WHERE id < 50) "
+                                      "INSERT INTO items SELECT id, 'item ' || id FROM n")));
+}
+
+void tst_CachedSqlInMemory::cleanup()
+{
+    m_db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(QStringLiteral("memory"));
+}
+
+void tst_CachedSqlInMemory::backgroundFetchIsRefused()
+{
+    CachedSqlTableModel model(nullptr, m_db);
+    model.setTableName(QStringLiteral("items"));
+
+    QSignalSpy errors(&model, &CachedSqlTableModel::errorOccurred);
+    model.setFetchMode(CachedSqlTableModel::FetchInBackground);
+
+    QCOMPARE(errors.count(), 1);
+    QCOMPARE(model.fetchMode(), CachedSqlTableModel::FetchOnDemand);
+
+    QVERIFY(model.select());
+
+    while (model.canFetchMore())
+        model.fetchMore();
+
+    QCOMPARE(model.rowCount(), 50);
+}
+
+void tst_CachedSqlInMemory::rowCount()
+{
+    CachedSqlTableModel model(nullptr, m_db);
+    model.setTableName(QStringLiteral("items"));
+    model.setAdaptiveFetch(false);
+    model.setFetchBatchSize(10);
+    model.setRowCountMode(CachedSqlTableModel::ExactRowCount);
+    QVERIFY(model.select());
+
+    //Counted on the model's own connection, a clone would have found no table
+    QTRY_COMPARE(model.totalRowCount(), qint64(50));
+    QCOMPARE(model.rowCount(), 50);
+}
+
+void tst_CachedSqlInMemory::asyncSubmit()
+{
+    CachedSqlTableModel model(nullptr, m_db);
+    model.setTableName(QStringLiteral("items"));
+    QVERIFY(model.select());
+
+    while (model.canFetchMore())
+        model.fetchMore();
+
+    QVERIFY(model.setData(model.index(0, 1), QStringLiteral("renamed")));
+
+    //Submitted on this thread, still reported through submitFinished()
+    QSignalSpy finished(&model, &CachedSqlTableModel::submitFinished);
+    QVERIFY(model.submitAllAsync());
+    QCOMPARE(finished.count(), 1);
+    QCOMPARE(finished.front().front().toBool(), true);
+    QVERIFY(!model.isDirty());
+
+    QSqlQuery query(m_db);
+    QVERIFY(query.exec(QStringLiteral("SELECT name FROM items WHERE id = 1")) && query.next());
+    QCOMPARE(query.value(0).toString(), QStringLiteral("renamed"));
+}
+
+void tst_CachedSqlInMemory::drainingExport()
+{
+    CachedSqlTableModel model(nullptr, m_db);
+    model.setTableName(QStringLiteral("items"));
+    model.setAdaptiveFetch(false);
+    model.setFetchBatchSize(10);
+    QVERIFY(model.select());
+
+    //The rest of the result is read into the cache instead of on the worker's connection
+    const QString fileName = m_dir.filePath(QStringLiteral("items.csv"));
+    QSignalSpy exported(&model, &CachedSqlTableModel::exportFinished);
+    QVERIFY(model.exportRows(fileName, CachedSqlTableModel::CsvExport, CachedSqlTableModel::StagedValues, true));
+    QVERIFY(exported.wait());
+    QCOMPARE(exported.front().front().toLongLong(), qint64(50));
+    QCOMPARE(model.rowCount(), 50);
+}
+
+QTEST_GUILESS_MAIN(tst_CachedSqlInMemory)
+
+#include "tst_cachedsqlinmemory.moc"
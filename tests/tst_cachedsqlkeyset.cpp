@@ -0,0 +1,114 @@
+//Keyset (seek) fetching against a temporary SQLite file
+#include "cachedsqltestdatabase.h"
+
+#include <QSet>
+#include <QSignalSpy>
+#include <QTest>
+
+class tst_CachedSqlKeyset : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void failedKeysetBatchStopsFetching();
+    void nullsInSortColumn_data();
+    void nullsInSortColumn();
+
+private:
+    CachedSqlTestDatabase m_db;
+};
+
+void tst_CachedSqlKeyset::init()
+{
+    QVERIFY(m_db.open(QString::fromLatin1(QTest::currentTestFunction())));
+}
+
+void tst_CachedSqlKeyset::cleanup()
+{
+    m_db.close();
+}
+
+void tst_CachedSqlKeyset::failedKeysetBatchStopsFetching()
+{
+    QVERIFY(m_db.fillItems(50));
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    model.setFetchMode(CachedSqlTableModel::FetchByKeyset);
+    model.setFetchBatchSize(10);
+    QVERIFY(model.select());
+    QCOMPARE(model.rowCount(), 10);
+    QVERIFY(model.canFetchMore());
+
+    //The next batch is a new query, make it fail
+    QVERIFY(m_db.exec(QStringLiteral("DROP TABLE items")));
+
+    QSignalSpy errors(&model, &CachedSqlTableModel::errorOccurred);
+    model.fetchMore();
+
+    QCOMPARE(errors.count(), 1);
+    QVERIFY(!model.canFetchMore());
+    QCOMPARE(model.rowCount(), 10);
+
+    //Not run again
+    model.fetchMore();
+    QCOMPARE(errors.count(), 1);
+}
+
+void tst_CachedSqlKeyset::nullsInSortColumn_data()
+{
+    QTest::addColumn<Qt::SortOrder>("order");
+
+    QTest::newRow("ascending") << Qt::AscendingOrder;
+    QTest::newRow("descending") << Qt::DescendingOrder;
+}
+
+void tst_CachedSqlKeyset::nullsInSortColumn()
+{
+    QFETCH(Qt::SortOrder, order);
+
+    //Every third row has no amount, batch boundaries fall on NULL and non-NULL rows alike
+    QVERIFY(m_db.fillItems(50));
+    QVERIFY(m_db.exec(QStringLiteral("UPDATE items SET amount = NULL WHERE id % 3 = 0")));
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    model.setFetchMode(CachedSqlTableModel::FetchByKeyset);
+    model.setFetchBatchSize(7);
+    QVERIFY(model.select());
+
+    //Sorted on the server while the result is only partly fetched
+    model.sort(2, order);
+    CachedSqlTestDatabase::fetchAll(model);
+
+    QCOMPARE(model.rowCount(), 50);
+
+    QSet<int> ids;
+    int nulls = 0;
+
+    for (int row = 0; row < model.rowCount(); ++row) {
+        ids.insert(model.data(model.index(row, 0)).toInt());
+
+        //NULL ranks below every value: first when ascending, last when descending
+        const bool null = model.data(model.index(row, 2)).isNull();
+        const bool nullBlock = order == Qt::AscendingOrder ? row < 16 : row >= 50 - 16;
+        QCOMPARE(null, nullBlock);
+        nulls += null ? 1 : 0;
+
+        if (row > 0 && !null && !model.data(model.index(row - 1, 2)).isNull()) {
+            const double previous = model.data(model.index(row - 1, 2)).toDouble();
+            const double current = model.data(model.index(row, 2)).toDouble();
+            QVERIFY(order == Qt::AscendingOrder ? previous <= current : previous >= current);
+        }
+    }
+
+    QCOMPARE(ids.count(), 50);
+    QCOMPARE(nulls, 16);
+}
+
+QTEST_GUILESS_MAIN(tst_CachedSqlKeyset)
+
+#include "tst_cachedsqlkeyset.moc"
@@ -0,0 +1,192 @@
+//Live updates on SQLite: a second connection writes to the same database file while the model polls PRAGMA data_version
+#include "cachedsqltablemodel.h"
+
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+#include <QTest>
+
+class tst_CachedSqlLiveUpdates : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void insertedRowAppears();
+    void deletedRowDisappears();
+    void versionedUpdateIsReloaded();
+    void unversionedUpdateIsReloaded();
+    void filteredOutRowDisappears();
+    void largeCacheProbesOncePerInterval();
+
+private:
+    void exec(QSqlDatabase db, const QString &stmt);
+    CachedSqlTableModel *createModel(bool versioned);
+    int rowOf(const CachedSqlTableModel &model, int id) const;
+
+    QTemporaryDir m_dir;
+    QSqlDatabase m_modelDb;
+    QSqlDatabase m_writerDb;
+    CachedSqlTableModel *m_model = nullptr;
+};
+
+void tst_CachedSqlLiveUpdates::init()
+{
+    QVERIFY(m_dir.isValid());
+
+    //Both connections open the same file, only the writer changes it
+    const QString path = m_dir.filePath(QStringLiteral("%1.sqlite").arg(QTest::currentTestFunction()));
+
+    m_modelDb = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), QStringLiteral("model"));
+    m_modelDb.setDatabaseName(path);
+    QVERIFY(m_modelDb.open());
+
+    m_writerDb = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), QStringLiteral("writer"));
+    m_writerDb.setDatabaseName(path);
+    QVERIFY(m_writerDb.open());
+
+    exec(m_writerDb, QStringLiteral("CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT, version INTEGER NOT NULL)"));
+
+    for (int id = 1; id <= 3; ++id)
+        exec(m_writerDb, QStringLiteral("INSERT INTO items VALUES (%1, 'item %1', 1)").arg(id));
+}
+
+void tst_CachedSqlLiveUpdates::cleanup()
+{
+    delete m_model;
+    m_model = nullptr;
+
+    m_modelDb = QSqlDatabase();
+    m_writerDb = QSqlDatabase();
+    QSqlDatabase::removeDatabase(QStringLiteral("model"));
+    QSqlDatabase::removeDatabase(QStringLiteral("writer"));
+}
+
+void tst_CachedSqlLiveUpdates::insertedRowAppears()
+{
+    CachedSqlTableModel *model = createModel(false);
+    QVERIFY(model);
+
+    exec(m_writerDb, QStringLiteral("INSERT INTO items VALUES (4, 'item 4', 1)"));
+
+    QTRY_COMPARE(model->rowCount(), 4);
+    QCOMPARE(model->data(model->index(rowOf(*model, 4), 1)).toString(), QStringLiteral("item 4"));
+}
+
+void tst_CachedSqlLiveUpdates::deletedRowDisappears()
+{
+    CachedSqlTableModel *model = createModel(true);
+    QVERIFY(model);
+
+    exec(m_writerDb, QStringLiteral("DELETE FROM items WHERE id = 2"));
+
+    QTRY_COMPARE(model->rowCount(), 2);
+    QCOMPARE(rowOf(*model, 2), -1);
+}
+
+void tst_CachedSqlLiveUpdates::versionedUpdateIsReloaded()
+{
+    CachedSqlTableModel *model = createModel(true);
+    QVERIFY(model);
+
+    exec(m_writerDb, QStringLiteral("UPDATE items SET name = 'renamed', version = 2 WHERE id = 3"));
+
+    QTRY_COMPARE(model->data(model->index(rowOf(*model, 3), 1)).toString(), QStringLiteral("renamed"));
+    QCOMPARE(model->rowCount(), 3);
+}
+
+void tst_CachedSqlLiveUpdates::unversionedUpdateIsReloaded()
+{
+    CachedSqlTableModel *model = createModel(false);
+    QVERIFY(model);
+
+    exec(m_writerDb, QStringLiteral("UPDATE items SET name = 'renamed' WHERE id = 1"));
+
+    QTRY_COMPARE(model->data(model->index(rowOf(*model, 1), 1)).toString(), QStringLiteral("renamed"));
+    QCOMPARE(model->rowCount(), 3);
+}
+
+void tst_CachedSqlLiveUpdates::filteredOutRowDisappears()
+{
+    CachedSqlTableModel *model = createModel(true);
+    QVERIFY(model);
+
+    model->setFilter(QStringLiteral("name <> 'hidden'"));
+    QVERIFY(model->select());
+
+    exec(m_writerDb, QStringLiteral("UPDATE items SET name = 'hidden', version = 2 WHERE id = 1"));
+
+    QTRY_COMPARE(model->rowCount(), 2);
+    QCOMPARE(rowOf(*model, 1), -1);
+}
+
+void tst_CachedSqlLiveUpdates::largeCacheProbesOncePerInterval()
+{
+    //More cached rows than are probed on every commit
+    QVERIFY(m_writerDb.transaction());
+
+    for (int id = 4; id <= 10010; ++id)
+        exec(m_writerDb, QStringLiteral("INSERT INTO items VALUES (%1, 'item %1', 1)").arg(id));
+
+    QVERIFY(m_writerDb.commit());
+
+    CachedSqlTableModel *model = createModel(false);
+    QVERIFY(model);
+    model->setLiveProbeInterval(2000);
+
+    //The first commit is probed right away
+    exec(m_writerDb, QStringLiteral("DELETE FROM items WHERE id = 2"));
+    QTRY_COMPARE(rowOf(*model, 2), -1);
+
+    //Within the interval new rows still arrive, the delete waits for the next probe
+    exec(m_writerDb, QStringLiteral("DELETE FROM items WHERE id = 3"));
+    exec(m_writerDb, QStringLiteral("INSERT INTO items VALUES (20000, 'item 20000', 1)"));
+    QTRY_VERIFY(rowOf(*model, 20000) != -1);
+    QVERIFY(rowOf(*model, 3) != -1);
+
+    QTRY_COMPARE(rowOf(*model, 3), -1);
+    QCOMPARE(model->rowCount(), 10009);
+}
+
+void tst_CachedSqlLiveUpdates::exec(QSqlDatabase db, const QString &stmt)
+{
+    QSqlQuery query(db);
+    QVERIFY2(query.exec(stmt), qPrintable(query.lastError().text()));
+}
+
+CachedSqlTableModel *tst_CachedSqlLiveUpdates::createModel(bool versioned)
+{
+    m_model = new CachedSqlTableModel(nullptr, m_modelDb);
+    m_model->setTableName(QStringLiteral("items"));
+
+    if (versioned)
+        m_model->setVersionColumn(QStringLiteral("version"));
+
+    if (!m_model->select())
+        return nullptr;
+
+    while (m_model->canFetchMore())
+        m_model->fetchMore();
+
+    m_model->setLiveUpdateInterval(10);
+    m_model->setLiveUpdateDelay(0);
+
+    return m_model->setLiveUpdates(true) ? m_model : nullptr;
+}
+
+int tst_CachedSqlLiveUpdates::rowOf(const CachedSqlTableModel &model, int id) const
+{
+    for (int row = 0; row < model.rowCount(); ++row) {
+        if (model.data(model.index(row, 0)).toInt() == id)
+            return row;
+    }
+
+    return -1;
+}
+
+QTEST_GUILESS_MAIN(tst_CachedSqlLiveUpdates)
+
+#include "tst_cachedsqlliveupdates.moc"
@@ -0,0 +1,131 @@
+//Find in grid through the search index against a temporary SQLite file
+#include "cachedsqltestdatabase.h"
+
+#include <QCoreApplication>
+#include <QTest>
+
+class tst_CachedSqlSearch : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void indexMatchesScan_data();
+    void indexMatchesScan();
+    void followsEdits();
+    void findsEvictedRows();
+
+private:
+    CachedSqlTestDatabase m_db;
+};
+
+void tst_CachedSqlSearch::init()
+{
+    QVERIFY(m_db.open(QString::fromLatin1(QTest::currentTestFunction())));
+}
+
+void tst_CachedSqlSearch::cleanup()
+{
+    m_db.close();
+}
+
+void tst_CachedSqlSearch::indexMatchesScan_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<Qt::MatchFlags>("flags");
+
+    QTest::newRow("contains") << QStringLiteral("item 1") << Qt::MatchFlags(Qt::MatchContains);
+    QTest::newRow("contains folded") << QStringLiteral("ITEM 2") << Qt::MatchFlags(Qt::MatchContains);
+    QTest::newRow("contains sensitive") << QStringLiteral("Item") << Qt::MatchFlags(Qt::MatchContains | Qt::MatchCaseSensitive);
+    QTest::newRow("short needle") << QStringLiteral("7") << Qt::MatchFlags(Qt::MatchContains);
+    QTest::newRow("starts with") << QStringLiteral("item 19") << Qt::MatchFlags(Qt::MatchStartsWith);
+    QTest::newRow("exactly") << QStringLiteral("item 42") << Qt::MatchFlags(Qt::MatchExactly);
+    QTest::newRow("exactly other case") << QStringLiteral("ITEM 42") << Qt::MatchFlags(Qt::MatchExactly);
+    QTest::newRow("fixed string") << QStringLiteral("ITEM 42") << Qt::MatchFlags(Qt::MatchFixedString);
+    QTest::newRow("non-ascii") << QStringLiteral("ÄPFEL") << Qt::MatchFlags(Qt::MatchContains);
+    QTest::newRow("no match") << QStringLiteral("banana") << Qt::MatchFlags(Qt::MatchContains);
+}
+
+void tst_CachedSqlSearch::indexMatchesScan()
+{
+    QFETCH(QString, text);
+    QFETCH(Qt::MatchFlags, flags);
+
+    QVERIFY(m_db.fillItems(300));
+    QVERIFY(m_db.exec(QStringLiteral("UPDATE items SET name = 'Item ' || id WHERE id % 3 = 0")));
+    QVERIFY(m_db.exec(QStringLiteral("UPDATE items SET name = 'äpfel ' || id WHERE id % 50 = 0")));
+    QVERIFY(m_db.exec(QStringLiteral("UPDATE items SET name = NULL WHERE id % 70 = 0")));
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    QVERIFY(model.select());
+    CachedSqlTestDatabase::fetchAll(model);
+
+    //The same rows as the linear scan QAbstractItemModel::match() does
+    const QVector<int> scanned = model.findRows(1, text, flags);
+
+    model.setSearchIndexed(1, true);
+    QVERIFY(model.isSearchIndexed(1));
+
+    QCOMPARE(model.findRows(1, text, flags), scanned);
+}
+
+void tst_CachedSqlSearch::followsEdits()
+{
+    QVERIFY(m_db.fillItems(100));
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    model.setAdaptiveFetch(false);
+    model.setFetchBatchSize(40);
+    QVERIFY(model.select());
+    model.setSearchIndexed(1, true);
+
+    //Edited rows and rows fetched after the index was built are searched as well
+    QVERIFY(model.setData(model.index(3, 1), QStringLiteral("needle")));
+    CachedSqlTestDatabase::fetchAll(model);
+    QVERIFY(model.setData(model.index(90, 1), QStringLiteral("Needle")));
+
+    QCOMPARE(model.findRows(1, QStringLiteral("needle")), (QVector<int>{3, 90}));
+    QCOMPARE(model.findRows(1, QStringLiteral("item 4"), Qt::MatchExactly), QVector<int>());
+    QCOMPARE(model.findRows(1, QStringLiteral("Needle"), Qt::MatchExactly), QVector<int>{90});
+
+    //Rows are reported where the view shows them after a client sort
+    model.setSortMode(CachedSqlTableModel::ClientSort);
+    model.sort(0, Qt::DescendingOrder);
+
+    QCOMPARE(model.findRows(1, QStringLiteral("needle")), (QVector<int>{9, 96}));
+
+    const QModelIndexList found = model.match(model.index(0, 1), Qt::DisplayRole, QStringLiteral("need"), -1, Qt::MatchStartsWith);
+    QCOMPARE(found.count(), 2);
+    QCOMPARE(found.at(0).row(), 9);
+    QCOMPARE(found.at(1).row(), 96);
+}
+
+void tst_CachedSqlSearch::findsEvictedRows()
+{
+    QVERIFY(m_db.fillItems(500));
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    model.setCacheBudget(50);
+    QVERIFY(model.select());
+    CachedSqlTestDatabase::fetchAll(model);
+    model.setSearchIndexed(1, true);
+
+    QCOMPARE(model.data(model.index(0, 0)).toInt(), 1);
+    QCoreApplication::processEvents();
+    QVERIFY(model.residentRowCount() < model.rowCount());
+
+    //Case sensitive matches are checked against the indexed text, not the evicted values
+    QCOMPARE(model.findRows(1, QStringLiteral("item 450"), Qt::MatchExactly), QVector<int>{449});
+    QCOMPARE(model.findRows(1, QStringLiteral("ITEM 450"), Qt::MatchExactly), QVector<int>());
+    QCOMPARE(model.findRows(1, QStringLiteral("item 45"), Qt::MatchStartsWith | Qt::MatchCaseSensitive),
+             (QVector<int>{44, 449, 450, 451, 452, 453, 454, 455, 456, 457, 458}));
+}
+
+QTEST_GUILESS_MAIN(tst_CachedSqlSearch)
+
+#include "tst_cachedsqlsearch.moc"
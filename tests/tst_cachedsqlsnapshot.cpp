@@ -0,0 +1,88 @@
+//Saving and loading snapshots of the cache against a temporary SQLite file
+#include "cachedsqltestdatabase.h"
+
+#include <QTest>
+
+class tst_CachedSqlSnapshot : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void partialSnapshotReload();
+    void validationRunsInBackground();
+
+private:
+    bool saveSnapshot(const QString &path, int fetchBatchSize);
+
+    CachedSqlTestDatabase m_db;
+};
+
+void tst_CachedSqlSnapshot::init()
+{
+    QVERIFY(m_db.open(QString::fromLatin1(QTest::currentTestFunction())));
+}
+
+void tst_CachedSqlSnapshot::cleanup()
+{
+    m_db.close();
+}
+
+void tst_CachedSqlSnapshot::partialSnapshotReload()
+{
+    QVERIFY(m_db.fillItems(30));
+
+    const QString path = m_db.filePath(QStringLiteral("items.snapshot"));
+    QVERIFY(saveSnapshot(path, 10));
+
+    //Rows the snapshot never held must come back even though their versions are not newer than any it saw
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    model.setVersionColumn(QStringLiteral("version"));
+    QVERIFY(model.loadSnapshot(path));
+    QCOMPARE(model.rowCount(), 10);
+
+    QTRY_COMPARE(model.rowCount(), 30);
+}
+
+void tst_CachedSqlSnapshot::validationRunsInBackground()
+{
+    QVERIFY(m_db.fillItems(30));
+
+    const QString path = m_db.filePath(QStringLiteral("items.snapshot"));
+    QVERIFY(saveSnapshot(path, 100));
+
+    //Changed behind the snapshot's back
+    QVERIFY(m_db.exec(QStringLiteral("DELETE FROM items WHERE id = 5")));
+    QVERIFY(m_db.exec(QStringLiteral("UPDATE items SET name = 'renamed', version = 2 WHERE id = 7")));
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    model.setVersionColumn(QStringLiteral("version"));
+    QVERIFY(model.loadSnapshot(path));
+
+    //The snapshot is shown as saved, nothing has been read on this thread yet
+    QCOMPARE(model.rowCount(), 30);
+    QCOMPARE(model.data(model.index(6, 1)).toString(), QStringLiteral("item 7"));
+
+    //The worker's results are merged once they arrive
+    QTRY_COMPARE(model.rowCount(), 29);
+    QTRY_COMPARE(model.data(model.index(5, 1)).toString(), QStringLiteral("renamed"));
+}
+
+bool tst_CachedSqlSnapshot::saveSnapshot(const QString &path, int fetchBatchSize)
+{
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    model.setVersionColumn(QStringLiteral("version"));
+    model.setAdaptiveFetch(false);
+    model.setFetchBatchSize(fetchBatchSize);
+
+    return model.select() && model.saveSnapshot(path);
+}
+
+QTEST_GUILESS_MAIN(tst_CachedSqlSnapshot)
+
+#include "tst_cachedsqlsnapshot.moc"
@@ -0,0 +1,121 @@
+//Sorting in the cache and on the server against a temporary SQLite file
+#include "cachedsqltestdatabase.h"
+
+#include <QTest>
+
+class tst_CachedSqlSort : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void multiKeySort();
+    void clientSortReplacesServerOrder();
+
+private:
+    static QStringList names(const CachedSqlTableModel &model);
+
+    CachedSqlTestDatabase m_db;
+};
+
+void tst_CachedSqlSort::init()
+{
+    QVERIFY(m_db.open(QString::fromLatin1(QTest::currentTestFunction())));
+}
+
+void tst_CachedSqlSort::cleanup()
+{
+    m_db.close();
+}
+
+void tst_CachedSqlSort::multiKeySort()
+{
+    //Enough rows for the keys to be extracted and the runs sorted on several threads, with many ties in the first key
+    const int count = 40000;
+    QVERIFY(m_db.fillItems(count));
+    QVERIFY(m_db.exec(QStringLiteral("UPDATE items SET amount = id % 7")));
+    QVERIFY(m_db.exec(QStringLiteral("UPDATE items SET amount = NULL WHERE id % 1000 = 0")));
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    QVERIFY(model.select());
+    CachedSqlTestDatabase::fetchAll(model);
+    QCOMPARE(model.rowCount(), count);
+
+    //An edited row and a persistent index have to move with the permutation
+    QVERIFY(model.setData(model.index(4, 1), QStringLiteral("edited")));
+    const QPersistentModelIndex edited(model.index(4, 1));
+
+    model.setSortMode(CachedSqlTableModel::ClientSort);
+    model.sort(QList<CachedSqlSortColumn>{{2, Qt::AscendingOrder}, {0, Qt::DescendingOrder}});
+
+    QCOMPARE(model.rowCount(), count);
+
+    //NULL ranks below every value, ties on the amount are broken by the id in descending order
+    for (int row = 1; row < count; ++row) {
+        const QVariant previousAmount = model.data(model.index(row - 1, 2));
+        const QVariant amount = model.data(model.index(row, 2));
+        const int previousId = model.data(model.index(row - 1, 0)).toInt();
+        const int id = model.data(model.index(row, 0)).toInt();
+
+        if (previousAmount.isNull() != amount.isNull()) {
+            QVERIFY(previousAmount.isNull());
+        } else if (amount.isNull() || previousAmount.toDouble() == amount.toDouble()) {
+            QVERIFY2(previousId > id, qPrintable(QStringLiteral("row %1").arg(row)));
+        } else {
+            QVERIFY2(previousAmount.toDouble() < amount.toDouble(), qPrintable(QStringLiteral("row %1").arg(row)));
+        }
+    }
+
+    QVERIFY(edited.isValid());
+    QCOMPARE(model.data(model.index(edited.row(), 0)).toInt(), 5);
+    QCOMPARE(edited.data().toString(), QStringLiteral("edited"));
+    QVERIFY(model.isDirty(edited));
+    QVERIFY(model.isDirty());
+}
+
+void tst_CachedSqlSort::clientSortReplacesServerOrder()
+{
+    QVERIFY(m_db.fillItems(30));
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    model.setAdaptiveFetch(false);
+    model.setFetchBatchSize(10);
+    QVERIFY(model.select());
+
+    //Partly fetched, ordered by the server
+    model.setSortMode(CachedSqlTableModel::ServerSort);
+    model.sort(0, Qt::DescendingOrder);
+    CachedSqlTestDatabase::fetchAll(model);
+    QCOMPARE(model.data(model.index(0, 0)).toInt(), 30);
+
+    //Then sorted in the cache on another column
+    model.setSortMode(CachedSqlTableModel::ClientSort);
+    model.sort(1, Qt::AscendingOrder);
+
+    QStringList expected = names(model);
+    std::sort(expected.begin(), expected.end());
+    QCOMPARE(names(model), expected);
+
+    //Selecting again keeps the order the rows were last shown in
+    QVERIFY(model.select());
+    CachedSqlTestDatabase::fetchAll(model);
+    QCOMPARE(names(model), expected);
+}
+
+QStringList tst_CachedSqlSort::names(const CachedSqlTableModel &model)
+{
+    QStringList names;
+
+    for (int row = 0; row < model.rowCount(); ++row)
+        names.append(model.data(model.index(row, 1)).toString());
+
+    return names;
+}
+
+QTEST_GUILESS_MAIN(tst_CachedSqlSort)
+
+#include "tst_cachedsqlsort.moc"
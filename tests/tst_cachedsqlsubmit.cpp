@@ -0,0 +1,181 @@
+//Submitting staged changes against a temporary SQLite file
+#include "cachedsqltestdatabase.h"
+
+#include <QSignalSpy>
+#include <QTest>
+
+class tst_CachedSqlSubmit : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void batchedSubmit();
+    void failedSubmitRollsBack();
+    void asyncSubmit();
+    void cancelAsyncSubmit();
+
+private:
+    static QList<QSqlRecord> newItems(const CachedSqlTableModel &model, int first, int count);
+
+    CachedSqlTestDatabase m_db;
+};
+
+void tst_CachedSqlSubmit::init()
+{
+    QVERIFY(m_db.open(QString::fromLatin1(QTest::currentTestFunction())));
+}
+
+void tst_CachedSqlSubmit::cleanup()
+{
+    m_db.close();
+}
+
+void tst_CachedSqlSubmit::batchedSubmit()
+{
+    QVERIFY(m_db.fillItems(3000));
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    QVERIFY(model.select());
+    CachedSqlTestDatabase::fetchAll(model);
+
+    //More deletes and inserts than fit in one statement's bind values
+    for (int row = 0; row < 1000; ++row)
+        QVERIFY(model.setData(model.index(row, 2), -1.0));
+
+    QVERIFY(model.removeRows(1000, 1500));
+    QVERIFY(model.appendRecords(newItems(model, 5001, 1500)));
+
+    QVERIFY2(model.submitAll(), qPrintable(model.lastError().text()));
+
+    QVERIFY(!model.isDirty());
+    QCOMPARE(model.rowCount(), 3000);
+    QCOMPARE(m_db.count(), qint64(3000));
+    QCOMPARE(m_db.count(QStringLiteral("amount = -1")), qint64(1000));
+    QCOMPARE(m_db.count(QStringLiteral("id BETWEEN 1001 AND 2500")), qint64(0));
+    QCOMPARE(m_db.count(QStringLiteral("id > 5000")), qint64(1500));
+}
+
+void tst_CachedSqlSubmit::failedSubmitRollsBack()
+{
+    QVERIFY(m_db.fillItems(20));
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    QVERIFY(model.select());
+    CachedSqlTestDatabase::fetchAll(model);
+
+    //Deletes and updates go first and succeed, the insert reuses a key that is still taken
+    QVERIFY(model.removeRows(0, 3));
+    QVERIFY(model.setData(model.index(5, 1), QStringLiteral("renamed")));
+    QVERIFY(model.appendRecords(newItems(model, 10, 1)));
+
+    QSignalSpy errors(&model, &CachedSqlTableModel::errorOccurred);
+    QVERIFY(!model.submitAll());
+    QCOMPARE(errors.count(), 1);
+
+    //Nothing reached the table and every row keeps its pending change
+    QCOMPARE(m_db.count(), qint64(20));
+    QCOMPARE(m_db.count(QStringLiteral("name = 'renamed'")), qint64(0));
+    QVERIFY(model.isDirty());
+    QCOMPARE(model.rowCount(), 21);
+    QCOMPARE(model.data(model.index(5, 1)).toString(), QStringLiteral("renamed"));
+
+    //Once the key is fixed the whole submit goes through again, including the statements that had succeeded before the rollback
+    QVERIFY(model.setData(model.index(20, 0), 500));
+    QVERIFY2(model.submitAll(), qPrintable(model.lastError().text()));
+
+    QVERIFY(!model.isDirty());
+    QCOMPARE(model.rowCount(), 18);
+    QCOMPARE(m_db.count(), qint64(18));
+    QCOMPARE(m_db.count(QStringLiteral("id <= 3")), qint64(0));
+    QCOMPARE(m_db.count(QStringLiteral("name = 'renamed'")), qint64(1));
+    QCOMPARE(m_db.count(QStringLiteral("id = 500")), qint64(1));
+}
+
+void tst_CachedSqlSubmit::asyncSubmit()
+{
+    QVERIFY(m_db.fillItems(20));
+
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    QVERIFY(model.select());
+    CachedSqlTestDatabase::fetchAll(model);
+
+    //One batch of each operation
+    QVERIFY(model.setData(model.index(0, 1), QStringLiteral("renamed")));
+    QVERIFY(model.setData(model.index(1, 1), QStringLiteral("renamed")));
+    QVERIFY(model.removeRows(5, 5));
+    QVERIFY(model.appendRecords(newItems(model, 100, 10)));
+
+    QSignalSpy finished(&model, &CachedSqlTableModel::submitFinished);
+    QSignalSpy progress(&model, &CachedSqlTableModel::submitProgress);
+    QVERIFY(model.submitAllAsync());
+    QVERIFY(model.isSubmitting());
+
+    //Nothing is applied to the cache until the worker has committed
+    QVERIFY(model.isDirty());
+
+    QVERIFY(finished.wait());
+    QCOMPARE(finished.front().front().toBool(), true);
+    QCOMPARE(progress.constLast().at(0).toInt(), 17);
+    QCOMPARE(progress.constLast().at(1).toInt(), 17);
+
+    QVERIFY(!model.isSubmitting());
+    QVERIFY(!model.isDirty());
+    QCOMPARE(model.rowCount(), 25);
+    QCOMPARE(m_db.count(), qint64(25));
+    QCOMPARE(m_db.count(QStringLiteral("name = 'renamed'")), qint64(2));
+    QCOMPARE(m_db.count(QStringLiteral("id BETWEEN 6 AND 10")), qint64(0));
+    QCOMPARE(m_db.count(QStringLiteral("id >= 100")), qint64(10));
+}
+
+void tst_CachedSqlSubmit::cancelAsyncSubmit()
+{
+    CachedSqlTableModel model(nullptr, m_db.db());
+    model.setTableName(QStringLiteral("items"));
+    QVERIFY(model.select());
+
+    //Enough rows that the worker is still busy when the cancel arrives
+    QVERIFY(model.appendRecords(newItems(model, 1, 20000)));
+
+    QSignalSpy canceled(&model, &CachedSqlTableModel::submitCanceled);
+    QSignalSpy finished(&model, &CachedSqlTableModel::submitFinished);
+    QVERIFY(model.submitAllAsync());
+    model.cancelSubmit();
+
+    QVERIFY(canceled.wait());
+    QCOMPARE(finished.count(), 0);
+
+    //Rolled back, the rows keep their pending inserts and can be submitted again
+    QVERIFY(!model.isSubmitting());
+    QCOMPARE(m_db.count(), qint64(0));
+    QVERIFY(model.isDirty());
+    QCOMPARE(model.rowCount(), 20000);
+
+    QVERIFY2(model.submitAll(), qPrintable(model.lastError().text()));
+    QCOMPARE(m_db.count(), qint64(20000));
+}
+
+QList<QSqlRecord> tst_CachedSqlSubmit::newItems(const CachedSqlTableModel &model, int first, int count)
+{
+    QList<QSqlRecord> records;
+    QSqlRecord rec = model.record();
+
+    for (int id = first; id < first + count; ++id) {
+        rec.setValue(QStringLiteral("id"), id);
+        rec.setValue(QStringLiteral("name"), QStringLiteral("new %1").arg(id));
+        rec.setValue(QStringLiteral("amount"), id * 0.5);
+        rec.setValue(QStringLiteral("version"), 1);
+        records.append(rec);
+    }
+
+    return records;
+}
+
+QTEST_GUILESS_MAIN(tst_CachedSqlSubmit)
+
+#include "tst_cachedsqlsubmit.moc"